@@ -0,0 +1,28 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/* DebugOutput buffer for ZX_SCHEDULER, the console task sends it to USART1 without waiting.
+ * Written by the main loop and the USB interrupt. A message that does not fit is dropped and counted. */
+
+void ConsoleWrite(const char *text, size_t length);
+bool ConsoleReady();
+void ConsoleSend();
@@ -0,0 +1,98 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "stm32f4xx_hal.h"
+#include "my_config.h"
+#include "cycles.h"
+
+/* Critical sections against the USB interrupt and SysTick. With ZX_IRQ_AUDIT they raise BASEPRI to
+ * CRITICAL_PRIORITY, the KBD_RD interrupt (priority 0) still answers inside, and they are timed.
+ * Otherwise they set PRIMASK and hold the KBD_RD interrupt off too. */
+
+#define CRITICAL_PRIORITY 1 /* OTG_FS, the highest priority a section masks */
+#define CRITICAL_BASEPRI (CRITICAL_PRIORITY << (8 - __NVIC_PRIO_BITS))
+
+typedef struct {
+    uint32_t mask; /* BASEPRI or PRIMASK to restore */
+#if ZX_IRQ_AUDIT
+    uint32_t start;
+#endif
+} Critical;
+
+void CriticalMeasured(uint32_t cycles, const char *name);
+void CriticalAudit();
+void CriticalReport();
+
+static inline void CriticalEnter(Critical *c) {
+#if ZX_IRQ_AUDIT
+    c->mask = __get_BASEPRI();
+    __set_BASEPRI_MAX(CRITICAL_BASEPRI);
+    c->start = Cycles();
+#else
+    c->mask = __get_PRIMASK();
+    __disable_irq();
+#endif
+}
+
+static inline void CriticalExit(Critical *c, const char *name) {
+#if ZX_IRQ_AUDIT
+    const uint32_t cycles = Cycles() - c->start;
+    __set_BASEPRI(c->mask);
+    CriticalMeasured(cycles, name);
+#else
+    (void)name;
+    __set_PRIMASK(c->mask);
+#endif
+}
+
+/* Sections against the USB interrupt alone, for thread mode code too long to hold KBD_RD off with PRIMASK
+ * (a formatted console line, a key scan). OTG_FS is masked in the NVIC, KBD_RD and SysTick still run. In an
+ * interrupt, or with OTG_FS already off, they do nothing. Timed like the others with ZX_IRQ_AUDIT. */
+static inline void CriticalUsbEnter(Critical *c) {
+    c->mask = __get_IPSR() == 0 && NVIC_GetEnableIRQ(OTG_FS_IRQn);
+    if (c->mask)
+        NVIC_DisableIRQ(OTG_FS_IRQn);
+#if ZX_IRQ_AUDIT
+    c->start = Cycles();
+#endif
+}
+
+static inline void CriticalUsbExit(Critical *c, const char *name) {
+#if ZX_IRQ_AUDIT
+    const uint32_t cycles = Cycles() - c->start;
+#endif
+    if (!c->mask)
+        return;
+    NVIC_EnableIRQ(OTG_FS_IRQn);
+#if ZX_IRQ_AUDIT
+    CriticalMeasured(cycles, name);
+#else
+    (void)name;
+#endif
+}
+
+/* Masks what a section masks until reset, for Error_Handler */
+static inline void CriticalHalt() {
+#if ZX_IRQ_AUDIT
+    __set_BASEPRI_MAX(CRITICAL_BASEPRI);
+#else
+    __disable_irq();
+#endif
+}
@@ -0,0 +1,36 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "stm32f4xx_hal.h"
+
+/* Cortex-M4 cycle counter, runs at HCLK (84 MHz) */
+
+static inline void CyclesInit() {
+    /* The counter is not reset, ZxTimer keeps an offset to it */
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+static inline uint32_t Cycles() {
+    return DWT->CYCCNT;
+}
+
+static inline uint32_t CyclesToNs(uint32_t cycles) {
+    return (uint32_t)((uint64_t)cycles * 1000 / (SystemCoreClock / 1000000));
+}
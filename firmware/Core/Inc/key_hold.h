@@ -0,0 +1,46 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "responder.h"
+
+/* Pulse stretching. A key stays visible to the ZX for at least a number of keyboard scans after it is pressed,
+ * so a tap between two scans is not lost, and is released at the first scan after that. Only scans that start
+ * after the press count, a scan running at the press may have read its row already. */
+
+#define KEY_HOLD_MASK 0x1F /* D0-D4, the other bits are RESET, MAGIC and modes */
+#define KEY_HOLD_BITS 5
+
+typedef struct {
+    uint8_t scans;                               /* Minimal number of scans */
+    uint8_t pressed[ZX_MATRIX_ROWS];             /* Last reported keys */
+    uint8_t holding[ZX_MATRIX_ROWS];             /* Keys not scanned enough yet */
+    uint8_t visible[ZX_MATRIX_ROWS];             /* pressed | holding */
+    uint8_t left[ZX_MATRIX_ROWS][KEY_HOLD_BITS]; /* Scans left for a holding key */
+} KeyHold;
+
+void KeyHoldInit(KeyHold *h, unsigned scans);
+
+/* New key state from the keyboard, returns the keys to show. scanning - a scan has started and its
+ * KeyHoldScan has not come yet. */
+const uint8_t *KeyHoldReport(KeyHold *h, const uint8_t *zx_matrix, bool scanning);
+
+/* The ZX has scanned the keyboard, returns true if h->visible changed */
+bool KeyHoldScan(KeyHold *h);
@@ -0,0 +1,64 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/* Latency histogram with 1 cycle buckets, the last bucket collects everything longer, the longest is kept exactly. */
+
+#define LATENCY_BUCKETS 256
+
+typedef struct {
+    uint32_t count[LATENCY_BUCKETS];
+    uint32_t max;
+    uint32_t max_at; /* Write time of the longest */
+} LatencyHistogram;
+
+typedef struct {
+    uint32_t total;
+    uint32_t min;
+    uint32_t max; /* Exact, not limited to the buckets */
+    uint32_t max_at;
+    uint32_t p50;
+    uint32_t p99;
+    uint32_t p999;
+} LatencySummary;
+
+/* Two histograms: the interrupt handler fills one, the report takes it and the handler goes on with the other */
+typedef struct {
+    LatencyHistogram histograms[2];
+    LatencyHistogram *volatile active;
+} LatencyRecorder;
+
+static inline void LatencyAdd(LatencyHistogram *h, uint32_t cycles, uint32_t at) {
+    h->count[cycles < LATENCY_BUCKETS ? cycles : LATENCY_BUCKETS - 1]++;
+    if (cycles > h->max) {
+        h->max = cycles;
+        h->max_at = at;
+    }
+}
+
+/* From the interrupt handler. Both times on the same wrapping timebase. */
+static inline void LatencyRecord(LatencyRecorder *r, uint32_t edge, uint32_t write) {
+    LatencyAdd(r->active, write - edge, write);
+}
+
+void LatencyClear(LatencyHistogram *h);
+void LatencySummarize(const LatencyHistogram *h, LatencySummary *s);
+void LatencyRecorderInit(LatencyRecorder *r);
+void LatencyTake(LatencyRecorder *r, LatencySummary *s);
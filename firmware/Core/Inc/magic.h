@@ -0,0 +1,25 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/* MAGIC (PB9) pulse from the start of an M1 cycle, made by TIM4 in one-pulse mode started by TIM3 on M1.
+ * Interrupts stay enabled, a ZX without M1 cycles is given up after ZX_MAGIC_TIMEOUT_MS. */
+
+void MagicInit();
+void MagicPress();
+void MagicPoll();
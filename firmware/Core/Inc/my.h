@@ -1,4 +1,9 @@
 #pragma once
 
+#include <stdint.h>
+
 void MyInit();
 void MyIdle();
+void MyRun();
+void MyUsbTransferDone(uint8_t pipe);
+void MyUsbConnected();
@@ -0,0 +1,197 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/* Build options. Override them from the command line, for example:
+ * make MY_DEFS="-DZX_RESPONDER=ZX_RESPONDER_FOLLOW -DZX_STATS=1" */
+
+/* Keyboard port responder
+ * ZX_RESPONDER_IORQ   - answer from the KBD_RD (PA5) falling edge interrupt. The answer must be
+ *                       ready in about 1.5 T-states, enough for 3.5 MHz machines only.
+ * ZX_RESPONDER_FOLLOW - the main loop keeps D0-D4 matching the current A8-A15, within about 290 ns
+ *                       of an address change without interrupts. Enough for 3.5 MHz, not for a new
+ *                       address on 7 and 14 MHz clones, see responder.c. The KBD_RD interrupt is kept
+ *                       as a fallback for the time the main loop is busy with USB.
+ * ZX_RESPONDER_DMA    - KBD_RD edge starts a TIM2 -> TIM1 -> DMA2 chain which copies the value to D0-D4
+ *                       without the CPU. Fixed latency, no jitter from USB and SysTick interrupts. */
+#define ZX_RESPONDER_IORQ 0
+#define ZX_RESPONDER_FOLLOW 1
+#define ZX_RESPONDER_DMA 2
+
+#ifndef ZX_RESPONDER
+#define ZX_RESPONDER ZX_RESPONDER_IORQ
+#endif
+
+/* How the port value is prepared and looked up, see the table in responder.c
+ * ZX_KERNEL_TABLE  - 256 byte table, the fastest lookup, the slowest publish
+ * ZX_KERNEL_NIBBLE - two 16 byte tables ANDed in the lookup
+ * ZX_KERNEL_SIMD   - 8 row bytes reduced with Cortex-M4 DSP byte instructions in the lookup */
+#define ZX_KERNEL_TABLE 0
+#define ZX_KERNEL_NIBBLE 1
+#define ZX_KERNEL_SIMD 2
+
+#ifndef ZX_KERNEL
+#define ZX_KERNEL ZX_KERNEL_TABLE
+#endif
+
+#if ZX_RESPONDER == ZX_RESPONDER_DMA && ZX_KERNEL != ZX_KERNEL_TABLE
+#error "The DMA responder needs ZX_KERNEL_TABLE"
+#endif
+
+/* Run the KBD_RD interrupt handler and take its vector from SRAM, so the interrupt latency does not depend
+ * on the flash wait states and on what the ART accelerator holds after the USB stack */
+#ifndef ZX_RAM_ISR
+#define ZX_RAM_ISR 0
+#endif
+
+/* Take the KBD_RD interrupt handler from Core/Src/responder_asm.s. Its time to the GPIOA->ODR write is fixed
+ * whatever the compiler and OPT, the build counts it and fails over RESPONDER_BUDGET_NS in the Makefile. */
+#ifndef ZX_ASM_RESPONDER
+#define ZX_ASM_RESPONDER 0
+#endif
+
+#if ZX_ASM_RESPONDER && ZX_KERNEL != ZX_KERNEL_TABLE
+#error "The assembler responder needs ZX_KERNEL_TABLE"
+#endif
+
+/* Decode keyboard reports and publish them from the USB interrupt (priority 1, below KBD_RD) as soon as
+ * the transfer completes. 0 - from MyIdle in the main loop, after USBH_Process has moved the report.
+ * The publish then runs inside the interrupt and stops the follow loop for as long as it takes. */
+#ifndef ZX_PUBLISH_IRQ
+#define ZX_PUBLISH_IRQ 0
+#endif
+
+/* Swap the port tables only between keyboard scans of the ZX, so all half-row reads of one scan see the same
+ * keys. The board sees KBD_RD but not the interrupt acknowledge, so a scan is over once KBD_RD has been quiet
+ * for ZX_FRAME_GAP_US. A new table waits for that at most ZX_FRAME_WAIT_US, programs that read the keyboard
+ * all the time still get it. The added latency is printed with ZX_STATS. */
+#ifndef ZX_PUBLISH_FRAME
+#define ZX_PUBLISH_FRAME 0
+#endif
+
+#ifndef ZX_FRAME_GAP_US
+#define ZX_FRAME_GAP_US 1000
+#endif
+
+#ifndef ZX_FRAME_WAIT_US
+#define ZX_FRAME_WAIT_US 20000
+#endif
+
+/* Recover the ZX frame clock from KBD_RD and M1 (TIM3 on PA6) and tell the machine, see zx_clock.h */
+#ifndef ZX_CLOCK
+#define ZX_CLOCK 0
+#endif
+
+/* Poll the keyboards on the SOF ZX_POLL_LEAD_US before the expected keyboard scan as well, so the report
+ * read by the ZX is as fresh as possible whatever bInterval is. The lead covers the main loop issuing the
+ * transfer and the transfer in the next USB frame. Needs ZX_CLOCK. */
+#ifndef ZX_POLL_JIT
+#define ZX_POLL_JIT 0
+#endif
+
+#ifndef ZX_POLL_LEAD_US
+#define ZX_POLL_LEAD_US 2000
+#endif
+
+#if ZX_POLL_JIT
+#undef ZX_CLOCK
+#define ZX_CLOCK 1
+#endif
+
+/* Keep every pressed key visible for at least ZX_HOLD_SCANS keyboard scans, so a short tap between two
+ * scans is not lost, 2 is enough. Scans are counted with ZX_CLOCK, 20 ms frames otherwise. 0 - off. */
+#ifndef ZX_HOLD_SCANS
+#define ZX_HOLD_SCANS 0
+#endif
+
+#if ZX_HOLD_SCANS > 254
+#error "ZX_HOLD_SCANS is 254 at most, a key pressed during a scan waits for one more"
+#endif
+
+/* MAGIC pulse width and how long to wait for an M1 cycle to start it */
+#ifndef ZX_MAGIC_PULSE_US
+#define ZX_MAGIC_PULSE_US 1
+#endif
+
+#ifndef ZX_MAGIC_TIMEOUT_MS
+#define ZX_MAGIC_TIMEOUT_MS 100
+#endif
+
+/* The pulse is counted by the 16 bit TIM4 at HCLK (84 MHz) without a prescaler */
+#if 1 + ZX_MAGIC_PULSE_US * 84 > 0xFFFF
+#error "ZX_MAGIC_PULSE_US does not fit TIM4, 780 us at most"
+#endif
+
+/* Run the main loop as a scheduler, see sched.h. Keys, USB host, console and stats are tasks by priority, woken
+ * by the OTG interrupt and keyboard reports, and DebugOutput goes through a ZX_CONSOLE_BUFFER byte buffer instead of
+ * waiting for the UART. ZX_STATS prints CPU use and the longest run of every task. */
+#ifndef ZX_SCHEDULER
+#define ZX_SCHEDULER 0
+#endif
+
+#ifndef ZX_CONSOLE_BUFFER
+#define ZX_CONSOLE_BUFFER 2048
+#endif
+
+/* Measure timings and print them to UART every ZX_STATS_PERIOD_MS */
+#ifndef ZX_STATS
+#define ZX_STATS 0
+#endif
+
+#ifndef ZX_STATS_PERIOD_MS
+#define ZX_STATS_PERIOD_MS 5000
+#endif
+
+/* Print publish and lookup cycles of the responder kernel at start */
+#ifndef ZX_BENCHMARK
+#define ZX_BENCHMARK 0
+#endif
+
+#if ZX_BENCHMARK
+#undef ZX_STATS
+#define ZX_STATS 1
+#endif
+
+/* Critical sections raise BASEPRI above the KBD_RD interrupt instead of masking all interrupts, and are timed,
+ * see critical.h. The interrupt priorities are checked at start. The longest time the KBD_RD interrupt was held
+ * off for any reason is the ZX_LATENCY max, so this turns it on. */
+#ifndef ZX_IRQ_AUDIT
+#define ZX_IRQ_AUDIT 0
+#endif
+
+#if ZX_IRQ_AUDIT
+#undef ZX_LATENCY
+#define ZX_LATENCY 1
+#endif
+
+/* Histogram of the KBD_RD edge to GPIOA->ODR write time of the interrupt responder.
+ * The edge is captured by TIM2, the write is timestamped with the DWT cycle counter. */
+#ifndef ZX_LATENCY
+#define ZX_LATENCY 0
+#endif
+
+#if ZX_LATENCY
+#if ZX_RESPONDER == ZX_RESPONDER_DMA
+#error "ZX_LATENCY measures the interrupt responder"
+#endif
+#if ZX_ASM_RESPONDER
+#error "ZX_LATENCY needs the C interrupt handler"
+#endif
+#undef ZX_STATS
+#define ZX_STATS 1
+#endif
@@ -0,0 +1,110 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Keyboard and gamepad input report layout compiled from the HID report descriptor once at enumeration,
+ * so decoding a report is a few loops over known bit ranges without walking the descriptor.
+ * All input fields must be in one report. Keyboard usages E0-E7 go to the modifier mask, others from
+ * KEY_A (4) to the key bitmap. Gamepad X and Y axes, hat switch and buttons of a Joystick or Game Pad
+ * application collection go to the joystick mask, axes through thresholds computed here. */
+
+#define REPORT_PLAN_MAX_FIELDS 8
+
+enum { REPORT_PLAN_BITMAP, REPORT_PLAN_ARRAY, REPORT_PLAN_BUTTONS, REPORT_PLAN_HAT, REPORT_PLAN_AXIS_X, REPORT_PLAN_AXIS_Y };
+#define REPORT_PLAN_SIGNED 0x80 /* axis type flag, the value is two's complement */
+
+/* Joystick mask, directions in the order of the arrow key codes */
+#define REPORT_PLAN_JOY_RIGHT (1 << 0)
+#define REPORT_PLAN_JOY_LEFT (1 << 1)
+#define REPORT_PLAN_JOY_DOWN (1 << 2)
+#define REPORT_PLAN_JOY_UP (1 << 3)
+#define REPORT_PLAN_JOY_DIRECTIONS 4
+#define REPORT_PLAN_JOY_BUTTON1 REPORT_PLAN_JOY_DIRECTIONS /* bit of button 1, the others follow */
+#define REPORT_PLAN_JOY_BUTTONS 12
+
+#if (REPORT_PLAN_JOY_RIGHT | REPORT_PLAN_JOY_LEFT | REPORT_PLAN_JOY_DOWN | REPORT_PLAN_JOY_UP) !=                    \
+    (1 << REPORT_PLAN_JOY_DIRECTIONS) - 1
+#error "The joystick directions must be the low REPORT_PLAN_JOY_DIRECTIONS bits"
+#endif
+
+typedef struct {
+    uint8_t type;
+    uint8_t size; /* bits per element */
+    union {
+        struct {
+            uint8_t count;       /* elements */
+            uint8_t usage;       /* usage of the first bit (bitmap, buttons) or of logical_min (array) */
+            uint8_t logical_min; /* array, hat */
+            uint8_t logical_max; /* array */
+        };
+        struct {
+            uint16_t low;  /* axis, below is left or up */
+            uint16_t high; /* axis, above is right or down */
+        };
+    };
+    uint16_t offset; /* bit offset after the report ID */
+} ReportPlanField;
+
+typedef struct {
+    uint8_t report_id; /* 0 - no report IDs */
+    uint8_t fields_count;
+    ReportPlanField fields[REPORT_PLAN_MAX_FIELDS];
+} ReportPlan;
+
+#define REPORT_PLAN_MAX_IDS 8
+
+typedef struct {
+    uint32_t page; /* 0 - the global usage page */
+    uint32_t min;
+    uint32_t max;
+    unsigned count;
+    bool broken;         /* not a continuous range */
+    uint8_t x, y, hat;   /* position in the usage list + 1, 0 - not listed */
+} ReportPlanUsages;
+
+/* Compiler state, the descriptor can be fed in chunks of any size as it arrives */
+typedef struct {
+    ReportPlan *plan;
+    struct {
+        uint8_t id;
+        uint16_t bits;
+    } ids[REPORT_PLAN_MAX_IDS];
+    uint8_t ids_count;
+    uint8_t item[5]; /* short item being received, prefix and up to 4 data bytes */
+    uint8_t item_fill;
+    bool failed;
+    int input_id;       /* report ID of the keyboard or gamepad fields */
+    unsigned depth;     /* collections */
+    bool gamepad;       /* inside a Joystick or Game Pad application collection */
+    uint32_t usage_page, report_size, report_count, report_id;
+    int32_t logical_min, logical_max;
+    ReportPlanUsages usages;
+} ReportPlanCompiler;
+
+void ReportPlanBegin(ReportPlanCompiler *c, ReportPlan *plan);
+void ReportPlanFeed(ReportPlanCompiler *c, const uint8_t *desc, unsigned length);
+
+/* Returns false if there is no keyboard or gamepad input or the descriptor uses unsupported items */
+bool ReportPlanEnd(ReportPlanCompiler *c);
+
+/* Returns false if the report does not carry the planned fields (another report ID) */
+bool ReportPlanDecode(const ReportPlan *plan, const uint8_t *report, unsigned length, uint8_t *modifiers,
+                      uint32_t keys[8], uint16_t *joystick);
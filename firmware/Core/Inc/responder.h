@@ -0,0 +1,32 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#define ZX_MATRIX_ROWS 8
+
+void ResponderInit();
+void ResponderPublish(const uint8_t *zx_matrix);
+void ResponderSwap();
+void ResponderFollow();
+void ResponderReport();
+void ResponderLatencyMax(uint32_t *cycles, uint32_t *at);
+
+void ResponderDmaInit(const uint8_t *table);
+void ResponderDmaSelect(const uint8_t *table);
@@ -0,0 +1,58 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Run-to-completion scheduler of the main loop, ZX_SCHEDULER. A pass runs the highest priority task that is
+ * woken by an interrupt, due by its period or ready by its own check, then starts from the top again. A task
+ * due again right after its run gives way once to the next due one, so a busy task does not starve the rest.
+ * Tasks are not preempted, the budget only reports long runs and lets a task stop early. */
+
+/* By priority, the highest first */
+typedef enum {
+    TASK_KEYS = 0, /* MAGIC, frame clock, short taps, frame swap. A keyboard report wakes it. */
+    TASK_USB,      /* USB host state machine. OTG events and SOF wake it. */
+    TASK_CONSOLE,  /* DebugOutput buffer to the UART */
+    TASK_STATS,    /* ZX_STATS report */
+    TASK_FOLLOW,   /* ZX_RESPONDER_FOLLOW loop, until a wake, the next tick or the end of its slice */
+    TASK_COUNT
+} TaskId;
+
+typedef struct {
+    const char *name;
+    void (*run)();
+    bool (*ready)();    /* Runs while it returns true, NULL - wakes and period only */
+    uint32_t period_ms; /* 0 - no period */
+    uint32_t budget;    /* Cycles of one run, longer runs are reported */
+} Task;
+
+extern volatile uint8_t sched_wake[TASK_COUNT];
+extern volatile uint8_t sched_woken; /* Any wake since the pass started, for a long task to give way */
+
+/* From interrupts too, the task runs once for any number of wakes before it starts */
+static inline void SchedWake(TaskId task) {
+    sched_wake[task] = 1;
+    sched_woken = 1;
+}
+
+void SchedInit(const Task *tasks, void (*idle)());
+void SchedRun();
+bool SchedBudgetOver();
+void SchedReport();
@@ -0,0 +1,54 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* ZX frame clock recovered from the keyboard scans of the interrupt handler, which come once a frame,
+ * and the M1 rate counted by TIM3 on PA6. Times are TIM2 ticks, HCLK cycles. */
+
+typedef enum {
+    ZX_MODEL_UNKNOWN,
+    ZX_MODEL_48K,      /* 69888 T-states at 3.5 MHz, 19.968 ms */
+    ZX_MODEL_128K,     /* 70908 T-states at 3.5469 MHz, 19.992 ms */
+    ZX_MODEL_PENTAGON, /* 71680 T-states at 3.5 MHz, 20.48 ms */
+    ZX_MODEL_TURBO,    /* M1 rate above a 3.5 MHz CPU */
+} ZxModel;
+
+typedef struct {
+    uint32_t frame;   /* Frame length, 0 until locked */
+    uint32_t scan;    /* End of the last keyboard scan */
+    uint32_t cpu_khz; /* CPU clock from the highest M1 rate, HALT fetches one every 4 T-states */
+    ZxModel model;
+} ZxClock;
+
+extern ZxClock zx_clock;
+
+void ZxClockInit();
+void ZxClockUpdate();
+void ZxClockReport();
+
+static inline bool ZxClockLocked() {
+    return zx_clock.frame != 0;
+}
+
+/* Expected end of the next keyboard scan */
+static inline uint32_t ZxClockNextScan() {
+    return zx_clock.scan + zx_clock.frame;
+}
@@ -0,0 +1,131 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "report_plan.h"
+
+/* ZX Spectrum keyboard
+ * ┌─────┬─────┬─────┬─────┬─────┬─────┬─────┬─────┬─────┬─────┐ ┌───────┐
+ * │ 1 ! │ 2 @ │ 3 # │ 4 $ │ 5 % │ 6 & │ 7 ` │ 8 ( │ 9 ) │ 0 _ │ │ RESET │
+ * ├─────┼─────┼─────┼─────┼─────┼─────┼─────┼─────┼─────┼─────┤ ├───────┤
+ * │ Q<= │ W<> │ E=> │ R < │ T > │  Y  │  U  │  I  │ O ; │ P " │ │ MAGIC │
+ * ├─────┼─────┼─────┼─────┼─────┼─────┼─────┼─────┼─────┼─────┤ └───────┘
+ * │  A  │  S  │  D  │  F  │  G  │ H ^ │ J - │ K + │ L = │ ENT │
+ * ├─────┼─────┼─────┼─────┼─────┼─────┼─────┼─────┼─────┼─────┤
+ * │ CAP │ Z : │  X  │ C ? │ V / │ B * │ N , │ M . │ SYM │ SPC │
+ * └─────┴─────┴─────┴─────┴─────┴─────┴─────┴─────┴─────┴─────┘
+ */
+
+#define ZX_A_SHIFT 3
+#define ZX_A_MASK 7
+#define ZX_D_MASK 7
+#define ZX(A, D) ((((A) & ZX_A_MASK) << ZX_A_SHIFT) | ((D) & ZX_D_MASK))
+#define ZXM_CAP (1 << 7)
+#define ZXM_SYM (1 << 6)
+#define ZX_GET_ADDRESS(KEY) (((KEY) >> ZX_A_SHIFT) & ZX_A_MASK)
+#define ZX_GET_DATA(KEY) ((KEY) & ZX_D_MASK)
+
+#define ZX_1 ZX(3, 0)
+#define ZX_2 ZX(3, 1)
+#define ZX_3 ZX(3, 2)
+#define ZX_4 ZX(3, 3)
+#define ZX_5 ZX(3, 4)
+#define ZX_6 ZX(4, 4)
+#define ZX_7 ZX(4, 3)
+#define ZX_8 ZX(4, 2)
+#define ZX_9 ZX(4, 1)
+#define ZX_0 ZX(4, 0)
+
+#define ZX_Q ZX(2, 0)
+#define ZX_W ZX(2, 1)
+#define ZX_E ZX(2, 2)
+#define ZX_R ZX(2, 3)
+#define ZX_T ZX(2, 4)
+#define ZX_Y ZX(5, 4)
+#define ZX_U ZX(5, 3)
+#define ZX_I ZX(5, 2)
+#define ZX_O ZX(5, 1)
+#define ZX_P ZX(5, 0)
+
+#define ZX_A ZX(1, 0)
+#define ZX_S ZX(1, 1)
+#define ZX_D ZX(1, 2)
+#define ZX_F ZX(1, 3)
+#define ZX_G ZX(1, 4)
+#define ZX_H ZX(6, 4)
+#define ZX_J ZX(6, 3)
+#define ZX_K ZX(6, 2)
+#define ZX_L ZX(6, 1)
+#define ZX_ENTER ZX(6, 0)
+
+#define ZX_CAPS ZX(0, 0) /* Caps shift */
+#define ZX_Z ZX(0, 1)
+#define ZX_X ZX(0, 2)
+#define ZX_C ZX(0, 3)
+#define ZX_V ZX(0, 4)
+#define ZX_B ZX(7, 4)
+#define ZX_N ZX(7, 3)
+#define ZX_M ZX(7, 2)
+#define ZX_SYM ZX(7, 1) /* Symbol shift */
+#define ZX_SPACE ZX(7, 0)
+
+#define ZX_EDIT (ZX_1 | ZXM_CAP)
+#define ZX_CAPSL (ZX_2 | ZXM_CAP) /* Caps lock */
+#define ZX_TRUVI (ZX_3 | ZXM_CAP) /* True video */
+#define ZX_INVVI (ZX_4 | ZXM_CAP) /* Inverse video */
+#define ZX_LEFT (ZX_5 | ZXM_CAP)
+#define ZX_DOWN (ZX_6 | ZXM_CAP)
+#define ZX_UP (ZX_7 | ZXM_CAP)
+#define ZX_RIGHT (ZX_8 | ZXM_CAP)
+#define ZX_GRAPH (ZX_9 | ZXM_CAP)
+#define ZX_DEL (ZX_0 | ZXM_CAP) /* Delete */
+#define ZX_BREAK (ZX_SPACE | ZXM_CAP)
+#define ZX_EXTMO (ZX_SYM | ZXM_CAP) /* Ext mode */
+
+#define ZX_GRAVE (ZX_7 | ZXM_SYM) /* ` Back quote */
+#define ZX_OPEN (ZX_8 | ZXM_SYM)  /* ( Open or left parenthesis */
+#define ZX_CLOSE (ZX_9 | ZXM_SYM) /* ) Close or right parenthesis */
+
+#define ZX_LT (ZX_R | ZXM_SYM)    /* < Less then */
+#define ZX_GT (ZX_T | ZXM_SYM)    /* > Greater then */
+#define ZX_SEMIC (ZX_O | ZXM_SYM) /* ; Semicolon */
+#define ZX_QUOTE (ZX_P | ZXM_SYM) /* " Quote */
+
+#define ZX_MINUS (ZX_J | ZXM_SYM) /* - Minus */
+#define ZX_PLUS (ZX_K | ZXM_SYM)  /* + Plus */
+#define ZX_EQUAL (ZX_L | ZXM_SYM) /* = Equal */
+
+#define ZX_COLON (ZX_Z | ZXM_SYM) /* : Colon */
+#define ZX_SLASH (ZX_V | ZXM_SYM) /* / Divide */
+#define ZX_MUL (ZX_B | ZXM_SYM)   /* * Multiply */
+#define ZX_COMMA (ZX_N | ZXM_SYM) /* , Comma */
+#define ZX_DOT (ZX_M | ZXM_SYM)   /* . Dot */
+
+#define ZX_RESET ZX(0, 5)
+#define ZX_MAGIC ZX(0, 6)
+#define ZX_CURJO ZX(1, 5)
+#define ZX_SINJO ZX(1, 6)
+#define ZX_SI2JO ZX(2, 5)
+
+#define NONE 0xFF
+
+enum { JOYSTICK_CURSOR, JOYSTICK_SINCLAIR1, JOYSTICK_SINCLAIR2 };
+
+/* Right, left, down, up, then gamepad buttons 1-12 */
+extern const uint8_t joystick_to_zx[][REPORT_PLAN_JOY_BUTTON1 + REPORT_PLAN_JOY_BUTTONS];
@@ -0,0 +1,35 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/* Value of D0-D4 for every A8-A15, the table of ZX_KERNEL_TABLE. Separate from responder.c for the host test. */
+
+#define ZX_TABLE_SIZE 0x100
+
+/* Subset recurrence, one AND per entry: the entry for address i equals the entry for i with its lowest
+ * zero bit set, less the row of that bit. */
+static inline void ZxPrepareTable(uint8_t *o, const uint8_t *zx_matrix) {
+    unsigned i = ZX_TABLE_SIZE - 1;
+    o[i] = 0xFF;
+    while (i-- != 0) {
+        const unsigned j = __builtin_ctz(~i);
+        o[i] = o[i | (1 << j)] & ~zx_matrix[j];
+    }
+}
@@ -0,0 +1,41 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "stm32f4xx_hal.h"
+
+/* TIM2 runs at HCLK like the DWT cycle counter, channel 1 captures the KBD_RD (PA5) falling edge */
+
+extern uint32_t zx_timer_cycles_offset;
+
+void ZxTimerInit();
+
+/* TIM3 counts the M1 (PA6) falling edges, the start of an opcode fetch, and pulses TRGO on each one */
+void ZxTimerM1Init();
+
+/* Time of the last KBD_RD falling edge in TIM2 ticks. To measure the time since it, read it before TIM2->CNT:
+ * read after the counter, an edge in between would look like a gap. */
+static inline uint32_t ZxTimerKbdRd() {
+    return TIM2->CCR1;
+}
+
+/* Convert a DWT cycle counter value to TIM2 ticks */
+static inline uint32_t ZxTimerFromCycles(uint32_t cycles) {
+    return cycles - zx_timer_cycles_offset;
+}
@@ -0,0 +1,81 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "stm32f4xx_hal.h"
+#include "my_config.h"
+#include "critical.h"
+#include "sched.h"
+#include "console.h"
+
+#if ZX_SCHEDULER
+
+#if (ZX_CONSOLE_BUFFER & (ZX_CONSOLE_BUFFER - 1)) != 0
+#error "ZX_CONSOLE_BUFFER must be a power of 2"
+#endif
+
+static char console_buffer[ZX_CONSOLE_BUFFER];
+static volatile uint32_t console_head; /* Moved by the writers */
+static volatile uint32_t console_tail; /* Moved by the console task */
+static uint32_t console_dropped;       /* Bytes */
+
+static void ConsolePut(const char *text, size_t length) {
+    uint32_t head = console_head;
+    size_t i;
+    for (i = 0; i < length; i++)
+        console_buffer[head++ & (ZX_CONSOLE_BUFFER - 1)] = text[i];
+    console_head = head; /* After the bytes, the console task reads up to it */
+}
+
+void ConsoleWrite(const char *text, size_t length) {
+    /* The USB interrupt is the only other writer, the main loop holds it off */
+    Critical c;
+    CriticalUsbEnter(&c);
+    size_t space = ZX_CONSOLE_BUFFER - (console_head - console_tail);
+    if (console_dropped != 0) {
+        char note[32];
+        const int n = snprintf(note, sizeof(note), "[%u bytes dropped]\r\n", (unsigned)console_dropped);
+        if (n > 0 && (size_t)n + length <= space) {
+            ConsolePut(note, n);
+            space -= n;
+            console_dropped = 0;
+        }
+    }
+    if (length <= space)
+        ConsolePut(text, length);
+    else
+        console_dropped += length;
+    CriticalUsbExit(&c, "ConsoleWrite");
+}
+
+/* A byte to send and room for it */
+bool ConsoleReady() {
+    return console_tail != console_head && (USART1->SR & USART_SR_TXE) != 0;
+}
+
+void ConsoleSend() {
+    uint32_t tail = console_tail;
+    while (tail != console_head && (USART1->SR & USART_SR_TXE) != 0 && !SchedBudgetOver()) {
+        USART1->DR = (uint8_t)console_buffer[tail & (ZX_CONSOLE_BUFFER - 1)];
+        tail++;
+    }
+    console_tail = tail;
+}
+
+#endif
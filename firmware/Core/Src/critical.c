@@ -0,0 +1,83 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include "stm32f4xx_hal.h"
+#include "my_config.h"
+#include "cycles.h"
+#include "critical.h"
+#include "responder.h"
+
+void DebugOutput(const char *format, ...);
+
+#if ZX_IRQ_AUDIT
+static uint32_t critical_count;
+static uint32_t critical_max;
+static const char *critical_max_name = "";
+
+void CriticalMeasured(uint32_t cycles, const char *name) {
+    critical_count++;
+    if (cycles > critical_max) {
+        critical_max = cycles;
+        critical_max_name = name;
+    }
+}
+#endif
+
+/* A configurable interrupt can not preempt KBD_RD at priority 0, but one at the same priority delays it
+ * for its whole run. Everything else must be at CRITICAL_PRIORITY or below to be masked by the sections. */
+void CriticalAudit() {
+#if ZX_IRQ_AUDIT
+    static const IRQn_Type system[] = {MemoryManagement_IRQn, BusFault_IRQn, UsageFault_IRQn, SVCall_IRQn,
+                                       DebugMonitor_IRQn,     PendSV_IRQn,   SysTick_IRQn};
+    unsigned i, found = 0;
+    for (i = 0; i < sizeof(system) / sizeof(system[0]); i++) {
+        if (NVIC_GetPriority(system[i]) < CRITICAL_PRIORITY) {
+            DebugOutput("Audit: exception %d at priority %u delays KBD_RD\r\n", (int)system[i],
+                        (unsigned)NVIC_GetPriority(system[i]));
+            found++;
+        }
+    }
+    for (i = 0; i <= SPI4_IRQn; i++) {
+        if (i == EXTI9_5_IRQn || !NVIC_GetEnableIRQ((IRQn_Type)i))
+            continue;
+        if (NVIC_GetPriority((IRQn_Type)i) < CRITICAL_PRIORITY) {
+            DebugOutput("Audit: IRQ %u at priority %u delays KBD_RD\r\n", i, (unsigned)NVIC_GetPriority((IRQn_Type)i));
+            found++;
+        }
+    }
+    DebugOutput("Audit: KBD_RD priority %u, %u interrupts at it, sections mask priority %u and below\r\n",
+                (unsigned)NVIC_GetPriority(EXTI9_5_IRQn), found, CRITICAL_PRIORITY);
+#endif
+}
+
+void CriticalReport() {
+#if ZX_IRQ_AUDIT
+    DebugOutput("Critical: %u sections, longest %u cycles, %u ns in %s\r\n",
+                (unsigned)critical_count, (unsigned)critical_max, (unsigned)CyclesToNs(critical_max),
+                critical_max_name);
+    /* The sections leave KBD_RD unmasked, the longest time it was held off by anything is the exact latency max.
+     * ZX_IRQ_AUDIT turns ZX_LATENCY on. */
+    uint32_t held_off, held_off_at;
+    ResponderLatencyMax(&held_off, &held_off_at);
+    DebugOutput("Critical: KBD_RD held off up to %u cycles, %u ns, at TIM2 %u\r\n", (unsigned)held_off,
+                (unsigned)CyclesToNs(held_off), (unsigned)held_off_at);
+    critical_count = 0;
+    critical_max = 0;
+    critical_max_name = "";
+#endif
+}
@@ -0,0 +1,65 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "key_hold.h"
+
+void KeyHoldInit(KeyHold *h, unsigned scans) {
+    memset(h, 0, sizeof(*h));
+    h->scans = scans;
+}
+
+const uint8_t *KeyHoldReport(KeyHold *h, const uint8_t *zx_matrix, bool scanning) {
+    const uint8_t scans = h->scans + (scanning ? 1 : 0);
+    unsigned r;
+    for (r = 0; r < ZX_MATRIX_ROWS; r++) {
+        const uint8_t keys = zx_matrix[r];
+        /* A press, a repeated one too, starts over */
+        unsigned down = keys & ~h->pressed[r] & KEY_HOLD_MASK;
+        h->pressed[r] = keys;
+        if (h->scans != 0)
+            h->holding[r] |= down;
+        while (down != 0) {
+            h->left[r][__builtin_ctz(down)] = scans;
+            down &= down - 1;
+        }
+        h->visible[r] = keys | h->holding[r];
+    }
+    return h->visible;
+}
+
+bool KeyHoldScan(KeyHold *h) {
+    bool changed = false;
+    unsigned r;
+    for (r = 0; r < ZX_MATRIX_ROWS; r++) {
+        unsigned holding = h->holding[r];
+        while (holding != 0) {
+            const unsigned bit = __builtin_ctz(holding);
+            holding &= holding - 1;
+            if (--h->left[r][bit] == 0)
+                h->holding[r] &= ~(1 << bit);
+        }
+        const uint8_t visible = h->pressed[r] | h->holding[r];
+        if (visible != h->visible[r]) {
+            h->visible[r] = visible;
+            changed = true;
+        }
+    }
+    return changed;
+}
@@ -0,0 +1,70 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "latency.h"
+
+void LatencyClear(LatencyHistogram *h) {
+    memset(h, 0, sizeof(*h));
+}
+
+/* Nearest rank: the smallest latency with at least permille of the reads at or below it */
+static uint32_t LatencyPercentile(const LatencyHistogram *h, uint32_t total, unsigned permille) {
+    const uint64_t rank = ((uint64_t)total * permille + 999) / 1000;
+    uint64_t sum = 0;
+    unsigned i;
+    for (i = 0; i < LATENCY_BUCKETS; i++) {
+        sum += h->count[i];
+        if (sum >= rank)
+            return i;
+    }
+    return LATENCY_BUCKETS - 1;
+}
+
+void LatencySummarize(const LatencyHistogram *h, LatencySummary *s) {
+    memset(s, 0, sizeof(*s));
+    unsigned i;
+    for (i = 0; i < LATENCY_BUCKETS; i++) {
+        if (h->count[i] == 0)
+            continue;
+        if (s->total == 0)
+            s->min = i;
+        s->total += h->count[i];
+    }
+    if (s->total == 0)
+        return;
+    s->max = h->max;
+    s->max_at = h->max_at;
+    s->p50 = LatencyPercentile(h, s->total, 500);
+    s->p99 = LatencyPercentile(h, s->total, 990);
+    s->p999 = LatencyPercentile(h, s->total, 999);
+}
+
+void LatencyRecorderInit(LatencyRecorder *r) {
+    LatencyClear(&r->histograms[0]);
+    LatencyClear(&r->histograms[1]);
+    r->active = &r->histograms[0];
+}
+
+/* Summary of the reads since the last call. A read being recorded during the switch may land in either. */
+void LatencyTake(LatencyRecorder *r, LatencySummary *s) {
+    LatencyHistogram *h = r->active;
+    r->active = h != &r->histograms[0] ? &r->histograms[0] : &r->histograms[1];
+    LatencySummarize(h, s);
+    LatencyClear(h);
+}
@@ -0,0 +1,87 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "stm32f4xx_hal.h"
+#include "my_config.h"
+#include "zx_timer.h"
+#include "critical.h"
+#include "magic.h"
+
+/* TIM4 runs at HCLK. Channel 4 in PWM mode 2 with the active level low: high until CCR4, low until ARR,
+ * then the one-pulse mode stops the counter at 0. Every TIM3 TRGO (ITR2) starts it again, so CCR4 is preloaded
+ * above ARR after the first pulse, the next triggers do not reach the pin. */
+
+#define MAGIC_DELAY 1 /* TIM4 ticks from the M1 falling edge */
+#define MAGIC_NEVER 0xFFFF
+
+static volatile bool magic_armed;
+static uint32_t magic_time;
+
+void MagicInit() {
+    ZxTimerM1Init();
+
+    __HAL_RCC_TIM4_CLK_ENABLE();
+    TIM4->CR1 = TIM_CR1_OPM | TIM_CR1_ARPE;
+    TIM4->PSC = 0;
+    TIM4->ARR = MAGIC_DELAY + ZX_MAGIC_PULSE_US * (SystemCoreClock / 1000000);
+    TIM4->CCR4 = MAGIC_NEVER;
+    TIM4->CCMR2 = TIM_CCMR2_OC4M_2 | TIM_CCMR2_OC4M_1 | TIM_CCMR2_OC4M_0 | TIM_CCMR2_OC4PE;
+    TIM4->CCER = TIM_CCER_CC4P | TIM_CCER_CC4E;
+    TIM4->EGR = TIM_EGR_UG;
+
+    /* PB9 to TIM4_CH4, released while the counter is stopped */
+    GPIO_InitTypeDef GPIO_InitStruct = {0};
+    GPIO_InitStruct.Pin = GPIO_PIN_9;
+    GPIO_InitStruct.Mode = GPIO_MODE_AF_OD;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+    GPIO_InitStruct.Alternate = GPIO_AF2_TIM4;
+    HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
+}
+
+/* One pulse at the next M1, nothing if one is waiting. With ZX_PUBLISH_IRQ it is called from the USB interrupt. */
+void MagicPress() {
+    Critical c;
+    CriticalEnter(&c);
+    if (!magic_armed) {
+        TIM4->CCR4 = MAGIC_DELAY;
+        TIM4->EGR = TIM_EGR_UG; /* CCR4 and a zero counter now */
+        TIM4->CCR4 = MAGIC_NEVER; /* From the end of the pulse */
+        TIM4->SR = 0;
+        TIM4->SMCR = TIM_SMCR_TS_1 | TIM_SMCR_SMS_2 | TIM_SMCR_SMS_1; /* Trigger mode from ITR2 */
+        magic_armed = true;
+        magic_time = HAL_GetTick();
+    }
+    CriticalExit(&c, "MagicPress");
+}
+
+/* Disarm after the pulse or the timeout, from the main loop. The USB interrupt does not arm it between the check
+ * and the disarm. */
+void MagicPoll() {
+    if (!magic_armed)
+        return;
+    Critical c;
+    CriticalEnter(&c);
+    if ((TIM4->SR & TIM_SR_UIF) != 0 || HAL_GetTick() - magic_time >= ZX_MAGIC_TIMEOUT_MS) {
+        TIM4->SMCR = 0;
+        TIM4->CR1 &= ~TIM_CR1_CEN;
+        magic_armed = false;
+    }
+    CriticalExit(&c, "MagicPoll");
+}
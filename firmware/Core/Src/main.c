@@ -22,7 +22,10 @@
 
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "my_config.h"
 #include "my.h"
+#include "responder.h"
+#include "critical.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -97,6 +100,9 @@ int main(void)
 
   /* Infinite loop */
   /* USER CODE BEGIN WHILE */
+#if ZX_SCHEDULER
+  MyRun();
+#endif
   while (1)
   {
     /* USER CODE END WHILE */
@@ -104,6 +110,7 @@ int main(void)
 
     /* USER CODE BEGIN 3 */
     MyIdle();
+    ResponderFollow();
   }
   /* USER CODE END 3 */
 }
@@ -272,7 +279,7 @@ void Error_Handler(void)
 {
   /* USER CODE BEGIN Error_Handler_Debug */
   /* User can add his own implementation to report the HAL error return state */
-  __disable_irq();
+  CriticalHalt();
   while (1)
   {
   }
@@ -19,123 +19,32 @@
 #include <assert.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <string.h>
 #include "stm32f4xx_hal.h"
 #include "usb_host.h"
 #include "usbh_core.h"
 #include "usbh_hid.h"
+#include "usbh_hub.h"
+#include "my_config.h"
+#include "responder.h"
+#include "zx_timer.h"
+#include "zx_clock.h"
+#include "key_hold.h"
+#include "magic.h"
+#include "cycles.h"
+#include "critical.h"
+#include "sched.h"
+#include "console.h"
+#include "zx_keys.h"
 #include "my.h"
 
 extern UART_HandleTypeDef huart1;
 extern USBH_HandleTypeDef hUsbHostFS;
 
 #define ARRAY_SIZE(A) (sizeof(A) / sizeof(A[0]))
-#define BITS_PER_BYTE 8
 #define USB_SHIFTS_COUNT 8
 #define BSRR_RESET 16
 
-/* ZX Spectrum keyboard
- * ┌─────┬─────┬─────┬─────┬─────┬─────┬─────┬─────┬─────┬─────┐ ┌───────┐
- * │ 1 ! │ 2 @ │ 3 # │ 4 $ │ 5 % │ 6 & │ 7 ` │ 8 ( │ 9 ) │ 0 _ │ │ RESET │
- * ├─────┼─────┼─────┼─────┼─────┼─────┼─────┼─────┼─────┼─────┤ ├───────┤
- * │ Q<= │ W<> │ E=> │ R < │ T > │  Y  │  U  │  I  │ O ; │ P " │ │ MAGIC │
- * ├─────┼─────┼─────┼─────┼─────┼─────┼─────┼─────┼─────┼─────┤ └───────┘
- * │  A  │  S  │  D  │  F  │  G  │ H ^ │ J - │ K + │ L = │ ENT │
- * ├─────┼─────┼─────┼─────┼─────┼─────┼─────┼─────┼─────┼─────┤
- * │ CAP │ Z : │  X  │ C ? │ V / │ B * │ N , │ M . │ SYM │ SPC │
- * └─────┴─────┴─────┴─────┴─────┴─────┴─────┴─────┴─────┴─────┘
- */
-
-#define ZX_A_SHIFT 3
-#define ZX_A_MASK 7
-#define ZX_D_MASK 7
-#define ZX(A, D) ((((A) & ZX_A_MASK) << ZX_A_SHIFT) | ((D) & ZX_D_MASK))
-#define ZXM_CAP (1 << 7)
-#define ZXM_SYM (1 << 6)
-#define ZX_GET_ADDRESS(KEY) (((KEY) >> ZX_A_SHIFT) & ZX_A_MASK)
-#define ZX_GET_DATA(KEY) ((KEY) & ZX_D_MASK)
-
-#define ZX_1 ZX(3, 0)
-#define ZX_2 ZX(3, 1)
-#define ZX_3 ZX(3, 2)
-#define ZX_4 ZX(3, 3)
-#define ZX_5 ZX(3, 4)
-#define ZX_6 ZX(4, 4)
-#define ZX_7 ZX(4, 3)
-#define ZX_8 ZX(4, 2)
-#define ZX_9 ZX(4, 1)
-#define ZX_0 ZX(4, 0)
-
-#define ZX_Q ZX(2, 0)
-#define ZX_W ZX(2, 1)
-#define ZX_E ZX(2, 2)
-#define ZX_R ZX(2, 3)
-#define ZX_T ZX(2, 4)
-#define ZX_Y ZX(5, 4)
-#define ZX_U ZX(5, 3)
-#define ZX_I ZX(5, 2)
-#define ZX_O ZX(5, 1)
-#define ZX_P ZX(5, 0)
-
-#define ZX_A ZX(1, 0)
-#define ZX_S ZX(1, 1)
-#define ZX_D ZX(1, 2)
-#define ZX_F ZX(1, 3)
-#define ZX_G ZX(1, 4)
-#define ZX_H ZX(6, 4)
-#define ZX_J ZX(6, 3)
-#define ZX_K ZX(6, 2)
-#define ZX_L ZX(6, 1)
-#define ZX_ENTER ZX(6, 0)
-
-#define ZX_CAPS ZX(0, 0) /* Caps shift */
-#define ZX_Z ZX(0, 1)
-#define ZX_X ZX(0, 2)
-#define ZX_C ZX(0, 3)
-#define ZX_V ZX(0, 4)
-#define ZX_B ZX(7, 4)
-#define ZX_N ZX(7, 3)
-#define ZX_M ZX(7, 2)
-#define ZX_SYM ZX(7, 1) /* Symbol shift */
-#define ZX_SPACE ZX(7, 0)
-
-#define ZX_EDIT (ZX_1 | ZXM_CAP)
-#define ZX_CAPSL (ZX_2 | ZXM_CAP) /* Caps lock */
-#define ZX_TRUVI (ZX_3 | ZXM_CAP) /* True video */
-#define ZX_INVVI (ZX_4 | ZXM_CAP) /* Inverse video */
-#define ZX_LEFT (ZX_5 | ZXM_CAP)
-#define ZX_DOWN (ZX_6 | ZXM_CAP)
-#define ZX_UP (ZX_7 | ZXM_CAP)
-#define ZX_RIGHT (ZX_8 | ZXM_CAP)
-#define ZX_GRAPH (ZX_9 | ZXM_CAP)
-#define ZX_DEL (ZX_0 | ZXM_CAP) /* Delete */
-#define ZX_BREAK (ZX_SPACE | ZXM_CAP)
-#define ZX_EXTMO (ZX_SYM | ZXM_CAP) /* Ext mode */
-
-#define ZX_GRAVE (ZX_7 | ZXM_SYM) /* ` Back quote */
-#define ZX_OPEN (ZX_8 | ZXM_SYM)  /* ( Open or left parenthesis */
-#define ZX_CLOSE (ZX_9 | ZXM_SYM) /* ) Close or right parenthesis */
-
-#define ZX_LT (ZX_R | ZXM_SYM)    /* < Less then */
-#define ZX_GT (ZX_T | ZXM_SYM)    /* > Greater then */
-#define ZX_SEMIC (ZX_O | ZXM_SYM) /* ; Semicolon */
-#define ZX_QUOTE (ZX_P | ZXM_SYM) /* " Quote */
-
-#define ZX_MINUS (ZX_J | ZXM_SYM) /* - Minus */
-#define ZX_PLUS (ZX_K | ZXM_SYM)  /* + Plus */
-#define ZX_EQUAL (ZX_L | ZXM_SYM) /* = Equal */
-
-#define ZX_COLON (ZX_Z | ZXM_SYM) /* : Colon */
-#define ZX_SLASH (ZX_V | ZXM_SYM) /* / Divide */
-#define ZX_MUL (ZX_B | ZXM_SYM)   /* * Multiply */
-#define ZX_COMMA (ZX_N | ZXM_SYM) /* , Comma */
-#define ZX_DOT (ZX_M | ZXM_SYM)   /* . Dot */
-
-#define ZX_RESET ZX(0, 5)
-#define ZX_MAGIC ZX(0, 6)
-#define ZX_CURJO ZX(1, 5)
-#define ZX_SINJO ZX(1, 6)
-
-#define NONE 0xFF
 #define STD_KEYS_OFFSET (USB_SHIFTS_COUNT - KEY_A)
 
 static const uint8_t usb_to_zx[] = {
@@ -156,7 +65,7 @@ static const uint8_t usb_to_zx[] = {
     ZX_QUOTE, ZX_GRAVE, ZX_COMMA, ZX_DOT,   /* 34  " ` , . */
     ZX_SLASH, ZX_CAPSL, ZX_TRUVI, ZX_INVVI, /* 38  / CAPS F1 F2 */
     ZX_GRAPH, NONE,     ZX_CURJO, ZX_SINJO, /* 3C  F3 F4 F5 F6 */
-    NONE,     NONE,     NONE,     ZX_MAGIC, /* 40  F7 F8 F9 F10 */
+    ZX_SI2JO, NONE,     NONE,     ZX_MAGIC, /* 40  F7 F8 F9 F10 */
     NONE,     ZX_RESET, ZX_PLUS,  NONE,     /* 44  F11 F12 PRSCR SCROLL */
     ZX_PLUS,  NONE,     NONE,     NONE,     /* 48  PAUSE INSERT HOME PGUP */
     ZX_DEL,   NONE,     NONE,     ZX_RIGHT, /* 4C  DEL END PGDN RIGHT */
@@ -168,10 +77,42 @@ static const uint8_t usb_to_zx[] = {
     0, ZX_0                                 /* 64  ? APP */
 };
 
-static uint8_t zx_prepared_a[0x100] = {[0 ... 0xFF] = 0xFF};
-static uint8_t zx_prepared_b[0x100] = {[0 ... 0xFF] = 0xFF};
-static volatile uint8_t* zx_prepared = zx_prepared_a;
-static uint8_t sinclair_joystic = false;
+static uint8_t joystick_profile = JOYSTICK_CURSOR;
+static uint8_t zx_matrix_prev[ZX_MATRIX_ROWS];
+
+/* Keys without a ZX mapping. Decoded in the USB interrupt, so they are only noted there
+ * and printed by the main loop at most every UNKNOWN_KEY_PERIOD_MS. */
+#define UNKNOWN_KEY_PERIOD_MS 1000
+static volatile uint8_t unknown_key;
+static volatile uint32_t unknown_key_count;
+static uint32_t unknown_key_reported;
+static uint32_t unknown_key_time;
+#if ZX_HOLD_SCANS
+/* Without the ZX clock a scan is assumed every frame. With it the frame time is a fallback
+ * for programs that stop reading the keyboard. */
+#define HOLD_FRAME_MS (ZX_CLOCK ? 25 : 20)
+static KeyHold key_hold;
+static uint32_t hold_time;
+static uint32_t hold_scan;
+#endif
+#if ZX_STATS
+static uint32_t stats_time;
+static uint32_t stats_reports;
+static uint32_t stats_unchanged;
+static volatile uint32_t stats_connect_time;
+static volatile bool stats_connect_pending;
+static uint32_t stats_connect_to_report = UINT32_MAX;
+static bool stats_connect_cached;
+#endif
+#if ZX_CLOCK && ZX_STATS
+#define POLL_TIMES 8
+static uint32_t poll_times[POLL_TIMES]; /* TIM2 time of the last polls, by the SOF interrupt */
+static volatile unsigned poll_count;
+static uint32_t stats_scan;
+static uint32_t key_to_read_total;
+static uint32_t key_to_read_count;
+static uint32_t key_to_read_max;
+#endif
 
 void DebugOutput(const char *format, ...) {
     assert(format != NULL);
@@ -183,16 +124,16 @@ void DebugOutput(const char *format, ...) {
     va_end(args);
     if (result > 0) {
         const size_t length = result < sizeof(buf) - 1 ? (size_t)result : sizeof(buf) - 1;
+#if ZX_SCHEDULER
+        ConsoleWrite(buf, length);
+#else
         HAL_StatusTypeDef result2 = HAL_UART_Transmit(&huart1, (const uint8_t *)buf, length, HAL_MAX_DELAY);
         assert(result2 == HAL_OK);
+#endif
     }
 }
 
-void MyInit() {
-    DebugOutput("\r\nZX USB Keyboard, version 15-Аug-2023, (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru\r\n");
-}
-
-static inline uint8_t ZxMatrixGet(uint8_t *zx_matix, uint8_t zx_key) {
+static inline uint8_t ZxMatrixGet(const uint8_t *zx_matix, uint8_t zx_key) {
     return zx_matix[ZX_GET_ADDRESS(zx_key)] & (1 << ZX_GET_DATA(zx_key));
 }
 
@@ -200,12 +141,12 @@ static inline void ZxMatrixSet(uint8_t *zx_matrix, uint8_t zx_key) {
     zx_matrix[ZX_GET_ADDRESS(zx_key)] |= 1 << ZX_GET_DATA(zx_key);
 }
 
-static void ZxMatrixSetUsb(uint8_t *zx_matrix, uint8_t usb_key) {
-    if (sinclair_joystic) {
-        static const uint8_t usb_to_zx_joystick[] = { ZX_7, ZX_6, ZX_8, ZX_9 };
+static void ZxMatrixSetUsb(uint8_t *zx_matrix, unsigned usb_key) {
+    if (joystick_profile != JOYSTICK_CURSOR) {
+        /* Arrows go in the order of the joystick directions */
         unsigned i = usb_key - (STD_KEYS_OFFSET + KEY_RIGHTARROW);
-        if (i < ARRAY_SIZE(usb_to_zx_joystick)) {
-            ZxMatrixSet(zx_matrix, usb_to_zx_joystick[i]);
+        if (i < REPORT_PLAN_JOY_DIRECTIONS) {
+            ZxMatrixSet(zx_matrix, joystick_to_zx[joystick_profile][i]);
             return;
         }
     }
@@ -220,22 +161,92 @@ static void ZxMatrixSetUsb(uint8_t *zx_matrix, uint8_t usb_key) {
             return;
         }
     }
-    DebugOutput("Unknown key %02X\r\n", usb_key);
+    unknown_key = (uint8_t)usb_key;
+    unknown_key_count++;
 }
 
-void MyIdle() {
-    /* Keyboard connected? */
-    if (hUsbHostFS.pActiveClass != USBH_HID_CLASS)
+static void MyUnknownKeys() {
+    const uint32_t count = unknown_key_count;
+    if (count == unknown_key_reported || HAL_GetTick() - unknown_key_time < UNKNOWN_KEY_PERIOD_MS)
         return;
+    unknown_key_time = HAL_GetTick();
+    DebugOutput("Unknown key %02X, %u reports\r\n", unknown_key, (unsigned)(count - unknown_key_reported));
+    unknown_key_reported = count;
+}
 
-    /* Get key from USB keyboard */
-    HID_KEYBD_Info_TypeDef *info = USBH_HID_GetKeybdInfo(&hUsbHostFS);
-    if (info == NULL)
-        return;
+/* ZX keyboard matrix calculation */
+static void ZxMatrixFromBoot(uint8_t *zx_matrix, const HID_KEYBD_BootTypeDef *boot) {
+    unsigned i;
+    for (i = 0; i < USB_SHIFTS_COUNT; i++)
+        if (boot->modifiers & (1 << i))
+            ZxMatrixSetUsb(zx_matrix, i);
+    for (i = 0; i < ARRAY_SIZE(boot->keys); i++) {
+        uint32_t keys = boot->keys[i];
+        while (keys != 0) {
+            ZxMatrixSetUsb(zx_matrix, STD_KEYS_OFFSET + i * 32 + __builtin_ctz(keys));
+            keys &= keys - 1;
+        }
+    }
+    unsigned joystick = boot->joystick;
+    while (joystick != 0) {
+        const uint8_t zx_key = joystick_to_zx[joystick_profile][__builtin_ctz(joystick)];
+        if (zx_key != NONE)
+            ZxMatrixSet(zx_matrix, zx_key);
+        joystick &= joystick - 1;
+    }
+}
+
+#if ZX_PUBLISH_IRQ && HID_RING_POLICY == HID_RING_KEEP_ALL
+#error "ZX_PUBLISH_IRQ does not read the HID report ring, it would stay full"
+#endif
+
+#if ZX_BENCHMARK
+/* One keyboard report through the old byte FIFO and through the report ring */
+static void ReportBenchmark() {
+    static FIFO_TypeDef fifo;
+    static uint8_t fifo_buf[HID_QUEUE_SIZE * KEYBD_BOOT_REPORT_SIZE];
+    static HID_RingTypeDef ring;
+    uint32_t report[KEYBD_BOOT_REPORT_SIZE / sizeof(uint32_t)] = {0};
+
+    USBH_HID_FifoInit(&fifo, fifo_buf, sizeof(fifo_buf));
+    uint32_t t = Cycles();
+    (void)USBH_HID_FifoWrite(&fifo, report, KEYBD_BOOT_REPORT_SIZE);
+    (void)USBH_HID_FifoRead(&fifo, report, KEYBD_BOOT_REPORT_SIZE);
+    const uint32_t fifo_cycles = Cycles() - t;
+
+    /* The channel receives into the write slot, no copy on the producer side */
+    USBH_HID_RingInit(&ring);
+    t = Cycles();
+    (void)USBH_HID_RingWriteSlot(&ring);
+    USBH_HID_RingCommit(&ring, KEYBD_BOOT_REPORT_SIZE);
+    (void)USBH_HID_RingRead(&ring, report, KEYBD_BOOT_REPORT_SIZE);
+    const uint32_t ring_cycles = Cycles() - t;
+
+    DebugOutput("Report FIFO: %u cycles, ring: %u cycles\r\n", (unsigned)fifo_cycles, (unsigned)ring_cycles);
+}
 
-    /* ZX keyboard matrix calculation */
-    uint8_t zx_matrix[8] = {0};
+/* One report from the ring to the ZX matrix through the generic HID_ReadItem decoder and the boot decoder */
+static void DecoderBenchmark() {
+    static USBH_HandleTypeDef host;
+    static USBH_ClassTypeDef host_class;
+    static HID_DeviceTypeDef device;
+    HID_HandleTypeDef *const hid = &device.itf[0];
+    static const uint32_t report[KEYBD_BOOT_REPORT_SIZE / sizeof(uint32_t)] = {0x05040002, 0}; /* LSHIFT, A, B */
+    uint8_t zx_matrix[ZX_MATRIX_ROWS] = {0};
     unsigned i;
+
+    host.pActiveClass = &host_class;
+    host_class.pData = &device;
+    device.count = 1;
+    hid->Init = USBH_HID_KeybdInit;
+    hid->InPipe = 1;
+    hid->length = KEYBD_BOOT_REPORT_SIZE;
+    USBH_HID_RingInit(&hid->ring);
+
+    memcpy(USBH_HID_RingWriteSlot(&hid->ring), report, sizeof(report));
+    USBH_HID_RingCommit(&hid->ring, sizeof(report));
+    uint32_t t = Cycles();
+    const HID_KEYBD_Info_TypeDef *info = USBH_HID_GetKeybdInfo(&host);
     const uint8_t *info_shifts = info->keys - USB_SHIFTS_COUNT;
     for (i = 0; i < USB_SHIFTS_COUNT; i++)
         if (info_shifts[i])
@@ -243,54 +254,361 @@ void MyIdle() {
     for (i = 0; i < ARRAY_SIZE(info->keys); i++)
         if (info->keys[i] >= KEY_A)
             ZxMatrixSetUsb(zx_matrix, STD_KEYS_OFFSET + info->keys[i]);
+    const uint32_t generic_cycles = Cycles() - t;
+
+    memset(zx_matrix, 0, sizeof(zx_matrix));
+    memcpy(USBH_HID_RingWriteSlot(&hid->ring), report, sizeof(report));
+    USBH_HID_RingCommit(&hid->ring, sizeof(report));
+    t = Cycles();
+    ZxMatrixFromBoot(zx_matrix, USBH_HID_GetKeybdBoot(&host));
+    const uint32_t boot_cycles = Cycles() - t;
+
+    DebugOutput("Decoder generic: %u cycles, boot: %u cycles\r\n", (unsigned)generic_cycles, (unsigned)boot_cycles);
+}
+#endif
+
+void MyInit() {
+    DebugOutput("\r\nZX USB Keyboard, version 15-Аug-2023, (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru\r\n");
+    ResponderInit();
+    MagicInit();
+    CriticalAudit();
+#if ZX_HOLD_SCANS
+    KeyHoldInit(&key_hold, ZX_HOLD_SCANS);
+#endif
+#if ZX_CLOCK
+    ZxClockInit();
+#endif
+#if ZX_BENCHMARK
+    ReportBenchmark();
+    DecoderBenchmark();
+#endif
+}
+
+#if ZX_STATS
+/* Called by the USB interrupt when a device is plugged in */
+void MyUsbConnected() {
+    stats_connect_time = HAL_GetTick();
+    stats_connect_pending = true;
+}
+#endif
+
+/* Show keys to the ZX: port table, LED, RESET and MAGIC */
+static void MyShow(const uint8_t *zx_matrix) {
+    unsigned i;
+
+    /* Many keyboards resend the same report, nothing to do then */
+    if (memcmp(zx_matrix, zx_matrix_prev, ZX_MATRIX_ROWS) == 0) {
+#if ZX_STATS
+        stats_unchanged++;
+#endif
+        return;
+    }
+    memcpy(zx_matrix_prev, zx_matrix, ZX_MATRIX_ROWS);
+
+    /* Precompute data for the interrupt handler */
+    ResponderPublish(zx_matrix);
+
+    /* Onboard led */
+    uint8_t any = 0;
+    for (i = 0; i < ZX_MATRIX_ROWS; i++)
+        any |= zx_matrix[i];
+    GPIOC->BSRR = any != 0 ? (GPIO_PIN_13 << BSRR_RESET) : GPIO_PIN_13;
+
+    /* Reset key */
+    GPIOB->BSRR = ZxMatrixGet(zx_matrix, ZX_RESET) ? (GPIO_PIN_8 << BSRR_RESET) : GPIO_PIN_8;
+
+    /* Magic key, pulsed by the timers at the start of the next M1 */
+    if (ZxMatrixGet(zx_matrix, ZX_MAGIC))
+        MagicPress();
+}
+
+#if ZX_HOLD_SCANS
+/* A keyboard scan has started since the last MyHoldTick, it may have read the keys before this report */
+static bool MyHoldScanning() {
+#if ZX_CLOCK
+    return ZxTimerKbdRd() != hold_scan;
+#else
+    return true; /* Frame times are not in phase with the scans */
+#endif
+}
+
+/* A keyboard scan of the ZX is over, or a frame time has passed without one */
+static bool MyHoldTick() {
+    const uint32_t now = HAL_GetTick();
+#if ZX_CLOCK
+    if (zx_clock.scan != hold_scan) {
+        hold_scan = zx_clock.scan;
+        hold_time = now;
+        return true;
+    }
+#endif
+    if (now - hold_time < HOLD_FRAME_MS)
+        return false;
+    hold_time = now;
+    return true;
+}
+#endif
+
+/* Apply a new key state from the keyboards: modes, short taps, then show it */
+static void MyKeys(const uint8_t *zx_matrix) {
+#if ZX_STATS
+    /* Time from plugging the keyboard in to its first report */
+    if (stats_connect_pending) {
+        stats_connect_pending = false;
+        stats_connect_to_report = HAL_GetTick() - stats_connect_time;
+        stats_connect_cached = hUsbHostFS.device.CfgCached != 0;
+    }
+    stats_reports++;
+#endif
 
     /* Modes */
     if (ZxMatrixGet(zx_matrix, ZX_CURJO))
-        sinclair_joystic = false;
+        joystick_profile = JOYSTICK_CURSOR;
     else if (ZxMatrixGet(zx_matrix, ZX_SINJO))
-        sinclair_joystic = true;
+        joystick_profile = JOYSTICK_SINCLAIR1;
+    else if (ZxMatrixGet(zx_matrix, ZX_SI2JO))
+        joystick_profile = JOYSTICK_SINCLAIR2;
+
+#if ZX_HOLD_SCANS
+    zx_matrix = KeyHoldReport(&key_hold, zx_matrix, MyHoldScanning());
+#endif
+    MyShow(zx_matrix);
+}
 
-    /* Precompute data for the interrupt handler */
-    uint8_t *a = zx_prepared != zx_prepared_a ? zx_prepared_a : zx_prepared_b;
-    uint8_t *o = a;
-    for (i = 0; i < ARRAY_SIZE(zx_prepared_a) - 1; i++) {
-        unsigned j, p = 0, z = i;
-        for (j = 0; j < BITS_PER_BYTE; j++) {
-            if ((z & 1) == 0)
-                p |= zx_matrix[j];
-            z >>= 1;
+/* Running HID devices: the one on the USB port or the ones behind a hub on it */
+static unsigned UsbHidDevices(USBH_HandleTypeDef **devices) {
+    if (hUsbHostFS.gState != HOST_CLASS)
+        return 0;
+    if (hUsbHostFS.pActiveClass == USBH_HID_CLASS) {
+        devices[0] = &hUsbHostFS;
+        return 1;
+    }
+    unsigned count = 0;
+    uint8_t port;
+    for (port = 1; port <= USBH_HUB_MAX_PORTS; port++) {
+        USBH_HandleTypeDef *device = USBH_HUB_GetDevice(&hUsbHostFS, port);
+        if (device != NULL && device->gState == HOST_CLASS && device->pActiveClass->ClassCode == USB_HID_CLASS)
+            devices[count++] = device;
+    }
+    return count;
+}
+
+/* Keys of all keyboards */
+static void ZxMatrixFromDevices(uint8_t *zx_matrix, USBH_HandleTypeDef *const *devices, unsigned count) {
+    unsigned d;
+    for (d = 0; d < count; d++)
+        ZxMatrixFromBoot(zx_matrix, USBH_HID_KeybdMerge(devices[d]->pActiveClass->pData));
+}
+
+#if ZX_POLL_JIT || (ZX_CLOCK && ZX_STATS)
+/* Called by the USB interrupt on every SOF of a HID device. Returns 1 to poll it now. */
+uint8_t USBH_HID_PollCallback(USBH_HandleTypeDef *phost, uint8_t due) {
+    (void)phost;
+    uint8_t poll = 0;
+#if ZX_POLL_JIT
+    /* The one SOF at the lead time before the expected scan */
+    if (ZxClockLocked()) {
+        const int32_t ticks_per_us = SystemCoreClock / 1000000;
+        const int32_t remaining = (int32_t)(ZxClockNextScan() - TIM2->CNT);
+        poll = remaining <= ZX_POLL_LEAD_US * ticks_per_us && remaining > (ZX_POLL_LEAD_US - 1000) * ticks_per_us;
+    }
+#endif
+#if ZX_CLOCK && ZX_STATS
+    if (due || poll)
+        poll_times[poll_count++ % POLL_TIMES] = TIM2->CNT;
+#else
+    (void)due;
+#endif
+    return poll;
+}
+#endif
+
+#if ZX_CLOCK && ZX_STATS
+/* A key pressed after the poll before last is reported by the last poll before the scan, so the ZX reads it
+ * between scan - last and scan - before last. */
+static void StatsKeyToRead(uint32_t scan) {
+    const unsigned count = poll_count;
+    uint32_t last = 0;
+    unsigned found = 0, i;
+    for (i = 1; i <= POLL_TIMES && i <= count; i++) {
+        const uint32_t t = poll_times[(count - i) % POLL_TIMES];
+        if ((int32_t)(scan - t) < 0)
+            continue; /* after the scan */
+        if (found++ == 0) {
+            last = t;
+            continue;
         }
-        *o++ = ~p;
+        const uint32_t worst = scan - t;
+        key_to_read_total += scan - last + (last - t) / 2;
+        key_to_read_count++;
+        if (worst > key_to_read_max)
+            key_to_read_max = worst;
+        break;
+    }
+}
+#endif
+
+#if ZX_PUBLISH_IRQ
+/* Called by the USB interrupt when a transfer on a pipe completes. A keyboard report is decoded and published
+ * right here, without waiting for USBH_Process and MyIdle in the main loop. */
+void MyUsbTransferDone(uint8_t pipe) {
+    USBH_HandleTypeDef *devices[1 + USBH_HUB_MAX_PORTS];
+    const unsigned count = UsbHidDevices(devices);
+
+    /* Any keyboard interface of any device, pipe numbers are unique across devices */
+    HID_HandleTypeDef *hid = NULL;
+    unsigned d, i;
+    for (d = 0; d < count && hid == NULL; d++) {
+        HID_DeviceTypeDef *device = devices[d]->pActiveClass->pData;
+        for (i = 0; i < device->count; i++)
+            if (device->itf[i].InPipe == pipe) {
+                hid = &device->itf[i];
+                break;
+            }
     }
-    zx_prepared = a;
+    if (hid == NULL || hid->state != HID_POLL || hid->Init != USBH_HID_KeybdInit)
+        return;
 
-    /* Onboard led */
-    GPIOC->BSRR = a[0] != 0xFF ? (GPIO_PIN_13 << BSRR_RESET) : GPIO_PIN_13;
+    /* Report straight from the receive buffer */
+    const uint32_t length = USBH_LL_GetLastXferSize(&hUsbHostFS, pipe);
+    if (USBH_HID_KeybdDecodeReport(hid, hid->pData, length, &hid->keys) != USBH_OK)
+        return;
 
-    /* Reset key */
-    GPIOB->BSRR = ZxMatrixGet(zx_matrix, ZX_RESET) ? (GPIO_PIN_8 << BSRR_RESET) : GPIO_PIN_8;
+    uint8_t zx_matrix[ZX_MATRIX_ROWS] = {0};
+    ZxMatrixFromDevices(zx_matrix, devices, count);
+    MyKeys(zx_matrix);
+}
+#endif
+
+/* MAGIC, the frame clock, short taps and the frame swap, every millisecond and after a keyboard report */
+static void MyKeysTask() {
+    MagicPoll();
+    MyUnknownKeys();
+
+#if ZX_CLOCK
+    ZxClockUpdate();
+#endif
+#if ZX_HOLD_SCANS
+    /* Release short taps once scanned. The USB interrupt publishes too and checks hold_scan, a report between
+     * the tick and the scan would count the scan that ended before it. */
+#if ZX_PUBLISH_IRQ
+    Critical c;
+    CriticalUsbEnter(&c);
+#endif
+    if (MyHoldTick() && KeyHoldScan(&key_hold))
+        MyShow(key_hold.visible);
+#if ZX_PUBLISH_IRQ
+    CriticalUsbExit(&c, "MyHoldTick");
+#endif
+#endif
+#if ZX_CLOCK && ZX_STATS
+    if (zx_clock.scan != stats_scan) {
+        stats_scan = zx_clock.scan;
+        StatsKeyToRead(stats_scan);
+    }
+#endif
+
+#if ZX_PUBLISH_FRAME
+    /* Table published during a keyboard scan */
+    ResponderSwap();
+#endif
+
+#if !ZX_PUBLISH_IRQ
+    /* Keyboards connected? */
+    USBH_HandleTypeDef *devices[1 + USBH_HUB_MAX_PORTS];
+    const unsigned count = UsbHidDevices(devices);
+
+    /* New reports from any of them */
+    bool fresh = false;
+    unsigned d;
+    for (d = 0; d < count; d++)
+        if (USBH_HID_GetKeybdBoot(devices[d]) != NULL)
+            fresh = true;
+    if (!fresh)
+        return;
+
+    /* Get keys from all keyboard interfaces of all keyboards */
+    uint8_t zx_matrix[ZX_MATRIX_ROWS] = {0};
+    ZxMatrixFromDevices(zx_matrix, devices, count);
+    MyKeys(zx_matrix);
+#endif
+}
 
-    /* Magic key */
-    if (ZxMatrixGet(zx_matrix, ZX_MAGIC)) {
-        /* Disable IRQ */
-        __disable_irq();
-        /* Wait for M1 raise */
-        while ((GPIOA->IDR & GPIO_PIN_6) == 0);
-        while ((GPIOA->IDR & GPIO_PIN_6) != 0);
-        /* Press MAGIC */
-        GPIOB->BSRR = GPIO_PIN_9 << BSRR_RESET;
-        /* Delay */
-        volatile unsigned delay = 0;
-        while (delay < 2)
-            delay++;
-        /* Release MAGIC */
-        GPIOB->BSRR = GPIO_PIN_9;
-        /* Enable IRQ */
-        __enable_irq();
+/* Timings to UART every ZX_STATS_PERIOD_MS */
+static void MyStatsTask() {
+#if ZX_STATS
+    if (HAL_GetTick() - stats_time >= ZX_STATS_PERIOD_MS) {
+        stats_time = HAL_GetTick();
+        DebugOutput("Reports: %u, unchanged %u\r\n", (unsigned)stats_reports, (unsigned)stats_unchanged);
+        stats_reports = 0;
+        stats_unchanged = 0;
+        if (hUsbHostFS.pActiveClass == USBH_HID_CLASS && hUsbHostFS.gState == HOST_CLASS) {
+            const uint8_t interface = hUsbHostFS.device.current_interface;
+            DebugOutput("Poll: bInterval %u, poll %u, measured %u ms\r\n",
+                        hUsbHostFS.device.CfgDesc.Itf_Desc[interface].Ep_Desc[0].bInterval,
+                        USBH_HID_GetPollInterval(&hUsbHostFS), USBH_HID_GetReportInterval(&hUsbHostFS));
+        }
+        if (stats_connect_to_report != UINT32_MAX)
+            DebugOutput("Plug to first report: %u ms%s\r\n", (unsigned)stats_connect_to_report,
+                        stats_connect_cached ? ", cached configuration" : "");
+        ResponderReport();
+        CriticalReport();
+        SchedReport();
+#if ZX_CLOCK
+        ZxClockReport();
+#endif
+#if ZX_CLOCK && ZX_STATS
+        /* TIM2 ticks are HCLK cycles */
+        const uint32_t key_to_read_avg = key_to_read_count != 0 ? key_to_read_total / key_to_read_count : 0;
+        DebugOutput("Key to read: avg %u us, max %u us, %s polling\r\n",
+                    (unsigned)(CyclesToNs(key_to_read_avg) / 1000), (unsigned)(CyclesToNs(key_to_read_max) / 1000),
+                    ZX_POLL_JIT ? "just in time" : "interval");
+        key_to_read_total = 0;
+        key_to_read_count = 0;
+        key_to_read_max = 0;
+#endif
     }
+#endif
+}
+
+void MyIdle() {
+    MyKeysTask();
+    MyStatsTask();
+}
+
+#if ZX_SCHEDULER
+/* Enumeration advances one state per USBH_Process, so it runs back to back until the class is started.
+ * Not while a state waits out a delay such as the 100 ms of the port reset, the period and OTG wakes see its end. */
+static bool MyUsbBusy() {
+    return hUsbHostFS.gState != HOST_IDLE && hUsbHostFS.gState < HOST_CLASS && !USBH_WaitPending(&hUsbHostFS);
+}
+
+/* A keyboard report from USBH_Process in the USB task, or from the USB interrupt */
+void USBH_HID_EventCallback(USBH_HandleTypeDef *phost) {
+    (void)phost;
+    SchedWake(TASK_KEYS);
+}
+
+/* Whenever nothing else is due, it gives way to any wake */
+static bool MyFollowReady() {
+    return ZX_RESPONDER == ZX_RESPONDER_FOLLOW;
 }
 
-void EXTI9_5_IRQHandler() {
-    GPIOA->ODR = zx_prepared[GPIOB->IDR & 0xFF];
-    __HAL_GPIO_EXTI_CLEAR_IT(0xFFFF);
+/* Budgets are limits at 84 MHz, not measurements. Keys and USB together keep the follow loop away for less than
+ * 150 us, the console sends one or two bytes, stats prints a whole report, follow is a slice and the interrupts
+ * in it. A run over its budget is printed, with ZX_STATS SchedReport prints the longest run next to the budget. */
+static const Task my_tasks[TASK_COUNT] = {
+    [TASK_KEYS] = {"keys", MyKeysTask, NULL, 1, 4000},
+    [TASK_USB] = {"usb", MX_USB_HOST_Process, MyUsbBusy, 1, 8000},
+    [TASK_CONSOLE] = {"console", ConsoleSend, ConsoleReady, 0, 1000},
+    [TASK_STATS] = {"stats", MyStatsTask, NULL, ZX_STATS_PERIOD_MS, 100000},
+    [TASK_FOLLOW] = {"follow", ResponderFollow, MyFollowReady, 0, 16800},
+};
+
+/* Instead of the loop in main() */
+void MyRun() {
+    SchedInit(my_tasks, NULL);
+    for (;;)
+        SchedRun();
 }
+#endif
@@ -0,0 +1,403 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "report_plan.h"
+
+#define HID_PAGE_GENERIC_DESKTOP 0x01
+#define HID_PAGE_KEYBOARD 0x07
+#define HID_PAGE_BUTTON 0x09
+#define HID_USAGE_JOYSTICK 0x04
+#define HID_USAGE_GAME_PAD 0x05
+#define HID_USAGE_X 0x30
+#define HID_USAGE_Y 0x31
+#define HID_USAGE_HAT_SWITCH 0x39
+#define HID_COLLECTION_APPLICATION 0x01
+#define HID_KEY_FIRST 0x04 /* below are "no key" and error codes */
+#define HID_KEY_LEFT_CTRL 0xE0
+#define HID_KEY_RIGHT_GUI 0xE7
+
+/* Item prefixes without the size bits */
+#define HID_ITEM_INPUT 0x80
+#define HID_ITEM_OUTPUT 0x90
+#define HID_ITEM_FEATURE 0xB0
+#define HID_ITEM_COLLECTION 0xA0
+#define HID_ITEM_END_COLLECTION 0xC0
+#define HID_ITEM_USAGE_PAGE 0x04
+#define HID_ITEM_LOGICAL_MIN 0x14
+#define HID_ITEM_LOGICAL_MAX 0x24
+#define HID_ITEM_REPORT_SIZE 0x74
+#define HID_ITEM_REPORT_ID 0x84
+#define HID_ITEM_REPORT_COUNT 0x94
+#define HID_ITEM_PUSH 0xA4
+#define HID_ITEM_POP 0xB4
+#define HID_ITEM_USAGE 0x08
+#define HID_ITEM_USAGE_MIN 0x18
+#define HID_ITEM_USAGE_MAX 0x28
+#define HID_ITEM_LONG 0xFE
+
+#define HID_INPUT_CONSTANT 0x01
+#define HID_INPUT_VARIABLE 0x02
+
+/* Hat switch positions clockwise from up */
+static const uint8_t hat_to_joystick[8] = {
+    REPORT_PLAN_JOY_UP,
+    REPORT_PLAN_JOY_UP | REPORT_PLAN_JOY_RIGHT,
+    REPORT_PLAN_JOY_RIGHT,
+    REPORT_PLAN_JOY_DOWN | REPORT_PLAN_JOY_RIGHT,
+    REPORT_PLAN_JOY_DOWN,
+    REPORT_PLAN_JOY_DOWN | REPORT_PLAN_JOY_LEFT,
+    REPORT_PLAN_JOY_LEFT,
+    REPORT_PLAN_JOY_UP | REPORT_PLAN_JOY_LEFT,
+};
+
+static bool ReportPlanAddInput(ReportPlan *plan, uint32_t flags, const ReportPlanUsages *usages, int32_t logical_min,
+                               int32_t logical_max, uint32_t report_size, uint32_t report_count, unsigned offset) {
+    if (plan->fields_count >= REPORT_PLAN_MAX_FIELDS || usages->broken || usages->min > 0xFF)
+        return false;
+    ReportPlanField *f = &plan->fields[plan->fields_count++];
+    f->offset = offset;
+    f->usage = usages->min;
+    if (flags & HID_INPUT_VARIABLE) {
+        if (report_size != 1)
+            return false;
+        uint32_t count = usages->count != 0 ? usages->max - usages->min + 1 : 0;
+        if (count > report_count)
+            count = report_count;
+        if (count > 0x100 - usages->min)
+            count = 0x100 - usages->min;
+        if (count > 0xFF)
+            count = 0xFF;
+        f->type = REPORT_PLAN_BITMAP;
+        f->size = 1;
+        f->count = count;
+    } else {
+        if (report_size == 0 || report_size > 8 || report_count > 0xFF || logical_min < 0 || logical_max > 0xFF ||
+            logical_min > logical_max)
+            return false;
+        f->type = REPORT_PLAN_ARRAY;
+        f->size = report_size;
+        f->count = report_count;
+        f->logical_min = logical_min;
+        f->logical_max = logical_max;
+    }
+    return true;
+}
+
+/* Position of a usage among the elements of a main item, -1 if it is not there */
+static int ReportPlanUsageIndex(const ReportPlanUsages *usages, uint8_t listed, uint32_t usage) {
+    if (listed != 0)
+        return listed - 1;
+    if (!usages->broken && usages->count != 0 && usage >= usages->min && usage <= usages->max)
+        return usage - usages->min;
+    return -1;
+}
+
+static ReportPlanField *ReportPlanAddField(ReportPlan *plan, uint8_t type, unsigned offset) {
+    if (plan->fields_count >= REPORT_PLAN_MAX_FIELDS)
+        return NULL;
+    ReportPlanField *f = &plan->fields[plan->fields_count++];
+    f->type = type;
+    f->offset = offset;
+    return f;
+}
+
+/* Axis with thresholds at a quarter of the range from its ends, compared with the value made unsigned */
+static bool ReportPlanAddAxis(ReportPlanCompiler *c, uint8_t type, int index, unsigned offset) {
+    const int32_t min = c->logical_min, max = c->logical_max;
+    if (index < 0 || (uint32_t)index >= c->report_count || c->report_size == 0 || c->report_size > 16 || min >= max)
+        return true;
+    const int32_t bias = min < 0 ? 1 << (c->report_size - 1) : 0;
+    const int32_t low = min + (max - min) / 4 + bias, high = max - (max - min) / 4 + bias;
+    if (low < 0 || high > UINT16_MAX)
+        return true;
+    ReportPlanField *f = ReportPlanAddField(c->plan, min < 0 ? type | REPORT_PLAN_SIGNED : type,
+                                            offset + index * c->report_size);
+    if (f == NULL)
+        return false;
+    f->size = c->report_size;
+    f->low = low;
+    f->high = high;
+    return true;
+}
+
+/* Gamepad X and Y axes, 8 position hat switch and buttons, other usages are skipped */
+static bool ReportPlanAddGamepad(ReportPlanCompiler *c, uint32_t page, uint32_t flags, unsigned offset) {
+    const ReportPlanUsages *usages = &c->usages;
+    ReportPlanField *f;
+
+    if ((flags & HID_INPUT_VARIABLE) == 0)
+        return true;
+
+    if (page == HID_PAGE_BUTTON) {
+        if (c->report_size != 1 || usages->count == 0 || usages->broken || usages->min == 0 ||
+            usages->min > REPORT_PLAN_JOY_BUTTONS)
+            return true;
+        uint32_t count = usages->max - usages->min + 1;
+        if (count > c->report_count)
+            count = c->report_count;
+        if (count > REPORT_PLAN_JOY_BUTTONS + 1 - usages->min)
+            count = REPORT_PLAN_JOY_BUTTONS + 1 - usages->min;
+        f = ReportPlanAddField(c->plan, REPORT_PLAN_BUTTONS, offset);
+        if (f == NULL)
+            return false;
+        f->size = 1;
+        f->count = count;
+        f->usage = usages->min;
+        return true;
+    }
+
+    const int hat = ReportPlanUsageIndex(usages, usages->hat, HID_USAGE_HAT_SWITCH);
+    if (hat >= 0 && (uint32_t)hat < c->report_count && c->report_size <= 8 && c->logical_min >= 0 &&
+        c->logical_max - c->logical_min == 7) {
+        f = ReportPlanAddField(c->plan, REPORT_PLAN_HAT, offset + hat * c->report_size);
+        if (f == NULL)
+            return false;
+        f->size = c->report_size;
+        f->count = 1;
+        f->logical_min = c->logical_min;
+    }
+
+    return ReportPlanAddAxis(c, REPORT_PLAN_AXIS_X, ReportPlanUsageIndex(usages, usages->x, HID_USAGE_X), offset) &&
+           ReportPlanAddAxis(c, REPORT_PLAN_AXIS_Y, ReportPlanUsageIndex(usages, usages->y, HID_USAGE_Y), offset);
+}
+
+static bool ReportPlanItem(ReportPlanCompiler *c, uint8_t prefix, uint32_t data, unsigned size) {
+    const int32_t sdata = size == 0 ? 0 : size == 1 ? (int8_t)data : size == 2 ? (int16_t)data : (int32_t)data;
+    ReportPlanUsages *usages = &c->usages;
+    unsigned i;
+
+    switch (prefix & 0xFC) {
+        case HID_ITEM_USAGE_PAGE:
+            c->usage_page = data;
+            break;
+        case HID_ITEM_LOGICAL_MIN:
+            c->logical_min = sdata;
+            break;
+        case HID_ITEM_LOGICAL_MAX:
+            /* Unsigned when the minimum is not negative, 0..255 is often written as one byte FF */
+            c->logical_max = c->logical_min >= 0 ? (int32_t)data : sdata;
+            break;
+        case HID_ITEM_REPORT_SIZE:
+            c->report_size = data;
+            break;
+        case HID_ITEM_REPORT_ID:
+            c->report_id = data;
+            break;
+        case HID_ITEM_REPORT_COUNT:
+            c->report_count = data;
+            break;
+        case HID_ITEM_PUSH:
+        case HID_ITEM_POP:
+            return false;
+        case HID_ITEM_USAGE:
+            if (size == 4)
+                usages->page = data >> 16;
+            data &= 0xFFFF;
+            if (data == HID_USAGE_X)
+                usages->x = usages->count + 1;
+            else if (data == HID_USAGE_Y)
+                usages->y = usages->count + 1;
+            else if (data == HID_USAGE_HAT_SWITCH)
+                usages->hat = usages->count + 1;
+            if (usages->count == 0)
+                usages->min = data;
+            else if (data != usages->max + 1)
+                usages->broken = true;
+            usages->max = data;
+            usages->count++;
+            break;
+        case HID_ITEM_USAGE_MIN:
+            if (size == 4)
+                usages->page = data >> 16;
+            usages->min = data & 0xFFFF;
+            usages->count = 1;
+            break;
+        case HID_ITEM_USAGE_MAX:
+            usages->max = data & 0xFFFF;
+            usages->count = 1;
+            break;
+        case HID_ITEM_INPUT: {
+            /* Input bits are counted per report ID */
+            for (i = 0; i < c->ids_count && c->ids[i].id != c->report_id; i++);
+            if (i == c->ids_count) {
+                if (c->ids_count == REPORT_PLAN_MAX_IDS)
+                    return false;
+                c->ids[i].id = c->report_id;
+                c->ids[i].bits = 0;
+                c->ids_count++;
+            }
+            const unsigned offset = c->ids[i].bits;
+            const uint32_t bits = offset + c->report_size * c->report_count;
+            if (bits > UINT16_MAX)
+                return false;
+            c->ids[i].bits = bits;
+
+            const uint32_t page = usages->page != 0 ? usages->page : c->usage_page;
+            const bool keyboard = page == HID_PAGE_KEYBOARD;
+            const bool gamepad = c->gamepad && (page == HID_PAGE_GENERIC_DESKTOP || page == HID_PAGE_BUTTON);
+            if ((data & HID_INPUT_CONSTANT) == 0 && (keyboard || gamepad)) {
+                if (c->input_id < 0)
+                    c->input_id = c->report_id;
+                if ((uint32_t)c->input_id == c->report_id &&
+                    !(keyboard ? ReportPlanAddInput(c->plan, data, usages, c->logical_min, c->logical_max,
+                                                    c->report_size, c->report_count, offset)
+                               : ReportPlanAddGamepad(c, page, data, offset)))
+                    return false;
+            }
+            memset(usages, 0, sizeof(*usages));
+            break;
+        }
+        case HID_ITEM_COLLECTION: {
+            /* Gamepad fields count only in a gamepad */
+            const uint32_t page = usages->page != 0 ? usages->page : c->usage_page;
+            if (c->depth == 0)
+                c->gamepad = data == HID_COLLECTION_APPLICATION && page == HID_PAGE_GENERIC_DESKTOP &&
+                             usages->count != 0 &&
+                             (usages->min == HID_USAGE_JOYSTICK || usages->min == HID_USAGE_GAME_PAD);
+            c->depth++;
+            memset(usages, 0, sizeof(*usages));
+            break;
+        }
+        case HID_ITEM_END_COLLECTION:
+            if (c->depth != 0 && --c->depth == 0)
+                c->gamepad = false;
+            memset(usages, 0, sizeof(*usages));
+            break;
+        case HID_ITEM_OUTPUT:
+        case HID_ITEM_FEATURE:
+            memset(usages, 0, sizeof(*usages));
+            break;
+    }
+    return true;
+}
+
+void ReportPlanBegin(ReportPlanCompiler *c, ReportPlan *plan) {
+    memset(c, 0, sizeof(*c));
+    memset(plan, 0, sizeof(*plan));
+    c->plan = plan;
+    c->input_id = -1;
+}
+
+void ReportPlanFeed(ReportPlanCompiler *c, const uint8_t *desc, unsigned length) {
+    const uint8_t *const end = desc + length;
+    while (desc < end && !c->failed) {
+        c->item[c->item_fill++] = *desc++;
+        const uint8_t prefix = c->item[0];
+        if (prefix == HID_ITEM_LONG) {
+            c->failed = true;
+            break;
+        }
+        const unsigned size = (prefix & 3) == 3 ? 4 : (prefix & 3);
+        if (c->item_fill < size + 1)
+            continue;
+        uint32_t data = 0;
+        unsigned i;
+        for (i = 0; i < size; i++)
+            data |= (uint32_t)c->item[i + 1] << (i * 8);
+        c->item_fill = 0;
+        if (!ReportPlanItem(c, prefix, data, size))
+            c->failed = true;
+    }
+}
+
+bool ReportPlanEnd(ReportPlanCompiler *c) {
+    ReportPlan *plan = c->plan;
+    if (c->failed || c->item_fill != 0 || plan->fields_count == 0 || c->input_id > 0xFF) {
+        memset(plan, 0, sizeof(*plan));
+        return false;
+    }
+    plan->report_id = c->input_id;
+    return true;
+}
+
+static inline void ReportPlanSetKey(unsigned usage, uint8_t *modifiers, uint32_t *keys) {
+    if (usage >= HID_KEY_LEFT_CTRL && usage <= HID_KEY_RIGHT_GUI)
+        *modifiers |= 1 << (usage - HID_KEY_LEFT_CTRL);
+    else if (usage >= HID_KEY_FIRST && usage <= 0xFF)
+        keys[usage >> 5] |= 1u << (usage & 31);
+}
+
+/* Field of up to 16 bits at any bit offset */
+static inline unsigned ReportPlanBits(const uint8_t *report, unsigned length, unsigned bit, unsigned size) {
+    const unsigned n = bit >> 3;
+    const uint32_t word = report[n] | (n + 1 < length ? report[n + 1] << 8 : 0) |
+                          (n + 2 < length ? (uint32_t)report[n + 2] << 16 : 0);
+    return (word >> (bit & 7)) & ((1u << size) - 1);
+}
+
+bool ReportPlanDecode(const ReportPlan *plan, const uint8_t *report, unsigned length, uint8_t *modifiers,
+                      uint32_t keys[8], uint16_t *joystick) {
+    if (plan->report_id != 0) {
+        if (length == 0 || report[0] != plan->report_id)
+            return false;
+        report++;
+        length--;
+    }
+
+    *modifiers = 0;
+    *joystick = 0;
+    memset(keys, 0, 8 * sizeof(keys[0]));
+    const unsigned bits = length * 8;
+    const ReportPlanField *f = plan->fields;
+    const ReportPlanField *const f_end = f + plan->fields_count;
+    for (; f != f_end; f++) {
+        unsigned i;
+        if (f->type == REPORT_PLAN_BITMAP) {
+            for (i = 0; i < f->count; i++) {
+                const unsigned bit = f->offset + i;
+                if (bit >= bits)
+                    break;
+                const uint8_t byte = report[bit >> 3];
+                if ((bit & 7) == 0 && byte == 0) {
+                    i += 7; /* nothing pressed in the whole byte */
+                    continue;
+                }
+                if (byte & (1 << (bit & 7)))
+                    ReportPlanSetKey(f->usage + i, modifiers, keys);
+            }
+        } else if (f->type == REPORT_PLAN_ARRAY) {
+            for (i = 0; i < f->count; i++) {
+                const unsigned bit = f->offset + i * f->size;
+                if (bit + f->size > bits)
+                    break;
+                const unsigned value = ReportPlanBits(report, length, bit, f->size);
+                if (value >= f->logical_min && value <= f->logical_max)
+                    ReportPlanSetKey(f->usage + value - f->logical_min, modifiers, keys);
+            }
+        } else if (f->offset + f->size * (f->type == REPORT_PLAN_BUTTONS ? f->count : 1u) > bits) {
+            continue; /* short report */
+        } else if (f->type == REPORT_PLAN_BUTTONS) {
+            const unsigned value = ReportPlanBits(report, length, f->offset, f->count);
+            *joystick |= value << (REPORT_PLAN_JOY_BUTTON1 + f->usage - 1);
+        } else if (f->type == REPORT_PLAN_HAT) {
+            const unsigned value = ReportPlanBits(report, length, f->offset, f->size) - f->logical_min;
+            if (value < 8)
+                *joystick |= hat_to_joystick[value];
+        } else {
+            unsigned value = ReportPlanBits(report, length, f->offset, f->size);
+            if (f->type & REPORT_PLAN_SIGNED)
+                value ^= 1u << (f->size - 1);
+            const bool x = (f->type & ~REPORT_PLAN_SIGNED) == REPORT_PLAN_AXIS_X;
+            if (value < f->low)
+                *joystick |= x ? REPORT_PLAN_JOY_LEFT : REPORT_PLAN_JOY_UP;
+            else if (value > f->high)
+                *joystick |= x ? REPORT_PLAN_JOY_RIGHT : REPORT_PLAN_JOY_DOWN;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,400 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "stm32f4xx_hal.h"
+#include "my_config.h"
+#include "cycles.h"
+#include "latency.h"
+#include "zx_timer.h"
+#include "sched.h"
+#include "responder.h"
+#include "zx_prepare.h"
+
+#define NIBBLE_BITS 4
+#define NIBBLE_VALUES 0x10
+
+void DebugOutput(const char *format, ...);
+
+#if ZX_RAM_ISR
+/* Copied from flash by the startup, see .ram_text and .ram_vector in the linker script */
+#define RAM_FUNC __attribute__((section(".ramfunc"), noinline))
+#define VECTORS (16 + SPI4_IRQn + 1)
+static uint32_t ram_vectors[VECTORS] __attribute__((section(".ram_vector"), used));
+#else
+#define RAM_FUNC
+#endif
+
+/* Responder kernels. Rough cost at 84 MHz, publish / lookup after the GPIOB->IDR read:
+ * ZX_KERNEL_TABLE  - 256 bytes, one load.                      ~1500 / ~3 cycles
+ * ZX_KERNEL_NIBBLE - 2 x 16 bytes for A8-A11 and A12-A15,
+ *                    two loads ANDed.                           ~600 / ~6 cycles
+ * ZX_KERNEL_SIMD   - the 8 rows as 2 words, rows are picked
+ *                    by SEL with GE flags from the address
+ *                    and ORed together.                          ~10 / ~14 cycles
+ * Build with ZX_BENCHMARK=1 to print measured numbers. */
+
+#if ZX_KERNEL == ZX_KERNEL_TABLE
+
+/* Value of D0-D4 for every A8-A15, double buffered. The DMA responder selects the buffer
+ * by bits 8-15 of the address, so both are kept together and aligned. */
+typedef uint8_t ZxPrepared[ZX_TABLE_SIZE];
+static ZxPrepared zx_prepared_ab[2] __attribute__((aligned(2 * ZX_TABLE_SIZE))) = {
+    [0 ... 1] = {[0 ... ZX_TABLE_SIZE - 1] = 0xFF}};
+
+static void ZxPrepare(uint8_t *o, const uint8_t *zx_matrix) {
+    ZxPrepareTable(o, zx_matrix);
+}
+
+static inline uint8_t ZxLookup(const volatile uint8_t *p, uint32_t address) {
+    return p[address & 0xFF];
+}
+
+#elif ZX_KERNEL == ZX_KERNEL_NIBBLE
+
+/* Value of D0-D4 for every A8-A11 (rows 0-3), then for every A12-A15 (rows 4-7) */
+typedef uint8_t ZxPrepared[2 * NIBBLE_VALUES];
+static ZxPrepared zx_prepared_ab[2] = {[0 ... 1] = {[0 ... 2 * NIBBLE_VALUES - 1] = 0xFF}};
+
+static void ZxPrepare(uint8_t *o, const uint8_t *zx_matrix) {
+    unsigned h, i;
+    for (h = 0; h < 2; h++) {
+        for (i = 0; i < NIBBLE_VALUES; i++) {
+            unsigned j, p = 0, z = i;
+            for (j = 0; j < NIBBLE_BITS; j++) {
+                if ((z & 1) == 0)
+                    p |= zx_matrix[j];
+                z >>= 1;
+            }
+            *o++ = ~p;
+        }
+        zx_matrix += NIBBLE_BITS;
+    }
+}
+
+static inline uint8_t ZxLookup(const volatile uint8_t *p, uint32_t address) {
+    return p[address & 0x0F] & p[NIBBLE_VALUES + ((address >> NIBBLE_BITS) & 0x0F)];
+}
+
+#elif ZX_KERNEL == ZX_KERNEL_SIMD
+
+/* Rows 0-3 and rows 4-7, one byte per row */
+typedef uint8_t ZxPrepared[ZX_MATRIX_ROWS] __attribute__((aligned(4)));
+static ZxPrepared zx_prepared_ab[2];
+
+static void ZxPrepare(uint8_t *o, const uint8_t *zx_matrix) {
+    unsigned i;
+    for (i = 0; i < ZX_MATRIX_ROWS; i++)
+        o[i] = zx_matrix[i];
+}
+
+static inline uint8_t ZxLookup(const volatile uint8_t *p, uint32_t address) {
+    const volatile uint32_t *rows = (const volatile uint32_t *)p;
+    const uint32_t selected = ~address; /* A row is selected by a low address line */
+    uint32_t low, high;
+    /* GE[3:0] come from bits 19:16, SEL takes the bytes with GE set from the first operand */
+    __asm("msr APSR_g, %[ge]\n\tsel %[out], %[rows], %[zero]"
+          : [out] "=r"(low)
+          : [ge] "r"(selected << 16), [rows] "r"(rows[0]), [zero] "r"(0)
+          : "cc");
+    __asm("msr APSR_g, %[ge]\n\tsel %[out], %[rows], %[zero]"
+          : [out] "=r"(high)
+          : [ge] "r"(selected << (16 - NIBBLE_BITS)), [rows] "r"(rows[1]), [zero] "r"(0)
+          : "cc");
+    uint32_t v = low | high;
+    v |= v >> 16;
+    v |= v >> 8;
+    return (uint8_t)~v;
+}
+
+#else
+#error "Unknown ZX_KERNEL"
+#endif
+
+#if ZX_ASM_RESPONDER
+/* Read by EXTI9_5_IRQHandler in responder_asm.s */
+const volatile uint8_t *volatile zx_prepared = zx_prepared_ab[0];
+#else
+static const volatile uint8_t *volatile zx_prepared = zx_prepared_ab[0];
+#endif
+
+#if ZX_PUBLISH_FRAME
+/* Table waiting for a gap between keyboard scans, and since when in TIM2 ticks */
+static uint8_t *volatile zx_pending;
+static uint32_t zx_pending_time;
+#endif
+
+#if ZX_PUBLISH_FRAME && ZX_STATS
+static uint32_t frame_swaps;
+static uint32_t frame_deferred; /* Publishes in the middle of a scan */
+static uint32_t frame_timeouts; /* No gap within ZX_FRAME_WAIT_US */
+static uint32_t frame_wait_max;
+static uint32_t frame_wait_total;
+#endif
+
+#if ZX_RESPONDER == ZX_RESPONDER_FOLLOW && ZX_STATS
+static uint32_t follow_max_gap;  /* Longest stop of the loop, interrupts included */
+static uint32_t follow_max_away; /* Longest USB host and MyIdle run, KBD_RD interrupt answers */
+static uint32_t follow_exit;
+#endif
+
+#if ZX_LATENCY
+/* Filled by the interrupt handler, taken by ResponderReport */
+static LatencyRecorder latency_recorder = {.active = &latency_recorder.histograms[0]};
+static uint32_t latency_max;
+static uint32_t latency_max_at;
+#endif
+
+#if ZX_STATS
+static uint32_t publish_max;
+static uint32_t publish_total;
+static uint32_t publish_count;
+#endif
+
+#if ZX_BENCHMARK
+static void ResponderBenchmark() {
+    static const char *const names[] = {"table", "nibble", "simd"};
+    static const uint8_t zx_matrix[ZX_MATRIX_ROWS] = {0x01, 0, 0x04, 0, 0, 0x10, 0, 0x02};
+    ZxPrepared p;
+    volatile uint32_t address; /* A8-A15 as GPIOB->IDR gives them, every value in turn */
+    volatile uint8_t result;
+    unsigned i;
+
+    uint32_t t = Cycles();
+    ZxPrepare(p, zx_matrix);
+    const uint32_t publish = Cycles() - t;
+
+    t = Cycles();
+    for (i = 0; i < 0x100; i++) {
+        address = i;
+        result = (uint8_t)address;
+    }
+    const uint32_t empty = Cycles() - t;
+
+    t = Cycles();
+    for (i = 0; i < 0x100; i++) {
+        address = i;
+        result = ZxLookup(p, address);
+    }
+    const uint32_t lookup = Cycles() - t - empty;
+    (void)result;
+
+    DebugOutput("Kernel %s: publish %u cycles, lookup %u.%02u cycles\r\n", names[ZX_KERNEL], (unsigned)publish,
+                (unsigned)(lookup / 0x100), (unsigned)(lookup % 0x100 * 100 / 0x100));
+}
+#endif
+
+void ResponderInit() {
+#if ZX_RAM_ISR
+    SCB->VTOR = (uint32_t)ram_vectors;
+    __DSB();
+#endif
+#if ZX_STATS
+    CyclesInit();
+#endif
+#if ZX_BENCHMARK
+    ResponderBenchmark();
+#endif
+#if ZX_RESPONDER == ZX_RESPONDER_DMA
+    ResponderDmaInit(zx_prepared_ab[0]);
+#endif
+#if ZX_LATENCY || ZX_PUBLISH_FRAME
+    ZxTimerInit();
+#endif
+}
+
+static inline void ResponderSelect(uint8_t *a) {
+    zx_prepared = a;
+#if ZX_RESPONDER == ZX_RESPONDER_DMA
+    ResponderDmaSelect(a);
+#endif
+}
+
+void ResponderPublish(const uint8_t *zx_matrix) {
+#if ZX_STATS
+    const uint32_t t = Cycles();
+#endif
+    uint8_t *a = zx_prepared != zx_prepared_ab[0] ? zx_prepared_ab[0] : zx_prepared_ab[1];
+    ZxPrepare(a, zx_matrix);
+#if ZX_PUBLISH_FRAME
+    /* A table published again before its swap keeps the first time, so the wait stays bounded */
+    if (zx_pending == NULL)
+        zx_pending_time = TIM2->CNT;
+    zx_pending = a;
+    ResponderSwap();
+#if ZX_STATS
+    if (zx_pending != NULL)
+        frame_deferred++;
+#endif
+#else
+    ResponderSelect(a);
+#endif
+#if ZX_STATS
+    const uint32_t cycles = Cycles() - t;
+    if (cycles > publish_max)
+        publish_max = cycles;
+    publish_total += cycles;
+    publish_count++;
+#endif
+}
+
+/* Frame mode. Called from the main loop, shows the pending table once the ZX is not scanning the keyboard.
+ * A KBD_RD edge in the few cycles between the check and the store is the only read that can see the old table. */
+void ResponderSwap() {
+#if ZX_PUBLISH_FRAME
+    uint8_t *p = zx_pending;
+    if (p == NULL)
+        return;
+    const uint32_t kbd_rd = ZxTimerKbdRd(); /* Before the counter, see ZxTimerKbdRd */
+    const uint32_t now = TIM2->CNT;
+    const uint32_t ticks_per_us = SystemCoreClock / 1000000;
+    const uint32_t wait = now - zx_pending_time;
+    const bool gap = now - kbd_rd >= ZX_FRAME_GAP_US * ticks_per_us;
+    if (!gap && wait < ZX_FRAME_WAIT_US * ticks_per_us)
+        return;
+    ResponderSelect(p);
+    /* The USB interrupt may have published another table meanwhile, it stays pending */
+    (void)__atomic_compare_exchange_n(&zx_pending, &p, NULL, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+#if ZX_STATS
+    frame_swaps++;
+    if (!gap)
+        frame_timeouts++;
+    if (wait > frame_wait_max)
+        frame_wait_max = wait;
+    frame_wait_total += wait;
+#endif
+#endif
+}
+
+/* Follow mode. The loop takes about 12 cycles (0.14 us at 84 MHz) with the table kernel, so without
+ * interrupts D0-D4 are valid up to 2 loop periods, about 290 ns, after A8-A15 change. KBD_RD falls about
+ * 1.5 T-states after the address is valid: 430 ns at 3.5 MHz, 215 ns at 7 MHz, 107 ns at 14 MHz. So only a
+ * 3.5 MHz read of a new address is met, a faster one gets D0-D4 late unless the address was there before.
+ * The real worst case is one loop more than the longest gap between two ODR writes, follow_max_gap, printed
+ * as "Follow: max gap" with ZX_STATS. SysTick and OTG interrupts make it about 1 us, a whole publish with
+ * ZX_PUBLISH_IRQ about 1500 cycles, 18 us, with the table kernel. The loop exits every millisecond
+ * to run the USB host and MyIdle, the KBD_RD interrupt answers in the meantime. With ZX_SCHEDULER it is the
+ * lowest priority task and also exits when another task is woken, by the OTG interrupt or a keyboard report,
+ * or after FOLLOW_SLICE_US. KBD_RD does not wake anything, the loop goes on while the ZX reads the keyboard.
+ * The table is read again every pass: the USB interrupt publishes while the loop runs, and a second publish
+ * rewrites the buffer shown before the first one. */
+
+#define FOLLOW_SLICE_US 100 /* About a UART byte at 115200, the console task sends between the slices */
+
+#if ZX_RESPONDER == ZX_RESPONDER_FOLLOW
+static inline bool FollowGoOn(uint32_t tick, uint32_t start, uint32_t budget) {
+#if ZX_SCHEDULER
+    return uwTick == tick && sched_woken == 0 && Cycles() - start < budget;
+#else
+    (void)start;
+    (void)budget;
+    return uwTick == tick;
+#endif
+}
+#endif
+
+void ResponderFollow() {
+#if ZX_RESPONDER == ZX_RESPONDER_FOLLOW
+    const uint32_t tick = uwTick;
+    const uint32_t start = Cycles();
+#if ZX_SCHEDULER
+    const uint32_t budget = FOLLOW_SLICE_US * (SystemCoreClock / 1000000);
+#else
+    const uint32_t budget = 0;
+#endif
+#if ZX_STATS
+    uint32_t prev = Cycles();
+    if (follow_exit != 0 && prev - follow_exit > follow_max_away)
+        follow_max_away = prev - follow_exit;
+    do {
+        GPIOA->ODR = ZxLookup(zx_prepared, GPIOB->IDR);
+        const uint32_t now = Cycles();
+        if (now - prev > follow_max_gap)
+            follow_max_gap = now - prev;
+        prev = now;
+    } while (FollowGoOn(tick, start, budget));
+    follow_exit = Cycles();
+#else
+    do {
+        GPIOA->ODR = ZxLookup(zx_prepared, GPIOB->IDR);
+    } while (FollowGoOn(tick, start, budget));
+#endif
+#endif
+}
+
+void ResponderReport() {
+#if ZX_STATS
+    /* One publish per report at 1 kHz polling takes avg * 1000 cycles of each second */
+    const uint32_t avg = publish_count != 0 ? publish_total / publish_count : 0;
+    const uint32_t cpu = (uint32_t)((uint64_t)avg * 1000 * 10000 / SystemCoreClock);
+    DebugOutput("Publish: %u times, avg %u, max %u cycles, %u.%02u%% CPU at 1 kHz\r\n", (unsigned)publish_count,
+                (unsigned)avg, (unsigned)publish_max, (unsigned)(cpu / 100), (unsigned)(cpu % 100));
+    publish_max = 0;
+    publish_total = 0;
+    publish_count = 0;
+#endif
+#if ZX_PUBLISH_FRAME && ZX_STATS
+    /* Latency added by waiting for the end of a scan, TIM2 ticks are HCLK cycles */
+    const uint32_t wait_avg = frame_swaps != 0 ? frame_wait_total / frame_swaps : 0;
+    DebugOutput("Frame: %u swaps, %u deferred, %u timed out, wait avg %u us, max %u us\r\n", (unsigned)frame_swaps,
+                (unsigned)frame_deferred, (unsigned)frame_timeouts, (unsigned)(CyclesToNs(wait_avg) / 1000),
+                (unsigned)(CyclesToNs(frame_wait_max) / 1000));
+    frame_swaps = 0;
+    frame_deferred = 0;
+    frame_timeouts = 0;
+    frame_wait_max = 0;
+    frame_wait_total = 0;
+#endif
+#if ZX_RESPONDER == ZX_RESPONDER_FOLLOW && ZX_STATS
+    /* The worst case response is the longest gap between two ODR writes plus one loop */
+    DebugOutput("Follow: max gap %u cycles, %u ns, max away %u ns\r\n", (unsigned)follow_max_gap,
+                (unsigned)CyclesToNs(follow_max_gap), (unsigned)CyclesToNs(follow_max_away));
+    follow_max_gap = 0;
+    follow_max_away = 0;
+#endif
+#if ZX_LATENCY
+    LatencySummary s;
+    LatencyTake(&latency_recorder, &s);
+    DebugOutput("Latency: %u reads, min %u, p50 %u, p99 %u, p99.9 %u, max %u cycles, handler in %s\r\n",
+                (unsigned)s.total, (unsigned)s.min, (unsigned)s.p50, (unsigned)s.p99, (unsigned)s.p999,
+                (unsigned)s.max, ZX_RAM_ISR ? "SRAM" : "flash");
+    latency_max = s.max;
+    latency_max_at = s.max_at;
+#endif
+}
+
+#if ZX_LATENCY
+/* The longest edge to write time of the last ResponderReport and the TIM2 time of its write */
+void ResponderLatencyMax(uint32_t *cycles, uint32_t *at) {
+    *cycles = latency_max;
+    *at = latency_max_at;
+}
+#endif
+
+#if !ZX_ASM_RESPONDER
+RAM_FUNC void EXTI9_5_IRQHandler() {
+    GPIOA->ODR = ZxLookup(zx_prepared, GPIOB->IDR);
+#if ZX_LATENCY
+    /* After the write, so only the following reads are delayed */
+    const uint32_t now = Cycles();
+    LatencyRecord(&latency_recorder, ZxTimerKbdRd(), ZxTimerFromCycles(now));
+#endif
+    __HAL_GPIO_EXTI_CLEAR_IT(0xFFFF);
+}
+#endif
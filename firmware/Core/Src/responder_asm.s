@@ -0,0 +1,73 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* KBD_RD interrupt with a fixed instruction sequence, ZX_ASM_RESPONDER. The same as EXTI9_5_IRQHandler in
+ * responder.c with ZX_KERNEL_TABLE, but the time to the GPIOA->ODR store does not depend on the compiler and OPT.
+ *
+ * Cycles at zero wait states (SRAM with ZX_RAM_ISR, ART hits from flash), Cortex-M4 TRM 3.3:
+ *   exception entry, vector fetch and stacking   12
+ *   movw, movt zx_prepared                          2
+ *   movw, movt GPIOA                                2
+ *   ldr  table                                      2
+ *   ldrb GPIOB->IDR, pipelined with ldr            1
+ *   ldrb table[A8-A15], needs the previous ldrb     2
+ *   str  GPIOA->ODR                                 2
+ *   total to the ODR write                         23, 274 ns at 84 MHz
+ * No literal pool, so the code does not read flash through the D-bus. zx_odr_store marks the store,
+ * responder_cycles.sh counts the path from the ELF after the link and stops the build if it is over budget. */
+
+#include "my_config.h"
+
+#if ZX_ASM_RESPONDER
+
+#define GPIOA_BASE 0x40020000
+#define GPIOA_ODR 0x14
+#define GPIOB_IDR (0x400 + 0x10) /* From GPIOA_BASE */
+#define EXTI_PR 0x40013C14
+
+    .syntax unified
+    .cpu cortex-m4
+    .thumb
+
+#if ZX_RAM_ISR
+    .section .ramfunc.EXTI9_5_IRQHandler, "ax", %progbits
+#else
+    .section .text.EXTI9_5_IRQHandler, "ax", %progbits
+#endif
+    .global EXTI9_5_IRQHandler
+    .global zx_odr_store
+    .type EXTI9_5_IRQHandler, %function
+    .align 2
+EXTI9_5_IRQHandler:
+    movw r0, #:lower16:zx_prepared
+    movt r0, #:upper16:zx_prepared
+    movw r1, #:lower16:GPIOA_BASE
+    movt r1, #:upper16:GPIOA_BASE
+    ldr r0, [r0]                    /* Table shown now */
+    ldrb r2, [r1, #GPIOB_IDR]       /* A8-A15 */
+    ldrb r2, [r0, r2]
+zx_odr_store:
+    str r2, [r1, #GPIOA_ODR]
+    /* Off the hot path */
+    movw r0, #:lower16:EXTI_PR
+    movt r0, #:upper16:EXTI_PR
+    movw r1, #0xFFFF
+    str r1, [r0]
+    bx lr
+    .size EXTI9_5_IRQHandler, . - EXTI9_5_IRQHandler
+
+#endif
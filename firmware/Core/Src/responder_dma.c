@@ -0,0 +1,120 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* DMA keyboard port responder, the CPU does not take part in answering.
+ *
+ * KBD_RD (PA5) falling edge is captured by TIM2 channel 1, TIM2 TRGO starts TIM1 in one-pulse mode.
+ * TIM1 requests drive a chain of DMA2 streams which program stream 0 and start it:
+ *
+ * TIM1 TRIG, stream 4: GPIOB->IDR (A8-A15) -> low byte of the stream 0 source address in dma_program
+ * TIM1 CC1,  stream 1: dma_program -> stream 0 NDTR, PAR, M0AR, M1AR (4 words burst)
+ * TIM1 CC2,  stream 2: dma_start -> DMA2 HISR, LIFCR, HIFCR, stream 0 CR (4 words burst, sets EN)
+ * Stream 0 memory-to-memory: zx_prepared[A8-A15] -> GPIOA->ODR
+ *
+ * DMA registers can only be written by words and stream 0 registers only while it is disabled,
+ * so the address is patched in RAM and copied as a whole. Streams 1 and 2 work in the
+ * peripheral-to-memory direction so their FIFO reads the program when requested, not in advance.
+ *
+ * The answer comes a fixed time after the edge: about 4 cycles of capture and trigger sync,
+ * CC2 at 12 TIM1 ticks, then 2 DMA transfers, about 35 cycles or 0.4 us at 84 MHz.
+ * Interrupts and the USB host do not add jitter, only the bus load of the CPU does. */
+
+#include <stdint.h>
+#include "stm32f4xx_hal.h"
+#include "my_config.h"
+#include "responder.h"
+#include "zx_timer.h"
+
+#if ZX_RESPONDER == ZX_RESPONDER_DMA
+
+#define TIM1_CC1_TIME 1
+#define TIM1_CC2_TIME 12
+#define DMA_CHANNEL_TIM1 6
+
+#define DMA_WORKER_CR (DMA_SxCR_DIR_1 | DMA_SxCR_EN) /* memory-to-memory, bytes, low priority */
+#define DMA_WORKER_FLAGS \
+    (DMA_LIFCR_CFEIF0 | DMA_LIFCR_CDMEIF0 | DMA_LIFCR_CTEIF0 | DMA_LIFCR_CHTIF0 | DMA_LIFCR_CTCIF0)
+#define DMA_BURST_CR                                                                                         \
+    ((DMA_CHANNEL_TIM1 << DMA_SxCR_CHSEL_Pos) | DMA_SxCR_MBURST_0 | DMA_SxCR_PBURST_0 | DMA_SxCR_MSIZE_1 | \
+     DMA_SxCR_PSIZE_1 | DMA_SxCR_MINC | DMA_SxCR_PINC | DMA_SxCR_CIRC)
+
+/* Stream 0 NDTR, PAR, M0AR, M1AR */
+static volatile uint32_t dma_program[4] __attribute__((aligned(16)));
+
+/* DMA2 HISR (read only), LIFCR, HIFCR, stream 0 CR */
+static const uint32_t dma_start[4] __attribute__((aligned(16))) = {0, DMA_WORKER_FLAGS, 0, DMA_WORKER_CR};
+
+static void DmaStreamInit(DMA_Stream_TypeDef *stream, uint32_t cr, uint32_t fcr, volatile const void *src,
+                          volatile void *dst, uint32_t count) {
+    stream->CR = 0;
+    while (stream->CR & DMA_SxCR_EN);
+    stream->NDTR = count;
+    stream->PAR = (uint32_t)src;
+    stream->M0AR = (uint32_t)dst;
+    stream->FCR = fcr;
+    stream->CR = cr;
+}
+
+void ResponderDmaInit(const uint8_t *table) {
+    __HAL_RCC_DMA2_CLK_ENABLE();
+    __HAL_RCC_TIM1_CLK_ENABLE();
+
+    /* The EXTI interrupt is not needed */
+    HAL_NVIC_DisableIRQ(EXTI9_5_IRQn);
+
+    dma_program[0] = 1;
+    dma_program[1] = (uint32_t)table;
+    dma_program[2] = (uint32_t)&GPIOA->ODR;
+    dma_program[3] = 0;
+
+    /* Stream 0, the worker, FIFO is required for memory-to-memory */
+    DmaStreamInit(DMA2_Stream0, 0, DMA_SxFCR_DMDIS, table, &GPIOA->ODR, 1);
+    DMA2->LIFCR = DMA_WORKER_FLAGS;
+
+    /* Stream 4, A8-A15 to the program */
+    DmaStreamInit(DMA2_Stream4,
+                  (DMA_CHANNEL_TIM1 << DMA_SxCR_CHSEL_Pos) | DMA_SxCR_PL_0 | DMA_SxCR_PL_1 | DMA_SxCR_CIRC |
+                      DMA_SxCR_EN,
+                  0, &GPIOB->IDR, &dma_program[1], 1);
+
+    /* Stream 1, the program to stream 0 */
+    DmaStreamInit(DMA2_Stream1, DMA_BURST_CR | DMA_SxCR_PL_1 | DMA_SxCR_EN, DMA_SxFCR_DMDIS | DMA_SxFCR_FTH,
+                  dma_program, &DMA2_Stream0->NDTR, 4);
+
+    /* Stream 2, start stream 0 */
+    DmaStreamInit(DMA2_Stream2, DMA_BURST_CR | DMA_SxCR_PL_0 | DMA_SxCR_EN, DMA_SxFCR_DMDIS | DMA_SxFCR_FTH,
+                  dma_start, &DMA2->HISR, 4);
+
+    /* TIM1, one pulse started by TIM2 TRGO (ITR1) */
+    TIM1->CR1 = TIM_CR1_OPM;
+    TIM1->SMCR = TIM_SMCR_TS_0 | TIM_SMCR_SMS_2 | TIM_SMCR_SMS_1;
+    TIM1->CCR1 = TIM1_CC1_TIME;
+    TIM1->CCR2 = TIM1_CC2_TIME;
+    TIM1->ARR = TIM1_CC2_TIME + 1;
+    TIM1->DIER = TIM_DIER_TDE | TIM_DIER_CC1DE | TIM_DIER_CC2DE;
+
+    /* TIM2 captures the KBD_RD falling edge, TRGO on capture */
+    ZxTimerInit();
+    TIM2->CR2 = TIM_CR2_MMS_1 | TIM_CR2_MMS_0;
+}
+
+void ResponderDmaSelect(const uint8_t *table) {
+    /* Both tables differ in bits 8-15 only, byte write is atomic against the A8-A15 write of stream 4 */
+    ((volatile uint8_t *)&dma_program[1])[1] = (uint8_t)((uint32_t)table >> 8);
+}
+
+#endif
@@ -0,0 +1,130 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "stm32f4xx_hal.h"
+#include "my_config.h"
+#include "cycles.h"
+#include "sched.h"
+
+void DebugOutput(const char *format, ...);
+
+volatile uint8_t sched_wake[TASK_COUNT];
+volatile uint8_t sched_woken;
+
+#if ZX_SCHEDULER
+
+/* Run times are wall time, they include the interrupts taken during the run */
+typedef struct {
+    uint32_t last; /* HAL_GetTick of the last run */
+    uint32_t runs;
+    uint64_t cycles;
+    uint32_t max;
+    uint32_t over; /* Runs longer than the budget */
+} TaskStats;
+
+static const Task *sched_tasks;
+static void (*sched_idle)();
+static TaskStats sched_stats[TASK_COUNT];
+static uint32_t sched_start; /* Cycles at the start of the running task */
+static uint32_t sched_budget;
+static unsigned sched_last = TASK_COUNT; /* Task of the previous pass */
+static uint32_t sched_report;            /* HAL_GetTick of the last report */
+
+void SchedInit(const Task *tasks, void (*idle)()) {
+    unsigned i;
+    CyclesInit();
+    sched_tasks = tasks;
+    sched_idle = idle;
+    for (i = 0; i < TASK_COUNT; i++)
+        sched_stats[i].last = HAL_GetTick();
+    sched_report = HAL_GetTick();
+}
+
+void SchedRun() {
+    const uint32_t now = HAL_GetTick();
+    unsigned i, run = TASK_COUNT;
+#if !ZX_STATS
+    /* Without SchedReport, the first long run of every period is printed too */
+    if (now - sched_report >= ZX_STATS_PERIOD_MS) {
+        sched_report = now;
+        for (i = 0; i < TASK_COUNT; i++)
+            sched_stats[i].over = 0;
+    }
+#endif
+    sched_woken = 0; /* Before the checks, a wake after them is seen by the task */
+    for (i = 0; i < TASK_COUNT; i++) {
+        const Task *t = &sched_tasks[i];
+        const bool due = sched_wake[i] != 0 || (t->period_ms != 0 && now - sched_stats[i].last >= t->period_ms) ||
+                         (t->ready != NULL && t->ready());
+        if (!due)
+            continue;
+        run = i;
+        /* The task of the previous pass waits for the next due one, if there is one */
+        if (i != sched_last)
+            break;
+    }
+    sched_last = run;
+    if (run == TASK_COUNT) {
+        if (sched_idle != NULL)
+            sched_idle();
+        return;
+    }
+    const Task *t = &sched_tasks[run];
+    TaskStats *s = &sched_stats[run];
+    sched_wake[run] = 0; /* Before the run, a wake during it runs the task again */
+    s->last = now;
+    sched_budget = t->budget;
+    sched_start = Cycles();
+    t->run();
+    const uint32_t cycles = Cycles() - sched_start;
+    s->runs++;
+    s->cycles += cycles;
+    if (cycles > s->max)
+        s->max = cycles;
+    /* The first long run of every report period is printed at once, SchedReport counts them all */
+    if (cycles > t->budget && s->over++ == 0)
+        DebugOutput("Task %s: %u cycles, over the budget of %u\r\n", t->name, (unsigned)cycles, (unsigned)t->budget);
+}
+
+/* For tasks with a long queue of work, they return and are run again in the next pass */
+bool SchedBudgetOver() {
+    return Cycles() - sched_start >= sched_budget;
+}
+
+#endif
+
+void SchedReport() {
+#if ZX_SCHEDULER && ZX_STATS
+    const uint32_t now = HAL_GetTick();
+    const uint64_t elapsed = (uint64_t)(now - sched_report) * (SystemCoreClock / 1000);
+    unsigned i;
+    sched_report = now;
+    for (i = 0; i < TASK_COUNT; i++) {
+        TaskStats *s = &sched_stats[i];
+        const uint32_t cpu = elapsed != 0 ? (uint32_t)(s->cycles * 10000 / elapsed) : 0;
+        DebugOutput("Task %s: %u runs, %u.%02u%% CPU, max %u cycles, %u ns, %u over %u\r\n", sched_tasks[i].name,
+                    (unsigned)s->runs, (unsigned)(cpu / 100), (unsigned)(cpu % 100), (unsigned)s->max,
+                    (unsigned)CyclesToNs(s->max), (unsigned)s->over, (unsigned)sched_tasks[i].budget);
+        s->runs = 0;
+        s->cycles = 0;
+        s->max = 0;
+        s->over = 0;
+    }
+#endif
+}
@@ -0,0 +1,142 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "stm32f4xx_hal.h"
+#include "my_config.h"
+#include "zx_timer.h"
+#include "zx_clock.h"
+
+void DebugOutput(const char *format, ...);
+
+/* Everything is sampled from the main loop: TIM2 captures KBD_RD, TIM3 counts M1, the KBD_RD interrupt
+ * handler does nothing more. A scan is over when KBD_RD has been quiet for ZX_FRAME_GAP_US, the last edge
+ * of a scan is as periodic as the first one. */
+
+#define FRAME_MIN_US 19000
+#define FRAME_MAX_US 21500
+#define FRAME_48K_128K_US 19980      /* Between 19.968 and 19.992 ms */
+#define FRAME_128K_PENTAGON_US 20236 /* Between 19.992 and 20.48 ms */
+#define TURBO_KHZ 4500
+#define LOCK_FRAMES 8
+#define FILTER_SHIFT 3
+#define M1_WINDOW_FRAMES 50 /* The highest M1 count of a frame is taken over a second */
+
+/* The 16 bit TIM3 wraps after 65536 M1, 18.7 ms at the M1 rate of a 14 MHz CPU. A frame with a longer gap
+ * between two updates, a blocking DebugOutput without ZX_SCHEDULER, has a wrong M1 count and is left out. */
+#define M1_MAX_KHZ 3500
+#define M1_WRAP_US (65536 * 1000 / M1_MAX_KHZ)
+
+ZxClock zx_clock;
+
+static uint32_t last_kbd_rd;
+static uint32_t last_update;
+static uint16_t m1_counter;
+static bool m1_lost;
+static uint32_t m1;
+static uint32_t m1_at_scan;
+static uint32_t m1_window_max;
+static uint32_t m1_frame_max;
+static unsigned window_frames;
+static unsigned good_frames;
+
+void ZxClockInit() {
+    ZxTimerInit();
+    ZxTimerM1Init();
+    m1_counter = TIM3->CNT;
+    last_kbd_rd = ZxTimerKbdRd();
+    last_update = TIM2->CNT;
+}
+
+static void ZxClockClassify() {
+    const uint32_t ticks_per_us = SystemCoreClock / 1000000;
+    const uint32_t frame_us = zx_clock.frame / ticks_per_us;
+    if (good_frames < LOCK_FRAMES)
+        zx_clock.model = ZX_MODEL_UNKNOWN;
+    else if (zx_clock.cpu_khz > TURBO_KHZ)
+        zx_clock.model = ZX_MODEL_TURBO;
+    else if (frame_us < FRAME_48K_128K_US)
+        zx_clock.model = ZX_MODEL_48K;
+    else if (frame_us < FRAME_128K_PENTAGON_US)
+        zx_clock.model = ZX_MODEL_128K;
+    else
+        zx_clock.model = ZX_MODEL_PENTAGON;
+}
+
+/* A keyboard scan ended at the time */
+static void ZxClockScan(uint32_t time) {
+    const uint32_t ticks_per_us = SystemCoreClock / 1000000;
+    const uint32_t period = time - zx_clock.scan;
+    const uint32_t m1_frame = m1 - m1_at_scan;
+    zx_clock.scan = time;
+    m1_at_scan = m1;
+
+    /* A program that does not scan every frame breaks the lock */
+    if (period < FRAME_MIN_US * ticks_per_us || period > FRAME_MAX_US * ticks_per_us) {
+        good_frames = 0;
+        zx_clock.frame = 0;
+        zx_clock.model = ZX_MODEL_UNKNOWN;
+        return;
+    }
+    if (zx_clock.frame == 0)
+        zx_clock.frame = period;
+    else
+        zx_clock.frame += ((int32_t)(period - zx_clock.frame)) >> FILTER_SHIFT;
+    if (good_frames < LOCK_FRAMES)
+        good_frames++;
+
+    /* M1 every 4 T-states at most */
+    if (m1_lost) {
+        m1_lost = false;
+    } else {
+        if (m1_frame > m1_window_max)
+            m1_window_max = m1_frame;
+        if (++window_frames >= M1_WINDOW_FRAMES) {
+            m1_frame_max = m1_window_max;
+            m1_window_max = 0;
+            window_frames = 0;
+        }
+    }
+    const uint32_t m1_max = m1_frame_max > m1_window_max ? m1_frame_max : m1_window_max;
+    zx_clock.cpu_khz = (uint32_t)((uint64_t)m1_max * 4 * (SystemCoreClock / 1000) / zx_clock.frame);
+
+    ZxClockClassify();
+}
+
+void ZxClockUpdate() {
+    const uint16_t counter = TIM3->CNT;
+    m1 += (uint16_t)(counter - m1_counter);
+    m1_counter = counter;
+
+    const uint32_t kbd_rd = ZxTimerKbdRd(); /* Before the counter, see ZxTimerKbdRd */
+    const uint32_t now = TIM2->CNT;
+    if (now - last_update >= M1_WRAP_US * (SystemCoreClock / 1000000))
+        m1_lost = true;
+    last_update = now;
+    if (kbd_rd != last_kbd_rd && now - kbd_rd >= ZX_FRAME_GAP_US * (SystemCoreClock / 1000000)) {
+        last_kbd_rd = kbd_rd;
+        ZxClockScan(kbd_rd);
+    }
+}
+
+void ZxClockReport() {
+    static const char *const names[] = {"unknown", "48K", "128K", "Pentagon", "turbo"};
+    const uint32_t ticks_per_us = SystemCoreClock / 1000000;
+    DebugOutput("ZX: %s, frame %u us, CPU %u kHz\r\n", names[zx_clock.model],
+                (unsigned)(zx_clock.frame / ticks_per_us), (unsigned)zx_clock.cpu_khz);
+}
@@ -0,0 +1,29 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include "zx_keys.h"
+
+/* ZX keys of the joystick directions and gamepad buttons by profile, selected with F5, F6 and F7 */
+const uint8_t joystick_to_zx[][REPORT_PLAN_JOY_BUTTON1 + REPORT_PLAN_JOY_BUTTONS] = {
+    [JOYSTICK_CURSOR] = { ZX_8, ZX_5, ZX_6, ZX_7, ZX_0, ZX_0, ZX_0, ZX_0, NONE, NONE, NONE, NONE, ZX_SPACE, ZX_ENTER,
+                          NONE, NONE },
+    [JOYSTICK_SINCLAIR1] = { ZX_7, ZX_6, ZX_8, ZX_9, ZX_0, ZX_0, ZX_0, ZX_0, NONE, NONE, NONE, NONE, ZX_SPACE,
+                             ZX_ENTER, NONE, NONE },
+    [JOYSTICK_SINCLAIR2] = { ZX_2, ZX_1, ZX_3, ZX_4, ZX_5, ZX_5, ZX_5, ZX_5, NONE, NONE, NONE, NONE, ZX_SPACE,
+                             ZX_ENTER, NONE, NONE },
+};
@@ -0,0 +1,96 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "stm32f4xx_hal.h"
+#include "cycles.h"
+#include "critical.h"
+#include "zx_timer.h"
+
+#define SAMPLE_MAX_CYCLES 16 /* TIM2->CNT read between two cycle counter reads, not interrupted */
+
+uint32_t zx_timer_cycles_offset;
+
+void ZxTimerInit() {
+    static bool initialized = false;
+    if (initialized)
+        return;
+    initialized = true;
+
+    __HAL_RCC_TIM2_CLK_ENABLE();
+
+    /* Free running, channel 1 captures the falling edge of TI1 */
+    TIM2->PSC = 0;
+    TIM2->ARR = 0xFFFFFFFF;
+    TIM2->CCMR1 = TIM_CCMR1_CC1S_0;
+    TIM2->CCER = TIM_CCER_CC1P | TIM_CCER_CC1E;
+    TIM2->EGR = TIM_EGR_UG;
+    TIM2->CR1 = TIM_CR1_CEN;
+
+    /* Both counters run from HCLK, the offset is constant. The APB1 read takes a few cycles,
+     * so the offset is accurate to about 2 cycles. KBD_RD is not masked with ZX_IRQ_AUDIT, a split read is redone. */
+    CyclesInit();
+    Critical c;
+    uint32_t before, ticks, cycles;
+    do {
+        CriticalEnter(&c);
+        before = Cycles();
+        ticks = TIM2->CNT;
+        cycles = Cycles();
+        CriticalExit(&c, "ZxTimerInit");
+    } while (cycles - before > SAMPLE_MAX_CYCLES);
+    zx_timer_cycles_offset = cycles - ticks;
+
+    /* PA5 to TIM2_CH1, the EXTI line stays configured */
+    GPIO_InitTypeDef GPIO_InitStruct = {0};
+    GPIO_InitStruct.Pin = GPIO_PIN_5;
+    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+    GPIO_InitStruct.Alternate = GPIO_AF1_TIM2;
+    HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+}
+
+void ZxTimerM1Init() {
+    static bool initialized = false;
+    if (initialized)
+        return;
+    initialized = true;
+
+    __HAL_RCC_TIM3_CLK_ENABLE();
+
+    /* External clock mode 1 from TI1 inverted, so both count the falling edge, the channel 1 capture of every
+     * edge is the compare pulse on TRGO */
+    TIM3->PSC = 0;
+    TIM3->ARR = 0xFFFF;
+    TIM3->CCMR1 = TIM_CCMR1_CC1S_0;
+    TIM3->CCER = TIM_CCER_CC1P | TIM_CCER_CC1E;
+    TIM3->SMCR = TIM_SMCR_TS_2 | TIM_SMCR_TS_0 | TIM_SMCR_SMS_2 | TIM_SMCR_SMS_1 | TIM_SMCR_SMS_0;
+    TIM3->CR2 = TIM_CR2_MMS_1 | TIM_CR2_MMS_0;
+    TIM3->EGR = TIM_EGR_UG;
+    TIM3->CR1 = TIM_CR1_CEN;
+
+    /* PA6 to TIM3_CH1, GPIOA->IDR still reads it */
+    GPIO_InitTypeDef GPIO_InitStruct = {0};
+    GPIO_InitStruct.Pin = GPIO_PIN_6;
+    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+    GPIO_InitStruct.Alternate = GPIO_AF2_TIM3;
+    HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+}
@@ -409,6 +409,19 @@ HAL_StatusTypeDef HAL_HCD_HC_SubmitRequest(HCD_HandleTypeDef *hhcd,
           hhcd->hc[ch_num].data_pid = HC_PID_DATA1;
         }
       }
+      else if ((token == 1U) && (direction == 1U)) /* receive data */
+      {
+        /* The host library splits long Data IN stages into several requests
+           and keeps the toggle, it sets 1 at the start of every stage */
+        if (hhcd->hc[ch_num].toggle_in == 0U)
+        {
+          hhcd->hc[ch_num].data_pid = HC_PID_DATA0;
+        }
+      }
+      else
+      {
+        /* ... */
+      }
       break;
 
     case EP_TYPE_BULK:
@@ -1060,6 +1073,17 @@ HAL_StatusTypeDef HAL_HCD_ResetPort(HCD_HandleTypeDef *hhcd)
   return (USB_ResetPort(hhcd->Instance));
 }
 
+/**
+  * @brief  Assert or release the host port reset without waiting.
+  * @param  hhcd HCD handle
+  * @param  resetActiveState 1 - assert the reset, 0 - release it
+  * @retval HAL status
+  */
+HAL_StatusTypeDef HAL_HCD_ResetPort2(HCD_HandleTypeDef *hhcd, uint32_t resetActiveState)
+{
+  return (USB_ResetPort2(hhcd->Instance, resetActiveState));
+}
+
 /**
   * @}
   */
@@ -1653,6 +1653,36 @@ HAL_StatusTypeDef USB_ResetPort(USB_OTG_GlobalTypeDef *USBx)
   return HAL_OK;
 }
 
+/**
+  * @brief  USB_ResetPort2 : Assert or release the Host Port reset
+  * @param  USBx  Selected device
+  * @param  resetActiveState  1 - assert the reset, 0 - release it
+  * @retval HAL status
+  * @note   Does not wait, the caller keeps the reset asserted at least 10 ms
+  */
+HAL_StatusTypeDef USB_ResetPort2(USB_OTG_GlobalTypeDef *USBx, uint32_t resetActiveState)
+{
+  uint32_t USBx_BASE = (uint32_t)USBx;
+
+  __IO uint32_t hprt0 = 0U;
+
+  hprt0 = USBx_HPRT0;
+
+  hprt0 &= ~(USB_OTG_HPRT_PENA | USB_OTG_HPRT_PCDET |
+             USB_OTG_HPRT_PENCHNG | USB_OTG_HPRT_POCCHNG);
+
+  if (resetActiveState == 0U)
+  {
+    USBx_HPRT0 = ((~USB_OTG_HPRT_PRST) & hprt0);
+  }
+  else
+  {
+    USBx_HPRT0 = (USB_OTG_HPRT_PRST | hprt0);
+  }
+
+  return HAL_OK;
+}
+
 /**
   * @brief  USB_DriveVbus : activate or de-activate vbus
   * @param  state  VBUS state
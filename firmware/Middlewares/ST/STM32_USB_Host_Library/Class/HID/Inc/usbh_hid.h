@@ -27,6 +27,7 @@ extern "C" {
 
 /* Includes ------------------------------------------------------------------*/
 #include "usbh_core.h"
+#include "report_plan.h"
 #include "usbh_hid_mouse.h"
 #include "usbh_hid_keybd.h"
 
@@ -52,7 +53,27 @@ extern "C" {
   * @{
   */
 
+#ifndef HID_MIN_POLL
 #define HID_MIN_POLL                                10U
+#endif
+#ifndef HID_POLL_OVERRIDE
+#define HID_POLL_OVERRIDE                           0U
+#endif
+
+/* Report ring policy */
+#define HID_RING_LATEST                             0U  /* the reader gets the newest report, older are skipped */
+#define HID_RING_KEEP_ALL                           1U  /* the reader gets every report, polling stops when full */
+#ifndef HID_RING_POLICY
+#define HID_RING_POLICY                             HID_RING_LATEST
+#endif
+#ifndef HID_RING_SIZE
+#define HID_RING_SIZE                               4U  /* reports, power of 2 */
+#endif
+#define HID_RING_REPORT_SIZE                        64U /* bytes, full speed interrupt packet */
+#ifndef HID_MAX_INTERFACES
+/* Polled HID interfaces of a device, each one after the first takes a host channel */
+#define HID_MAX_INTERFACES                          USBH_MAX_NUM_INTERFACES
+#endif
 #define HID_REPORT_SIZE                             16U
 #define HID_MAX_USAGE                               10U
 #define HID_MAX_NBR_REPORT_FMT                      10U
@@ -206,6 +227,18 @@ typedef struct
 } FIFO_TypeDef;
 
 
+/* Single producer, single consumer ring of whole reports. The host channel
+   receives straight into the slot at head, so the only copy is to the reader. */
+typedef struct
+{
+  uint32_t      report[HID_RING_SIZE][HID_RING_REPORT_SIZE / sizeof(uint32_t)];
+  uint16_t      size[HID_RING_SIZE];  /* bytes received into each slot */
+  __IO uint32_t head;     /* reports written, changed by the producer only */
+  __IO uint32_t tail;     /* reports read, changed by the consumer only */
+  uint32_t      skipped;  /* reports never read, HID_RING_LATEST */
+} HID_RingTypeDef;
+
+
 /* Structure for HID process */
 typedef struct _HID_Process
 {
@@ -215,18 +248,35 @@ typedef struct _HID_Process
   uint8_t              OutEp;
   uint8_t              InEp;
   HID_CtlStateTypeDef  ctl_state;
-  FIFO_TypeDef         fifo;
+  HID_RingTypeDef      ring;
   uint8_t              *pData;
   uint16_t             length;
   uint8_t              ep_addr;
   uint16_t             poll;
+  uint16_t             interval;
   uint32_t             timer;
   uint8_t              DataReady;
+  uint8_t              plan_valid;
+  ReportPlan           plan;
+  HID_KEYBD_BootTypeDef keys;        /* last keyboard state reported by the interface */
+  uint8_t              itf_ix;        /* index in CfgDesc.Itf_Desc */
   HID_DescTypeDef      HID_Desc;
   USBH_StatusTypeDef(* Init)(USBH_HandleTypeDef *phost);
 }
 HID_HandleTypeDef;
 
+/* All polled HID interfaces of the device, pActiveClass->pData points to it. The first one
+   is the boot interface the class was started for.
+   The others are keyboard interfaces of a composite device: NKRO bitmaps, media keys,
+   a second key block. They have an IN pipe only. */
+typedef struct _HID_Device
+{
+  HID_HandleTypeDef    itf[HID_MAX_INTERFACES];
+  uint8_t              count;
+  uint8_t              setup;         /* interface running its class requests */
+}
+HID_DeviceTypeDef;
+
 /**
   * @}
   */
@@ -305,16 +355,28 @@ USBH_StatusTypeDef USBH_HID_SetProtocol(USBH_HandleTypeDef *phost,
 
 void USBH_HID_EventCallback(USBH_HandleTypeDef *phost);
 
+uint8_t USBH_HID_PollCallback(USBH_HandleTypeDef *phost, uint8_t due);
+
 HID_TypeTypeDef USBH_HID_GetDeviceType(USBH_HandleTypeDef *phost);
 
 uint8_t USBH_HID_GetPollInterval(USBH_HandleTypeDef *phost);
 
+uint16_t USBH_HID_GetReportInterval(USBH_HandleTypeDef *phost);
+
 void USBH_HID_FifoInit(FIFO_TypeDef *f, uint8_t *buf, uint16_t size);
 
 uint16_t  USBH_HID_FifoRead(FIFO_TypeDef *f, void *buf, uint16_t  nbytes);
 
 uint16_t  USBH_HID_FifoWrite(FIFO_TypeDef *f, void *buf, uint16_t nbytes);
 
+void USBH_HID_RingInit(HID_RingTypeDef *r);
+
+uint8_t *USBH_HID_RingWriteSlot(HID_RingTypeDef *r);
+
+void USBH_HID_RingCommit(HID_RingTypeDef *r, uint16_t size);
+
+uint16_t USBH_HID_RingRead(HID_RingTypeDef *r, uint32_t *buf, uint16_t nbytes);
+
 /**
   * @}
   */
@@ -285,8 +285,28 @@ typedef struct
 }
 HID_KEYBD_Info_TypeDef;
 
+#define KEYBD_BOOT_REPORT_SIZE                 8U
+
+/* Keyboard or gamepad report decoded in one pass, boot or report protocol */
+typedef struct
+{
+  uint8_t  modifiers;   /* bit 0 - left ctrl ... bit 7 - right gui */
+  uint16_t joystick;    /* REPORT_PLAN_JOY_ directions and buttons */
+  uint32_t keys[8];     /* one bit per pressed key code, KEY_A and above */
+}
+HID_KEYBD_BootTypeDef;
+
+struct _HID_Process;
+struct _HID_Device;
+
 USBH_StatusTypeDef USBH_HID_KeybdInit(USBH_HandleTypeDef *phost);
+void USBH_HID_KeybdInitInterface(struct _HID_Process *HID_Handle);
 HID_KEYBD_Info_TypeDef *USBH_HID_GetKeybdInfo(USBH_HandleTypeDef *phost);
+const HID_KEYBD_BootTypeDef *USBH_HID_GetKeybdBoot(USBH_HandleTypeDef *phost);
+void USBH_HID_KeybdBootDecode(const uint8_t *report, uint16_t length, HID_KEYBD_BootTypeDef *boot);
+USBH_StatusTypeDef USBH_HID_KeybdDecodeReport(const struct _HID_Process *HID_Handle, const uint8_t *report,
+                                              uint16_t length, HID_KEYBD_BootTypeDef *boot);
+const HID_KEYBD_BootTypeDef *USBH_HID_KeybdMerge(const struct _HID_Device *HID_Device);
 uint8_t USBH_HID_GetASCIICode(HID_KEYBD_Info_TypeDef *info);
 
 /**
@@ -79,6 +79,9 @@ EndBSPDependencies */
 /** @defgroup USBH_HID_CORE_Private_Macros
   * @{
   */
+/* wIndex of the class requests: the number of the current interface */
+#define HID_INTERFACE_NUMBER(phost) \
+  ((uint16_t)(phost)->device.CfgDesc.Itf_Desc[(phost)->device.current_interface].bInterfaceNumber)
 /**
   * @}
   */
@@ -88,6 +91,11 @@ EndBSPDependencies */
   * @{
   */
 
+#if (HID_REPORT_PROTOCOL == 1U)
+/* Compiles the report descriptor while it is received, one device enumerates at a time */
+static ReportPlanCompiler HID_ReportCompiler;
+#endif
+
 /**
   * @}
   */
@@ -102,11 +110,25 @@ static USBH_StatusTypeDef USBH_HID_InterfaceDeInit(USBH_HandleTypeDef *phost);
 static USBH_StatusTypeDef USBH_HID_ClassRequest(USBH_HandleTypeDef *phost);
 static USBH_StatusTypeDef USBH_HID_Process(USBH_HandleTypeDef *phost);
 static USBH_StatusTypeDef USBH_HID_SOFProcess(USBH_HandleTypeDef *phost);
+static USBH_StatusTypeDef USBH_HID_InterfaceRequest(USBH_HandleTypeDef *phost, HID_HandleTypeDef *HID_Handle,
+                                                    uint8_t ix);
+static USBH_StatusTypeDef USBH_HID_InterfaceProcess(USBH_HandleTypeDef *phost, HID_HandleTypeDef *HID_Handle,
+                                                    uint8_t ix);
+static USBH_StatusTypeDef USBH_HID_OpenInterface(USBH_HandleTypeDef *phost, HID_HandleTypeDef *HID_Handle,
+                                                 uint8_t interface, uint8_t out);
+static void  USBH_HID_CloseInterface(USBH_HandleTypeDef *phost, HID_HandleTypeDef *HID_Handle);
 static void  USBH_HID_ParseHIDDesc(HID_DescTypeDef *desc, uint8_t *buf);
+static void  USBH_HID_ReportDescSink(USBH_HandleTypeDef *phost, uint16_t offset,
+                                     const uint8_t *data, uint16_t length);
 
 extern USBH_StatusTypeDef USBH_HID_MouseInit(USBH_HandleTypeDef *phost);
 extern USBH_StatusTypeDef USBH_HID_KeybdInit(USBH_HandleTypeDef *phost);
 
+#if (USBH_CFG_CACHE_SIZE > 0U)
+_Static_assert(HID_MAX_INTERFACES * sizeof(ReportPlan) <= USBH_CFG_CACHE_CLASS_SIZE,
+               "USBH_CFG_CACHE_CLASS_SIZE is too small");
+#endif
+
 USBH_ClassTypeDef  HID_Class =
 {
   "HID",
@@ -137,12 +159,20 @@ USBH_ClassTypeDef  HID_Class =
 static USBH_StatusTypeDef USBH_HID_InterfaceInit(USBH_HandleTypeDef *phost)
 {
   USBH_StatusTypeDef status;
+  HID_DeviceTypeDef *HID_Device;
   HID_HandleTypeDef *HID_Handle;
-  uint8_t max_ep;
-  uint8_t num = 0U;
+  USBH_InterfaceDescTypeDef *pif;
   uint8_t interface;
+  uint8_t ix;
 
   interface = USBH_FindInterface(phost, phost->pActiveClass->ClassCode, HID_BOOT_CODE, 0xFFU);
+#if (HID_REPORT_PROTOCOL == 1U)
+  /* Gamepads have no boot interface, their report descriptor tells */
+  if (interface == 0xFFU)
+  {
+    interface = USBH_FindInterface(phost, phost->pActiveClass->ClassCode, 0xFFU, 0xFFU);
+  }
+#endif
 
   if ((interface == 0xFFU) || (interface >= USBH_MAX_NUM_INTERFACES)) /* No Valid Interface */
   {
@@ -157,18 +187,19 @@ static USBH_StatusTypeDef USBH_HID_InterfaceInit(USBH_HandleTypeDef *phost)
     return USBH_FAIL;
   }
 
-  phost->pActiveClass->pData = (HID_HandleTypeDef *)USBH_malloc(sizeof(HID_HandleTypeDef));
-  HID_Handle = (HID_HandleTypeDef *) phost->pActiveClass->pData;
+  phost->pActiveClass->pData = (HID_DeviceTypeDef *)USBH_malloc(sizeof(HID_DeviceTypeDef));
+  HID_Device = (HID_DeviceTypeDef *) phost->pActiveClass->pData;
 
-  if (HID_Handle == NULL)
+  if (HID_Device == NULL)
   {
     USBH_DbgLog("Cannot allocate memory for HID Handle");
     return USBH_FAIL;
   }
 
   /* Initialize hid handler */
-  (void)USBH_memset(HID_Handle, 0, sizeof(HID_HandleTypeDef));
+  (void)USBH_memset(HID_Device, 0, sizeof(HID_DeviceTypeDef));
 
+  HID_Handle = &HID_Device->itf[0];
   HID_Handle->state = HID_ERROR;
 
   /*Decode Bootclass Protocol: Mouse or Keyboard*/
@@ -182,12 +213,66 @@ static USBH_StatusTypeDef USBH_HID_InterfaceInit(USBH_HandleTypeDef *phost)
     USBH_UsrLog("Mouse device found!");
     HID_Handle->Init = USBH_HID_MouseInit;
   }
+#if (HID_REPORT_PROTOCOL == 1U)
+  else if (phost->device.CfgDesc.Itf_Desc[interface].bInterfaceSubClass != HID_BOOT_CODE)
+  {
+    USBH_UsrLog("Report protocol device found!");
+    HID_Handle->Init = USBH_HID_KeybdInit;
+  }
+#endif
   else
   {
     USBH_UsrLog("Protocol not supported.");
     return USBH_FAIL;
   }
 
+  /* Host channels are scarce behind a hub and nothing is sent to the OUT endpoint */
+  (void)USBH_HID_OpenInterface(phost, HID_Handle, interface, (phost->pParent == NULL) ? 1U : 0U);
+  HID_Device->count = 1U;
+
+  /* Other keyboard interfaces of the device, found to carry keys or not by their report descriptors */
+  for (ix = 0U; (ix < USBH_MAX_NUM_INTERFACES) && (HID_Device->count < HID_MAX_INTERFACES); ix++)
+  {
+    pif = &phost->device.CfgDesc.Itf_Desc[ix];
+    if ((ix == interface) || (pif->bInterfaceClass != USB_HID_CLASS) || (pif->bAlternateSetting != 0U) ||
+        (pif->bInterfaceProtocol == HID_MOUSE_BOOT_CODE))
+    {
+      continue;
+    }
+
+    HID_Handle = &HID_Device->itf[HID_Device->count];
+    HID_Handle->Init = USBH_HID_KeybdInit;
+    if (USBH_HID_OpenInterface(phost, HID_Handle, ix, 0U) == USBH_OK)
+    {
+      USBH_UsrLog("HID interface %d added", pif->bInterfaceNumber);
+      HID_Device->count++;
+    }
+    else
+    {
+      USBH_HID_CloseInterface(phost, HID_Handle);
+      (void)USBH_memset(HID_Handle, 0, sizeof(HID_HandleTypeDef));
+    }
+  }
+
+  return USBH_OK;
+}
+
+/**
+  * @brief  USBH_HID_OpenInterface
+  *         The function opens the pipes of a HID interface.
+  * @param  phost: Host handle
+  * @param  HID_Handle: HID handle of the interface
+  * @param  interface: index of the interface in the configuration
+  * @param  out: open the OUT pipe as well
+  * @retval USBH_OK, USBH_FAIL if there is no IN pipe
+  */
+static USBH_StatusTypeDef USBH_HID_OpenInterface(USBH_HandleTypeDef *phost, HID_HandleTypeDef *HID_Handle,
+                                                 uint8_t interface, uint8_t out)
+{
+  uint8_t max_ep;
+  uint8_t num = 0U;
+
+  HID_Handle->itf_ix    = interface;
   HID_Handle->state     = HID_INIT;
   HID_Handle->ctl_state = HID_REQ_INIT;
   HID_Handle->ep_addr   = phost->device.CfgDesc.Itf_Desc[interface].Ep_Desc[0].bEndpointAddress;
@@ -199,6 +284,11 @@ static USBH_StatusTypeDef USBH_HID_InterfaceInit(USBH_HandleTypeDef *phost)
     HID_Handle->poll = HID_MIN_POLL;
   }
 
+  if (HID_POLL_OVERRIDE != 0U)
+  {
+    HID_Handle->poll = HID_POLL_OVERRIDE;
+  }
+
   /* Check of available number of endpoints */
   /* Find the number of EPs in the Interface Descriptor */
   /* Choose the lower number in order not to overrun the buffer allocated */
@@ -213,6 +303,12 @@ static USBH_StatusTypeDef USBH_HID_InterfaceInit(USBH_HandleTypeDef *phost)
     {
       HID_Handle->InEp = (phost->device.CfgDesc.Itf_Desc[interface].Ep_Desc[num].bEndpointAddress);
       HID_Handle->InPipe = USBH_AllocPipe(phost, HID_Handle->InEp);
+      if (HID_Handle->InPipe == 0xFFU)
+      {
+        /* No free host channel */
+        HID_Handle->InPipe = 0U;
+        return USBH_FAIL;
+      }
 
       /* Open pipe for IN endpoint */
       (void)USBH_OpenPipe(phost, HID_Handle->InPipe, HID_Handle->InEp, phost->device.address,
@@ -220,10 +316,16 @@ static USBH_StatusTypeDef USBH_HID_InterfaceInit(USBH_HandleTypeDef *phost)
 
       (void)USBH_LL_SetToggle(phost, HID_Handle->InPipe, 0U);
     }
-    else
+    else if (out != 0U)
     {
       HID_Handle->OutEp = (phost->device.CfgDesc.Itf_Desc[interface].Ep_Desc[num].bEndpointAddress);
       HID_Handle->OutPipe  = USBH_AllocPipe(phost, HID_Handle->OutEp);
+      if (HID_Handle->OutPipe == 0xFFU)
+      {
+        /* No free host channel, the pipe is not used for now */
+        HID_Handle->OutPipe = 0U;
+        continue;
+      }
 
       /* Open pipe for OUT endpoint */
       (void)USBH_OpenPipe(phost, HID_Handle->OutPipe, HID_Handle->OutEp, phost->device.address,
@@ -231,21 +333,25 @@ static USBH_StatusTypeDef USBH_HID_InterfaceInit(USBH_HandleTypeDef *phost)
 
       (void)USBH_LL_SetToggle(phost, HID_Handle->OutPipe, 0U);
     }
+    else
+    {
+      /* Only the first interface sends output reports */
+    }
   }
 
-  return USBH_OK;
+  return (HID_Handle->InPipe != 0U) ? USBH_OK : USBH_FAIL;
 }
 
 /**
-  * @brief  USBH_HID_InterfaceDeInit
-  *         The function DeInit the Pipes used for the HID class.
+  * @brief  USBH_HID_CloseInterface
+  *         The function closes the pipes of a HID interface, it is not polled
+  *         after that.
   * @param  phost: Host handle
-  * @retval USBH Status
+  * @param  HID_Handle: HID handle of the interface
+  * @retval None
   */
-static USBH_StatusTypeDef USBH_HID_InterfaceDeInit(USBH_HandleTypeDef *phost)
+static void USBH_HID_CloseInterface(USBH_HandleTypeDef *phost, HID_HandleTypeDef *HID_Handle)
 {
-  HID_HandleTypeDef *HID_Handle = (HID_HandleTypeDef *) phost->pActiveClass->pData;
-
   if (HID_Handle->InPipe != 0x00U)
   {
     (void)USBH_ClosePipe(phost, HID_Handle->InPipe);
@@ -260,8 +366,27 @@ static USBH_StatusTypeDef USBH_HID_InterfaceDeInit(USBH_HandleTypeDef *phost)
     HID_Handle->OutPipe = 0U;     /* Reset the pipe as Free */
   }
 
-  if ((phost->pActiveClass->pData) != NULL)
+  HID_Handle->state = HID_ERROR;
+}
+
+/**
+  * @brief  USBH_HID_InterfaceDeInit
+  *         The function DeInit the Pipes used for the HID class.
+  * @param  phost: Host handle
+  * @retval USBH Status
+  */
+static USBH_StatusTypeDef USBH_HID_InterfaceDeInit(USBH_HandleTypeDef *phost)
+{
+  HID_DeviceTypeDef *HID_Device = (HID_DeviceTypeDef *) phost->pActiveClass->pData;
+  uint8_t ix;
+
+  if (HID_Device != NULL)
   {
+    for (ix = 0U; ix < HID_Device->count; ix++)
+    {
+      USBH_HID_CloseInterface(phost, &HID_Device->itf[ix]);
+    }
+
     USBH_free(phost->pActiveClass->pData);
     phost->pActiveClass->pData = 0U;
   }
@@ -272,16 +397,71 @@ static USBH_StatusTypeDef USBH_HID_InterfaceDeInit(USBH_HandleTypeDef *phost)
 /**
   * @brief  USBH_HID_ClassRequest
   *         The function is responsible for handling Standard requests
-  *         for HID class.
+  *         for HID class, interface by interface.
   * @param  phost: Host handle
   * @retval USBH Status
   */
 static USBH_StatusTypeDef USBH_HID_ClassRequest(USBH_HandleTypeDef *phost)
+{
+  USBH_StatusTypeDef status;
+  HID_DeviceTypeDef *HID_Device = (HID_DeviceTypeDef *) phost->pActiveClass->pData;
+  HID_HandleTypeDef *HID_Handle = &HID_Device->itf[HID_Device->setup];
+
+  /* Class requests go to the current interface */
+  phost->device.current_interface = HID_Handle->itf_ix;
+  status = USBH_HID_InterfaceRequest(phost, HID_Handle, HID_Device->setup);
+
+  /* Interfaces are polled only if they carry keys or a gamepad */
+  if ((status == USBH_OK) && (HID_Handle->Init == USBH_HID_KeybdInit) && (HID_Handle->plan_valid == 0U) &&
+      (phost->device.CfgDesc.Itf_Desc[HID_Handle->itf_ix].bInterfaceProtocol != HID_KEYBRD_BOOT_CODE))
+  {
+    USBH_HID_CloseInterface(phost, HID_Handle);
+  }
+  else if ((status == USBH_FAIL) && (HID_Device->setup != 0U))
+  {
+    /* Failure of other interfaces does not stop the device */
+    USBH_HID_CloseInterface(phost, HID_Handle);
+    status = USBH_OK;
+  }
+  else
+  {
+    /* ... */
+  }
+
+  if (status == USBH_OK)
+  {
+    HID_Device->setup++;
+    if (HID_Device->setup < HID_Device->count)
+    {
+      status = USBH_BUSY;
+    }
+    else
+    {
+      phost->device.current_interface = HID_Device->itf[0].itf_ix;
+
+      /* all requests performed*/
+      phost->pUser(phost, HOST_USER_CLASS_ACTIVE);
+    }
+  }
+
+  return status;
+}
+
+/**
+  * @brief  USBH_HID_InterfaceRequest
+  *         The function is responsible for handling Standard requests
+  *         for one HID interface.
+  * @param  phost: Host handle
+  * @param  HID_Handle: HID handle of the interface, the current interface
+  * @param  ix: index of the HID handle
+  * @retval USBH Status
+  */
+static USBH_StatusTypeDef USBH_HID_InterfaceRequest(USBH_HandleTypeDef *phost, HID_HandleTypeDef *HID_Handle,
+                                                    uint8_t ix)
 {
 
   USBH_StatusTypeDef status         = USBH_BUSY;
   USBH_StatusTypeDef classReqStatus = USBH_BUSY;
-  HID_HandleTypeDef *HID_Handle = (HID_HandleTypeDef *) phost->pActiveClass->pData;
 
   /* Switch HID state machine */
   switch (HID_Handle->ctl_state)
@@ -289,9 +469,25 @@ static USBH_StatusTypeDef USBH_HID_ClassRequest(USBH_HandleTypeDef *phost)
     case HID_REQ_INIT:
     case HID_REQ_GET_HID_DESC:
 
-      USBH_HID_ParseHIDDesc(&HID_Handle->HID_Desc, phost->device.CfgDesc_Raw);
+      USBH_HID_ParseHIDDesc(&HID_Handle->HID_Desc, phost->device.CfgDesc.Itf_Desc[HID_Handle->itf_ix].ClassDesc);
 
-      HID_Handle->ctl_state = HID_REQ_GET_REPORT_DESC;
+      /* A known device does not need to send its report descriptor again, the plan compiled from it is cached */
+#if (USBH_CFG_CACHE_SIZE > 0U)
+      if (phost->device.CfgCached != 0U)
+      {
+        (void)USBH_memcpy(&HID_Handle->plan, &phost->device.ClassCache[ix * sizeof(ReportPlan)],
+                          sizeof(HID_Handle->plan));
+        HID_Handle->plan_valid = (HID_Handle->plan.fields_count != 0U) ? 1U : 0U;
+        HID_Handle->ctl_state = HID_REQ_SET_IDLE;
+      }
+      else
+#endif
+      {
+#if (HID_REPORT_PROTOCOL == 1U)
+        ReportPlanBegin(&HID_ReportCompiler, &HID_Handle->plan);
+#endif
+        HID_Handle->ctl_state = HID_REQ_GET_REPORT_DESC;
+      }
 
       break;
     case HID_REQ_GET_REPORT_DESC:
@@ -300,7 +496,25 @@ static USBH_StatusTypeDef USBH_HID_ClassRequest(USBH_HandleTypeDef *phost)
       classReqStatus = USBH_HID_GetHIDReportDescriptor(phost, HID_Handle->HID_Desc.wItemLength);
       if (classReqStatus == USBH_OK)
       {
-        /* The descriptor is available in phost->device.Data */
+        /* The descriptor has been compiled while it was received */
+#if (HID_REPORT_PROTOCOL == 1U)
+        if ((HID_Handle->Init == USBH_HID_KeybdInit) && ReportPlanEnd(&HID_ReportCompiler))
+        {
+          USBH_UsrLog("Report protocol, %d fields", HID_Handle->plan.fields_count);
+          HID_Handle->plan_valid = 1U;
+        }
+        else
+#endif
+        {
+          (void)USBH_memset(&HID_Handle->plan, 0, sizeof(HID_Handle->plan));
+          HID_Handle->plan_valid = 0U;
+        }
+#if (USBH_CFG_CACHE_SIZE > 0U)
+        (void)USBH_memcpy(&phost->device.ClassCache[ix * sizeof(ReportPlan)], &HID_Handle->plan,
+                          sizeof(HID_Handle->plan));
+#else
+        (void)ix;
+#endif
         HID_Handle->ctl_state = HID_REQ_SET_IDLE;
       }
       else if (classReqStatus == USBH_NOT_SUPPORTED)
@@ -334,14 +548,19 @@ static USBH_StatusTypeDef USBH_HID_ClassRequest(USBH_HandleTypeDef *phost)
       break;
 
     case HID_REQ_SET_PROTOCOL:
-      /* set protocol */
-      classReqStatus = USBH_HID_SetProtocol(phost, 0U);
-      if (classReqStatus == USBH_OK)
+      /* Only boot interfaces have protocols */
+      if (phost->device.CfgDesc.Itf_Desc[HID_Handle->itf_ix].bInterfaceSubClass != HID_BOOT_CODE)
       {
         HID_Handle->ctl_state = HID_REQ_IDLE;
+        status = USBH_OK;
+        break;
+      }
 
-        /* all requests performed*/
-        phost->pUser(phost, HOST_USER_CLASS_ACTIVE);
+      /* set protocol: report protocol (0U here) with a compiled plan, boot protocol (1U) otherwise */
+      classReqStatus = USBH_HID_SetProtocol(phost, (HID_Handle->plan_valid != 0U) ? 0U : 1U);
+      if (classReqStatus == USBH_OK)
+      {
+        HID_Handle->ctl_state = HID_REQ_IDLE;
         status = USBH_OK;
       }
       else if (classReqStatus == USBH_NOT_SUPPORTED)
@@ -366,20 +585,58 @@ static USBH_StatusTypeDef USBH_HID_ClassRequest(USBH_HandleTypeDef *phost)
 /**
   * @brief  USBH_HID_Process
   *         The function is for managing state machine for HID data transfers
+  *         of all interfaces, they are polled in the same frames.
   * @param  phost: Host handle
   * @retval USBH Status
   */
 static USBH_StatusTypeDef USBH_HID_Process(USBH_HandleTypeDef *phost)
+{
+  HID_DeviceTypeDef *HID_Device = (HID_DeviceTypeDef *) phost->pActiveClass->pData;
+  USBH_StatusTypeDef status;
+  uint8_t ix;
+
+  status = USBH_HID_InterfaceProcess(phost, &HID_Device->itf[0], 0U);
+
+  for (ix = 1U; ix < HID_Device->count; ix++)
+  {
+    if (HID_Device->itf[ix].InPipe != 0U)
+    {
+      (void)USBH_HID_InterfaceProcess(phost, &HID_Device->itf[ix], ix);
+    }
+  }
+
+  return status;
+}
+
+/**
+  * @brief  USBH_HID_InterfaceProcess
+  *         The function is for managing state machine for HID data transfers
+  *         of one interface
+  * @param  phost: Host handle
+  * @param  HID_Handle: HID handle of the interface
+  * @param  ix: index of the HID handle
+  * @retval USBH Status
+  */
+static USBH_StatusTypeDef USBH_HID_InterfaceProcess(USBH_HandleTypeDef *phost, HID_HandleTypeDef *HID_Handle,
+                                                    uint8_t ix)
 {
   USBH_StatusTypeDef status = USBH_OK;
-  HID_HandleTypeDef *HID_Handle = (HID_HandleTypeDef *) phost->pActiveClass->pData;
   uint32_t XferSize;
 
   switch (HID_Handle->state)
   {
     case HID_INIT:
-      HID_Handle->Init(phost);
-      HID_Handle->state = HID_IDLE;
+      if (ix == 0U)
+      {
+        HID_Handle->Init(phost);
+        HID_Handle->state = HID_IDLE;
+      }
+      else
+      {
+        /* GET_REPORT goes to the first interface only */
+        USBH_HID_KeybdInitInterface(HID_Handle);
+        HID_Handle->state = HID_SYNC;
+      }
 
 #if (USBH_USE_OS == 1U)
       phost->os_msg = (uint32_t)USBH_URB_EVENT;
@@ -428,6 +685,7 @@ static USBH_StatusTypeDef USBH_HID_Process(USBH_HandleTypeDef *phost)
       if ((phost->Timer & 1U) != 0U)
       {
         HID_Handle->state = HID_GET_DATA;
+        HID_Handle->timer = phost->Timer;
       }
 
 #if (USBH_USE_OS == 1U)
@@ -441,11 +699,18 @@ static USBH_StatusTypeDef USBH_HID_Process(USBH_HandleTypeDef *phost)
       break;
 
     case HID_GET_DATA:
+      /* Receive straight into the ring, wait while it is full */
+      HID_Handle->pData = USBH_HID_RingWriteSlot(&HID_Handle->ring);
+      if (HID_Handle->pData == NULL)
+      {
+        break;
+      }
       (void)USBH_InterruptReceiveData(phost, HID_Handle->pData,
                                       (uint8_t)HID_Handle->length,
                                       HID_Handle->InPipe);
 
       HID_Handle->state = HID_POLL;
+      HID_Handle->interval = (uint16_t)(phost->Timer - HID_Handle->timer);
       HID_Handle->timer = phost->Timer;
       HID_Handle->DataReady = 0U;
       break;
@@ -457,7 +722,7 @@ static USBH_StatusTypeDef USBH_HID_Process(USBH_HandleTypeDef *phost)
 
         if ((HID_Handle->DataReady == 0U) && (XferSize != 0U))
         {
-          (void)USBH_HID_FifoWrite(&HID_Handle->fifo, HID_Handle->pData, HID_Handle->length);
+          USBH_HID_RingCommit(&HID_Handle->ring, (uint16_t)XferSize);
           HID_Handle->DataReady = 1U;
           USBH_HID_EventCallback(phost);
 
@@ -501,11 +766,29 @@ static USBH_StatusTypeDef USBH_HID_Process(USBH_HandleTypeDef *phost)
   */
 static USBH_StatusTypeDef USBH_HID_SOFProcess(USBH_HandleTypeDef *phost)
 {
-  HID_HandleTypeDef *HID_Handle = (HID_HandleTypeDef *) phost->pActiveClass->pData;
+  HID_DeviceTypeDef *HID_Device = (HID_DeviceTypeDef *) phost->pActiveClass->pData;
+  HID_HandleTypeDef *HID_Handle;
+  uint8_t due = 0U;
+  uint8_t now;
+  uint8_t ix;
+
+  for (ix = 0U; ix < HID_Device->count; ix++)
+  {
+    HID_Handle = &HID_Device->itf[ix];
+    if ((HID_Handle->state == HID_POLL) && ((phost->Timer - HID_Handle->timer) >= HID_Handle->poll))
+    {
+      due = 1U;
+    }
+  }
+
+  /* The application may poll earlier, the schedule restarts from there */
+  now = USBH_HID_PollCallback(phost, due);
 
-  if (HID_Handle->state == HID_POLL)
+  for (ix = 0U; ix < HID_Device->count; ix++)
   {
-    if ((phost->Timer - HID_Handle->timer) >= HID_Handle->poll)
+    HID_Handle = &HID_Device->itf[ix];
+    if ((HID_Handle->state == HID_POLL) &&
+        ((now != 0U) || ((phost->Timer - HID_Handle->timer) >= HID_Handle->poll)))
     {
       HID_Handle->state = HID_GET_DATA;
 
@@ -524,8 +807,9 @@ static USBH_StatusTypeDef USBH_HID_SOFProcess(USBH_HandleTypeDef *phost)
 
 /**
   * @brief  USBH_Get_HID_ReportDescriptor
-  *         Issue report Descriptor command to the device. Once the response
-  *         received, parse the report descriptor and update the status.
+  *         Issue report Descriptor command to the device. The descriptor is
+  *         compiled into the keyboard report plan chunk by chunk as it arrives,
+  *         so its length is not limited by a buffer.
   * @param  phost: Host handle
   * @param  Length : HID Report Descriptor Length
   * @retval USBH Status
@@ -536,20 +820,46 @@ USBH_StatusTypeDef USBH_HID_GetHIDReportDescriptor(USBH_HandleTypeDef *phost,
 
   USBH_StatusTypeDef status;
 
-  status = USBH_GetDescriptor(phost,
-                              USB_REQ_RECIPIENT_INTERFACE | USB_REQ_TYPE_STANDARD,
-                              USB_DESC_HID_REPORT,
-                              phost->device.Data,
-                              length);
+  status = USBH_GetDescriptorStream(phost,
+                                    USB_REQ_RECIPIENT_INTERFACE | USB_REQ_TYPE_STANDARD,
+                                    USB_DESC_HID_REPORT, HID_INTERFACE_NUMBER(phost),
+                                    length, USBH_HID_ReportDescSink);
 
-  /* HID report descriptor is available in phost->device.Data.
-  In case of USB Boot Mode devices for In report handling ,
-  HID report descriptor parsing is not required.
-  In case, for supporting Non-Boot Protocol devices and output reports,
-  user may parse the report descriptor*/
+  return status;
+}
 
+/**
+  * @brief  USBH_HID_ReportDescSink
+  *         Receives a chunk of the report descriptor
+  * @param  phost: Host handle
+  * @param  offset: Offset of the chunk in the descriptor
+  * @param  data: Chunk
+  * @param  length: Length of the chunk
+  * @retval None
+  */
+static void USBH_HID_ReportDescSink(USBH_HandleTypeDef *phost, uint16_t offset,
+                                    const uint8_t *data, uint16_t length)
+{
+#if (HID_REPORT_PROTOCOL == 1U)
+  HID_DeviceTypeDef *HID_Device = (HID_DeviceTypeDef *) phost->pActiveClass->pData;
+  HID_HandleTypeDef *HID_Handle = &HID_Device->itf[HID_Device->setup];
 
-  return status;
+  /* Offset 0 again after a retried request */
+  if (offset == 0U)
+  {
+    ReportPlanBegin(&HID_ReportCompiler, &HID_Handle->plan);
+  }
+  if (HID_Handle->Init == USBH_HID_KeybdInit)
+  {
+    ReportPlanFeed(&HID_ReportCompiler, data, length);
+  }
+#else
+  /* Boot protocol only, the descriptor is not used */
+  (void)phost;
+  (void)offset;
+  (void)data;
+  (void)length;
+#endif
 }
 
 /**
@@ -594,7 +904,7 @@ USBH_StatusTypeDef USBH_HID_SetIdle(USBH_HandleTypeDef *phost,
   phost->Control.setup.b.bRequest = USB_HID_SET_IDLE;
   phost->Control.setup.b.wValue.w = (uint16_t)(((uint32_t)duration << 8U) | (uint32_t)reportId);
 
-  phost->Control.setup.b.wIndex.w = 0U;
+  phost->Control.setup.b.wIndex.w = HID_INTERFACE_NUMBER(phost);
   phost->Control.setup.b.wLength.w = 0U;
 
   return USBH_CtlReq(phost, NULL, 0U);
@@ -625,7 +935,7 @@ USBH_StatusTypeDef USBH_HID_SetReport(USBH_HandleTypeDef *phost,
   phost->Control.setup.b.bRequest = USB_HID_SET_REPORT;
   phost->Control.setup.b.wValue.w = (uint16_t)(((uint32_t)reportType << 8U) | (uint32_t)reportId);
 
-  phost->Control.setup.b.wIndex.w = 0U;
+  phost->Control.setup.b.wIndex.w = HID_INTERFACE_NUMBER(phost);
   phost->Control.setup.b.wLength.w = reportLen;
 
   return USBH_CtlReq(phost, reportBuff, (uint16_t)reportLen);
@@ -656,7 +966,7 @@ USBH_StatusTypeDef USBH_HID_GetReport(USBH_HandleTypeDef *phost,
   phost->Control.setup.b.bRequest = USB_HID_GET_REPORT;
   phost->Control.setup.b.wValue.w = (uint16_t)(((uint32_t)reportType << 8U) | (uint32_t)reportId);
 
-  phost->Control.setup.b.wIndex.w = 0U;
+  phost->Control.setup.b.wIndex.w = HID_INTERFACE_NUMBER(phost);
   phost->Control.setup.b.wLength.w = reportLen;
 
   return USBH_CtlReq(phost, reportBuff, (uint16_t)reportLen);
@@ -685,7 +995,7 @@ USBH_StatusTypeDef USBH_HID_SetProtocol(USBH_HandleTypeDef *phost,
     phost->Control.setup.b.wValue.w = 1U;
   }
 
-  phost->Control.setup.b.wIndex.w = 0U;
+  phost->Control.setup.b.wIndex.w = HID_INTERFACE_NUMBER(phost);
   phost->Control.setup.b.wLength.w = 0U;
 
   return USBH_CtlReq(phost, NULL, 0U);
@@ -696,37 +1006,21 @@ USBH_StatusTypeDef USBH_HID_SetProtocol(USBH_HandleTypeDef *phost,
   * @brief  USBH_ParseHIDDesc
   *         This function Parse the HID descriptor
   * @param  desc: HID Descriptor
-  * @param  buf: Buffer where the source descriptor is available
+  * @param  buf: Class-specific descriptor of the interface, kept by the
+  *         configuration descriptor parser
   * @retval None
   */
 static void  USBH_HID_ParseHIDDesc(HID_DescTypeDef *desc, uint8_t *buf)
 {
-  USBH_DescHeader_t *pdesc = (USBH_DescHeader_t *)buf;
-  uint16_t CfgDescLen;
-  uint16_t ptr;
-
-  CfgDescLen = LE16(buf + 2U);
-
-  if (CfgDescLen > USB_CONFIGURATION_DESC_SIZE)
+  if (buf[1] == USB_DESC_TYPE_HID)
   {
-    ptr = USB_LEN_CFG_DESC;
-
-    while (ptr < CfgDescLen)
-    {
-      pdesc = USBH_GetNextDesc((uint8_t *)pdesc, &ptr);
-
-      if (pdesc->bDescriptorType == USB_DESC_TYPE_HID)
-      {
-        desc->bLength = *(uint8_t *)((uint8_t *)pdesc + 0U);
-        desc->bDescriptorType = *(uint8_t *)((uint8_t *)pdesc + 1U);
-        desc->bcdHID = LE16((uint8_t *)pdesc + 2U);
-        desc->bCountryCode = *(uint8_t *)((uint8_t *)pdesc + 4U);
-        desc->bNumDescriptors = *(uint8_t *)((uint8_t *)pdesc + 5U);
-        desc->bReportDescriptorType = *(uint8_t *)((uint8_t *)pdesc + 6U);
-        desc->wItemLength = LE16((uint8_t *)pdesc + 7U);
-        break;
-      }
-    }
+    desc->bLength = *(uint8_t *)(buf + 0U);
+    desc->bDescriptorType = *(uint8_t *)(buf + 1U);
+    desc->bcdHID = LE16(buf + 2U);
+    desc->bCountryCode = *(uint8_t *)(buf + 4U);
+    desc->bNumDescriptors = *(uint8_t *)(buf + 5U);
+    desc->bReportDescriptorType = *(uint8_t *)(buf + 6U);
+    desc->wItemLength = LE16(buf + 7U);
   }
 }
 
@@ -768,7 +1062,7 @@ HID_TypeTypeDef USBH_HID_GetDeviceType(USBH_HandleTypeDef *phost)
   */
 uint8_t USBH_HID_GetPollInterval(USBH_HandleTypeDef *phost)
 {
-  HID_HandleTypeDef *HID_Handle = (HID_HandleTypeDef *) phost->pActiveClass->pData;
+  HID_HandleTypeDef *HID_Handle = &((HID_DeviceTypeDef *) phost->pActiveClass->pData)->itf[0];
 
   if ((phost->gState == HOST_CLASS_REQUEST) ||
       (phost->gState == HOST_INPUT) ||
@@ -783,6 +1077,27 @@ uint8_t USBH_HID_GetPollInterval(USBH_HandleTypeDef *phost)
     return 0U;
   }
 }
+
+/**
+  * @brief  USBH_HID_GetReportInterval
+  *         Return the measured time between the last two interrupt IN requests
+  * @param  phost: Host handle
+  * @retval interval (ms), 0 if not polling
+  */
+uint16_t USBH_HID_GetReportInterval(USBH_HandleTypeDef *phost)
+{
+  HID_HandleTypeDef *HID_Handle = &((HID_DeviceTypeDef *) phost->pActiveClass->pData)->itf[0];
+
+  if (phost->gState == HOST_CLASS)
+  {
+    return HID_Handle->interval;
+  }
+  else
+  {
+    return 0U;
+  }
+}
+
 /**
   * @brief  USBH_HID_FifoInit
   *         Initialize FIFO.
@@ -889,6 +1204,109 @@ uint16_t USBH_HID_FifoWrite(FIFO_TypeDef *f, void *buf, uint16_t  nbytes)
   return nbytes;
 }
 
+/**
+  * @brief  USBH_HID_RingInit
+  *         Initialize the report ring.
+  * @param  r: Ring address
+  * @retval none
+  */
+void USBH_HID_RingInit(HID_RingTypeDef *r)
+{
+  (void)USBH_memset(r, 0, sizeof(*r));
+}
+
+/**
+  * @brief  USBH_HID_RingWriteSlot
+  *         Return the slot for the next report.
+  * @param  r: Ring address
+  * @retval slot, NULL if the ring is full and the policy is HID_RING_KEEP_ALL
+  */
+uint8_t *USBH_HID_RingWriteSlot(HID_RingTypeDef *r)
+{
+  const uint32_t head = r->head;
+
+#if (HID_RING_POLICY == HID_RING_KEEP_ALL)
+  if ((head - r->tail) >= HID_RING_SIZE)
+  {
+    return NULL;
+  }
+#endif
+
+  return (uint8_t *)(void *)r->report[head % HID_RING_SIZE];
+}
+
+/**
+  * @brief  USBH_HID_RingCommit
+  *         Publish the report received into the write slot.
+  * @param  r: Ring address
+  * @param  size: bytes received, the transfer size of the host channel
+  * @retval none
+  */
+void USBH_HID_RingCommit(HID_RingTypeDef *r, uint16_t size)
+{
+  r->size[r->head % HID_RING_SIZE] = size;
+
+  /* The report must be visible before the index */
+  __DMB();
+  r->head = r->head + 1U;
+}
+
+/**
+  * @brief  USBH_HID_RingRead
+  *         Copy a report out of the ring according to HID_RING_POLICY.
+  * @param  r: Ring address
+  * @param  buf: word aligned read buffer
+  * @param  nbytes: buffer size, up to HID_RING_REPORT_SIZE
+  * @retval bytes received with the report, up to nbytes, 0 if there is no new report
+  */
+uint16_t USBH_HID_RingRead(HID_RingTypeDef *r, uint32_t *buf, uint16_t nbytes)
+{
+  const uint32_t *src;
+  uint32_t index;
+  uint32_t words;
+  uint32_t i;
+  uint16_t size;
+
+  if (r->head == r->tail)
+  {
+    return 0U;
+  }
+
+#if (HID_RING_POLICY == HID_RING_KEEP_ALL)
+  /* The producer does not touch slots that were not read */
+  index = r->tail;
+  __DMB();
+  size = MIN(r->size[index % HID_RING_SIZE], nbytes);
+  words = ((uint32_t)size + sizeof(uint32_t) - 1U) / sizeof(uint32_t);
+  src = r->report[index % HID_RING_SIZE];
+  for (i = 0U; i < words; i++)
+  {
+    buf[i] = src[i];
+  }
+  __DMB();
+#else
+  /* The producer never waits, take the newest report and check that it was
+     not overwritten while copying. The slot at head may be receiving now. */
+  do
+  {
+    index = r->head - 1U;
+    __DMB();
+    size = MIN(r->size[index % HID_RING_SIZE], nbytes);
+    words = ((uint32_t)size + sizeof(uint32_t) - 1U) / sizeof(uint32_t);
+    src = r->report[index % HID_RING_SIZE];
+    for (i = 0U; i < words; i++)
+    {
+      buf[i] = src[i];
+    }
+    __DMB();
+  } while ((r->head - index) >= HID_RING_SIZE);
+  r->skipped += index - r->tail;
+#endif
+
+  r->tail = index + 1U;
+  return size;
+}
+
 /**
   * @brief  The function is a callback about HID Data events
   *  @param  phost: Selected device
@@ -899,6 +1317,21 @@ __weak void USBH_HID_EventCallback(USBH_HandleTypeDef *phost)
   /* Prevent unused argument(s) compilation warning */
   UNUSED(phost);
 }
+
+/**
+  * @brief  The function is called on every SOF, from the USB interrupt
+  * @param  phost: Selected device
+  * @param  due: an interface is polled on this SOF by its interval
+  * @retval 1 to poll all interfaces on this SOF, 0 to keep the interval
+  */
+__weak uint8_t USBH_HID_PollCallback(USBH_HandleTypeDef *phost, uint8_t due)
+{
+  /* Prevent unused argument(s) compilation warning */
+  UNUSED(phost);
+  UNUSED(due);
+
+  return 0U;
+}
 /**
   * @}
   */
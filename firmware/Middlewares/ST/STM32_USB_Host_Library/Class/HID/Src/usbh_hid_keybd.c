@@ -27,6 +27,7 @@
 EndBSPDependencies */
 
 /* Includes ------------------------------------------------------------------*/
+#include "usbh_hid.h"
 #include "usbh_hid_keybd.h"
 #include "usbh_hid_parser.h"
 
@@ -94,8 +95,8 @@ static USBH_StatusTypeDef USBH_HID_KeybdDecode(USBH_HandleTypeDef *phost);
   */
 
 HID_KEYBD_Info_TypeDef     keybd_info;
-uint32_t                   keybd_rx_report_buf[2];
-uint32_t                   keybd_report_data[2];
+HID_KEYBD_BootTypeDef      keybd_boot;
+uint32_t                   keybd_report_data[HID_RING_REPORT_SIZE / sizeof(uint32_t)];
 
 static const HID_Report_ItemTypedef imp_0_lctrl =
 {
@@ -328,7 +329,7 @@ static  const  uint8_t  HID_KEYBRD_Codes[] =
 USBH_StatusTypeDef USBH_HID_KeybdInit(USBH_HandleTypeDef *phost)
 {
   uint32_t x;
-  HID_HandleTypeDef *HID_Handle = (HID_HandleTypeDef *) phost->pActiveClass->pData;
+  HID_HandleTypeDef *HID_Handle = &((HID_DeviceTypeDef *) phost->pActiveClass->pData)->itf[0];
 
   keybd_info.lctrl = 0U;
   keybd_info.lshift = 0U;
@@ -343,17 +344,32 @@ USBH_StatusTypeDef USBH_HID_KeybdInit(USBH_HandleTypeDef *phost)
   for (x = 0U; x < (sizeof(keybd_report_data) / sizeof(uint32_t)); x++)
   {
     keybd_report_data[x] = 0U;
-    keybd_rx_report_buf[x] = 0U;
   }
 
+  USBH_HID_KeybdInitInterface(HID_Handle);
+
+  return USBH_OK;
+}
+
+/**
+  * @brief  USBH_HID_KeybdInitInterface
+  *         The function inits the report ring of a keyboard interface.
+  * @param  HID_Handle: HID handle of the interface
+  * @retval none
+  */
+void USBH_HID_KeybdInitInterface(HID_HandleTypeDef *HID_Handle)
+{
+  /* Boot reports are 8 bytes, report protocol reports up to the ring slot */
+  if ((HID_Handle->plan_valid == 0U) && (HID_Handle->length > KEYBD_BOOT_REPORT_SIZE))
+  {
+    HID_Handle->length = KEYBD_BOOT_REPORT_SIZE;
+  }
   if (HID_Handle->length > (sizeof(keybd_report_data)))
   {
     HID_Handle->length = (uint16_t)(sizeof(keybd_report_data));
   }
-  HID_Handle->pData = (uint8_t *)(void *)keybd_rx_report_buf;
-  USBH_HID_FifoInit(&HID_Handle->fifo, phost->device.Data, (uint16_t)(HID_QUEUE_SIZE * sizeof(keybd_report_data)));
-
-  return USBH_OK;
+  USBH_HID_RingInit(&HID_Handle->ring);
+  HID_Handle->pData = USBH_HID_RingWriteSlot(&HID_Handle->ring);
 }
 
 /**
@@ -374,6 +390,143 @@ HID_KEYBD_Info_TypeDef *USBH_HID_GetKeybdInfo(USBH_HandleTypeDef *phost)
   }
 }
 
+/**
+  * @brief  USBH_HID_GetKeybdBoot
+  *         The function decodes the next report of every keyboard interface
+  *         and returns the keys of all of them.
+  * @param  phost: Host handle
+  * @retval merged keys, NULL if there is no new report
+  */
+const HID_KEYBD_BootTypeDef *USBH_HID_GetKeybdBoot(USBH_HandleTypeDef *phost)
+{
+  HID_DeviceTypeDef *HID_Device = (HID_DeviceTypeDef *) phost->pActiveClass->pData;
+  HID_HandleTypeDef *HID_Handle;
+  uint16_t size;
+  uint8_t fresh = 0U;
+  uint8_t ix;
+
+  for (ix = 0U; ix < HID_Device->count; ix++)
+  {
+    HID_Handle = &HID_Device->itf[ix];
+    if ((HID_Handle->InPipe == 0U) || (HID_Handle->Init != USBH_HID_KeybdInit) || (HID_Handle->length == 0U))
+    {
+      continue;
+    }
+    /* Only the bytes received, a short report leaves older bytes in the slot */
+    size = USBH_HID_RingRead(&HID_Handle->ring, keybd_report_data, HID_Handle->length);
+    if ((size != 0U) &&
+        (USBH_HID_KeybdDecodeReport(HID_Handle, (const uint8_t *)(void *)keybd_report_data, size,
+                                    &HID_Handle->keys) == USBH_OK))
+    {
+      fresh = 1U;
+    }
+  }
+
+  return (fresh != 0U) ? USBH_HID_KeybdMerge(HID_Device) : NULL;
+}
+
+/**
+  * @brief  USBH_HID_KeybdMerge
+  *         The function merges the last keys of all keyboard interfaces.
+  *         A single interface costs nothing.
+  * @param  HID_Device: HID interfaces of the device
+  * @retval keys pressed on any interface
+  */
+const HID_KEYBD_BootTypeDef *USBH_HID_KeybdMerge(const HID_DeviceTypeDef *HID_Device)
+{
+  const HID_HandleTypeDef *HID_Handle;
+  uint32_t i;
+  uint8_t ix;
+
+  if (HID_Device->count == 1U)
+  {
+    return &HID_Device->itf[0].keys;
+  }
+
+  keybd_boot = HID_Device->itf[0].keys;
+  for (ix = 1U; ix < HID_Device->count; ix++)
+  {
+    HID_Handle = &HID_Device->itf[ix];
+    if ((HID_Handle->InPipe == 0U) || (HID_Handle->Init != USBH_HID_KeybdInit))
+    {
+      continue;
+    }
+    keybd_boot.modifiers |= HID_Handle->keys.modifiers;
+    keybd_boot.joystick |= HID_Handle->keys.joystick;
+    for (i = 0U; i < (sizeof(keybd_boot.keys) / sizeof(keybd_boot.keys[0])); i++)
+    {
+      keybd_boot.keys[i] |= HID_Handle->keys.keys[i];
+    }
+  }
+  return &keybd_boot;
+}
+
+/**
+  * @brief  USBH_HID_KeybdDecodeReport
+  *         Decode a keyboard report with the compiled report plan in report
+  *         protocol or as a boot report.
+  * @param  HID_Handle: HID handle
+  * @param  report: report data
+  * @param  length: bytes received
+  * @param  boot: decoded report
+  * @retval USBH_OK, USBH_FAIL if the report carries no keys (another report ID)
+  *         or is too short
+  */
+USBH_StatusTypeDef USBH_HID_KeybdDecodeReport(const HID_HandleTypeDef *HID_Handle, const uint8_t *report,
+                                              uint16_t length, HID_KEYBD_BootTypeDef *boot)
+{
+  if (HID_Handle->plan_valid != 0U)
+  {
+    return ReportPlanDecode(&HID_Handle->plan, report, length, &boot->modifiers, boot->keys,
+                            &boot->joystick) ? USBH_OK : USBH_FAIL;
+  }
+
+  /* Modifiers, reserved and at least one key code */
+  if (length < 3U)
+  {
+    return USBH_FAIL;
+  }
+
+  USBH_HID_KeybdBootDecode(report, length, boot);
+  return USBH_OK;
+}
+
+/**
+  * @brief  USBH_HID_KeybdBootDecode
+  *         Decode a boot keyboard report (modifiers, reserved, 6 key codes)
+  *         without the generic item parser.
+  * @param  report: report data
+  * @param  length: report length
+  * @param  boot: decoded report
+  * @retval none
+  */
+void USBH_HID_KeybdBootDecode(const uint8_t *report, uint16_t length, HID_KEYBD_BootTypeDef *boot)
+{
+  uint32_t i;
+
+  for (i = 0U; i < (sizeof(boot->keys) / sizeof(boot->keys[0])); i++)
+  {
+    boot->keys[i] = 0U;
+  }
+
+  if (length > KEYBD_BOOT_REPORT_SIZE)
+  {
+    length = KEYBD_BOOT_REPORT_SIZE;
+  }
+
+  boot->modifiers = (length > 0U) ? report[0] : 0U;
+  boot->joystick = 0U;
+
+  for (i = 2U; i < length; i++)
+  {
+    const uint8_t key = report[i];
+    if (key >= KEY_A)
+    {
+      boot->keys[key >> 5] |= 1UL << (key & 31U);
+    }
+  }
+}
+
 /**
   * @brief  USBH_HID_KeybdDecode
   *         The function decode keyboard data.
@@ -384,13 +537,13 @@ static USBH_StatusTypeDef USBH_HID_KeybdDecode(USBH_HandleTypeDef *phost)
 {
   uint8_t x;
 
-  HID_HandleTypeDef *HID_Handle = (HID_HandleTypeDef *) phost->pActiveClass->pData;
+  HID_HandleTypeDef *HID_Handle = &((HID_DeviceTypeDef *) phost->pActiveClass->pData)->itf[0];
   if (HID_Handle->length == 0U)
   {
     return USBH_FAIL;
   }
-  /*Fill report */
-  if (USBH_HID_FifoRead(&HID_Handle->fifo, &keybd_report_data, HID_Handle->length) ==  HID_Handle->length)
+  /*Fill report, the items are those of a whole boot report */
+  if (USBH_HID_RingRead(&HID_Handle->ring, keybd_report_data, HID_Handle->length) >= KEYBD_BOOT_REPORT_SIZE)
   {
     keybd_info.lctrl = (uint8_t)HID_ReadItem((HID_Report_ItemTypedef *) &imp_0_lctrl, 0U);
     keybd_info.lshift = (uint8_t)HID_ReadItem((HID_Report_ItemTypedef *) &imp_0_lshift, 0U);
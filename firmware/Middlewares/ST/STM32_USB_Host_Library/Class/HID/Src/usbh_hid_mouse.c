@@ -84,7 +84,6 @@ static USBH_StatusTypeDef USBH_HID_MouseDecode(USBH_HandleTypeDef *phost);
   */
 HID_MOUSE_Info_TypeDef    mouse_info;
 uint32_t                  mouse_report_data[2];
-uint32_t                  mouse_rx_report_buf[2];
 
 /* Structures defining how to access items in a HID mouse report */
 /* Access button 1 state. */
@@ -181,7 +180,7 @@ static const HID_Report_ItemTypedef prop_y =
 USBH_StatusTypeDef USBH_HID_MouseInit(USBH_HandleTypeDef *phost)
 {
   uint32_t i;
-  HID_HandleTypeDef *HID_Handle = (HID_HandleTypeDef *) phost->pActiveClass->pData;
+  HID_HandleTypeDef *HID_Handle = &((HID_DeviceTypeDef *) phost->pActiveClass->pData)->itf[0];
 
   mouse_info.x = 0U;
   mouse_info.y = 0U;
@@ -192,15 +191,14 @@ USBH_StatusTypeDef USBH_HID_MouseInit(USBH_HandleTypeDef *phost)
   for (i = 0U; i < (sizeof(mouse_report_data) / sizeof(uint32_t)); i++)
   {
     mouse_report_data[i] = 0U;
-    mouse_rx_report_buf[i] = 0U;
   }
 
   if (HID_Handle->length > sizeof(mouse_report_data))
   {
     HID_Handle->length = (uint16_t)sizeof(mouse_report_data);
   }
-  HID_Handle->pData = (uint8_t *)(void *)mouse_rx_report_buf;
-  USBH_HID_FifoInit(&HID_Handle->fifo, phost->device.Data, (uint16_t)(HID_QUEUE_SIZE * sizeof(mouse_report_data)));
+  USBH_HID_RingInit(&HID_Handle->ring);
+  HID_Handle->pData = USBH_HID_RingWriteSlot(&HID_Handle->ring);
 
   return USBH_OK;
 }
@@ -231,14 +229,14 @@ HID_MOUSE_Info_TypeDef *USBH_HID_GetMouseInfo(USBH_HandleTypeDef *phost)
   */
 static USBH_StatusTypeDef USBH_HID_MouseDecode(USBH_HandleTypeDef *phost)
 {
-  HID_HandleTypeDef *HID_Handle = (HID_HandleTypeDef *) phost->pActiveClass->pData;
+  HID_HandleTypeDef *HID_Handle = &((HID_DeviceTypeDef *) phost->pActiveClass->pData)->itf[0];
 
   if (HID_Handle->length == 0U)
   {
     return USBH_FAIL;
   }
-  /*Fill report */
-  if (USBH_HID_FifoRead(&HID_Handle->fifo, &mouse_report_data, HID_Handle->length) ==  HID_Handle->length)
+  /*Fill report, buttons, X and Y are the first 3 bytes */
+  if (USBH_HID_RingRead(&HID_Handle->ring, mouse_report_data, HID_Handle->length) >= 3U)
   {
     /*Decode report */
     mouse_info.x = (uint8_t)HID_ReadItem((HID_Report_ItemTypedef *) &prop_x, 0U);
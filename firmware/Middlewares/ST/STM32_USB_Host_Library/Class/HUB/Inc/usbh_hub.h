@@ -0,0 +1,181 @@
+/**
+  ******************************************************************************
+  * @file    usbh_hub.h
+  * @brief   This file contains all the prototypes for the usbh_hub.c
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive  ----------------------------------------------*/
+#ifndef __USBH_HUB_H
+#define __USBH_HUB_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "usbh_core.h"
+
+/** @addtogroup USBH_LIB
+  * @{
+  */
+
+/** @addtogroup USBH_CLASS
+  * @{
+  */
+
+/** @addtogroup USBH_HUB_CLASS
+  * @{
+  */
+
+/** @defgroup USBH_HUB_CORE
+  * @brief This file is the Header file for usbh_hub.c
+  * @{
+  */
+
+
+/** @defgroup USBH_HUB_CORE_Exported_Types
+  * @{
+  */
+
+#ifndef USBH_HUB_MAX_PORTS
+#define USBH_HUB_MAX_PORTS                          4U
+#endif
+
+/* States for HUB State Machine */
+typedef enum
+{
+  HUB_IDLE = 0,
+  HUB_PORT_STATUS,
+  HUB_PORT_CLEAR,
+  HUB_PORT_RESET,
+}
+HUB_StateTypeDef;
+
+/* States of the status change endpoint */
+typedef enum
+{
+  HUB_GET_DATA = 0,
+  HUB_POLL,
+}
+HUB_PollStateTypeDef;
+
+typedef enum
+{
+  HUB_REQ_GET_DESC = 0,
+  HUB_REQ_POWER_ON,
+  HUB_REQ_POWER_GOOD,
+  HUB_REQ_IDLE,
+}
+HUB_CtlStateTypeDef;
+
+/* Structure for HUB process */
+typedef struct _HUB_Process
+{
+  HUB_StateTypeDef     state;
+  HUB_CtlStateTypeDef  ctl_state;
+  HUB_PollStateTypeDef poll_state;
+  uint8_t              InPipe;
+  uint8_t              InEp;
+  uint8_t              length;
+  uint8_t              poll;
+  uint32_t             timer;
+  uint8_t              DataReady;
+  uint8_t              NbrPorts;
+  uint16_t             PwrOn2PwrGood;            /* ms */
+  uint8_t              port;                     /* Port of the request in progress */
+  uint8_t              feature;                  /* Change being acknowledged */
+  uint32_t             changes;                  /* Ports with a change to read, bit N - port N */
+  uint8_t              data[8];                  /* Status change bitmap */
+  uint8_t              status[4];                /* wPortStatus, wPortChange */
+  uint32_t             port_tick[USBH_HUB_MAX_PORTS]; /* Connection or last reset */
+}
+HUB_HandleTypeDef;
+
+/**
+  * @}
+  */
+
+/** @defgroup USBH_HUB_CORE_Exported_Defines
+  * @{
+  */
+
+#define USB_HUB_CLASS                                   0x09U
+#define USB_DESC_TYPE_HUB                               0x29U
+#define USB_DESC_HUB                                    ((USB_DESC_TYPE_HUB << 8) & 0xFF00U)
+
+/* Port features */
+#define HUB_FEAT_PORT_RESET                             4U
+#define HUB_FEAT_PORT_POWER                             8U
+#define HUB_FEAT_C_PORT_CONNECTION                      16U
+#define HUB_FEAT_C_PORT_ENABLE                          17U
+#define HUB_FEAT_C_PORT_SUSPEND                         18U
+#define HUB_FEAT_C_PORT_OVER_CURRENT                    19U
+#define HUB_FEAT_C_PORT_RESET                           20U
+
+/* wPortStatus */
+#define HUB_PORT_CONNECTION                             0x0001U
+#define HUB_PORT_ENABLE                                 0x0002U
+#define HUB_PORT_LOW_SPEED                              0x0200U
+
+/* wPortChange */
+#define HUB_C_PORT_CONNECTION                           0x0001U
+#define HUB_C_PORT_ENABLE                               0x0002U
+#define HUB_C_PORT_SUSPEND                              0x0004U
+#define HUB_C_PORT_OVER_CURRENT                         0x0008U
+#define HUB_C_PORT_RESET                                0x0010U
+
+/* Debounce after connection, the port is reset again if it does not come up */
+#define HUB_RESET_DELAY                                 100U
+
+/**
+  * @}
+  */
+
+/** @defgroup USBH_HUB_CORE_Exported_Macros
+  * @{
+  */
+/**
+  * @}
+  */
+
+/** @defgroup USBH_HUB_CORE_Exported_Variables
+  * @{
+  */
+extern USBH_ClassTypeDef  HUB_Class;
+#define USBH_HUB_CLASS    &HUB_Class
+/**
+  * @}
+  */
+
+/** @defgroup USBH_HUB_CORE_Exported_FunctionsPrototype
+  * @{
+  */
+
+USBH_HandleTypeDef *USBH_HUB_GetDevice(USBH_HandleTypeDef *phost, uint8_t port);
+
+/**
+  * @}
+  */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __USBH_HUB_H */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
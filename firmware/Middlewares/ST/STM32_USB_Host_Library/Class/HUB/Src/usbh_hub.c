@@ -0,0 +1,732 @@
+/**
+  ******************************************************************************
+  * @file    usbh_hub.c
+  * @brief   This file is the HUB Layer Handlers for USB Host HUB class.
+  *
+  * @verbatim
+  *
+  *          ===================================================================
+  *                                HUB Class  Description
+  *          ===================================================================
+  *           This module manages a hub on the root port following chapter 11
+  *           of the "Universal Serial Bus Specification Revision 2.0".
+  *           Every port of the hub gets its own Host Handle which enumerates
+  *           and runs the device behind it with the other registered classes.
+  *           The devices share the host channels of the root port, the control
+  *           pipes are taken by one device at a time. Hubs behind a hub are
+  *           not supported.
+  *
+  *  @endverbatim
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "usbh_hub.h"
+
+
+/** @addtogroup USBH_LIB
+  * @{
+  */
+
+/** @addtogroup USBH_CLASS
+  * @{
+  */
+
+/** @addtogroup USBH_HUB_CLASS
+  * @{
+  */
+
+/** @defgroup USBH_HUB_CORE
+  * @brief    This file includes HUB Layer Handlers for USB Host HUB class.
+  * @{
+  */
+
+/** @defgroup USBH_HUB_CORE_Private_Variables
+  * @{
+  */
+
+/* Devices behind the hub, one per port */
+static USBH_HandleTypeDef HUB_Devices[USBH_HUB_MAX_PORTS];
+
+/* The devices have their own copies of the classes, pData of a class is per device */
+static USBH_ClassTypeDef HUB_DeviceClasses[USBH_HUB_MAX_PORTS][USBH_MAX_NUM_SUPPORTED_CLASS];
+
+/**
+  * @}
+  */
+
+
+/** @defgroup USBH_HUB_CORE_Private_FunctionPrototypes
+  * @{
+  */
+
+static USBH_StatusTypeDef USBH_HUB_InterfaceInit(USBH_HandleTypeDef *phost);
+static USBH_StatusTypeDef USBH_HUB_InterfaceDeInit(USBH_HandleTypeDef *phost);
+static USBH_StatusTypeDef USBH_HUB_ClassRequest(USBH_HandleTypeDef *phost);
+static USBH_StatusTypeDef USBH_HUB_Process(USBH_HandleTypeDef *phost);
+static USBH_StatusTypeDef USBH_HUB_SOFProcess(USBH_HandleTypeDef *phost);
+static void USBH_HUB_PollProcess(USBH_HandleTypeDef *phost, HUB_HandleTypeDef *HUB_Handle);
+static void USBH_HUB_PortProcess(USBH_HandleTypeDef *phost, HUB_HandleTypeDef *HUB_Handle);
+static uint8_t USBH_HUB_PortChange(USBH_HandleTypeDef *phost, HUB_HandleTypeDef *HUB_Handle);
+static uint8_t USBH_HUB_PortToReset(USBH_HandleTypeDef *phost, HUB_HandleTypeDef *HUB_Handle);
+static USBH_StatusTypeDef USBH_HUB_GetHubDescriptor(USBH_HandleTypeDef *phost, uint16_t length);
+static USBH_StatusTypeDef USBH_HUB_GetPortStatus(USBH_HandleTypeDef *phost, uint8_t port, uint8_t *buff);
+static USBH_StatusTypeDef USBH_HUB_SetPortFeature(USBH_HandleTypeDef *phost, uint8_t port, uint8_t feature);
+static USBH_StatusTypeDef USBH_HUB_ClearPortFeature(USBH_HandleTypeDef *phost, uint8_t port, uint8_t feature);
+
+USBH_ClassTypeDef  HUB_Class =
+{
+  "HUB",
+  USB_HUB_CLASS,
+  USBH_HUB_InterfaceInit,
+  USBH_HUB_InterfaceDeInit,
+  USBH_HUB_ClassRequest,
+  USBH_HUB_Process,
+  USBH_HUB_SOFProcess,
+  NULL,
+};
+/**
+  * @}
+  */
+
+
+/** @defgroup USBH_HUB_CORE_Private_Functions
+  * @{
+  */
+
+
+/**
+  * @brief  USBH_HUB_InterfaceInit
+  *         The function init the HUB class.
+  * @param  phost: Host handle
+  * @retval USBH Status
+  */
+static USBH_StatusTypeDef USBH_HUB_InterfaceInit(USBH_HandleTypeDef *phost)
+{
+  HUB_HandleTypeDef *HUB_Handle;
+  USBH_EpDescTypeDef *ep;
+  USBH_HandleTypeDef *child;
+  uint8_t interface;
+  uint8_t pipe;
+  uint8_t port;
+  uint32_t idx;
+  uint32_t n;
+
+  interface = USBH_FindInterface(phost, phost->pActiveClass->ClassCode, 0xFFU, 0xFFU);
+
+  if ((interface == 0xFFU) || (interface >= USBH_MAX_NUM_INTERFACES)) /* No Valid Interface */
+  {
+    USBH_DbgLog("Cannot Find the interface for %s class.", phost->pActiveClass->Name);
+    return USBH_FAIL;
+  }
+
+  if (phost->pParent != NULL)
+  {
+    USBH_UsrLog("Hub behind a hub is not supported.");
+    return USBH_FAIL;
+  }
+
+  if (USBH_SelectInterface(phost, interface) != USBH_OK)
+  {
+    return USBH_FAIL;
+  }
+
+  ep = &phost->device.CfgDesc.Itf_Desc[interface].Ep_Desc[0];
+  pipe = USBH_AllocPipe(phost, ep->bEndpointAddress);
+  if (pipe == 0xFFU)
+  {
+    USBH_DbgLog("No free host channel for the HUB");
+    return USBH_FAIL;
+  }
+
+  phost->pActiveClass->pData = (HUB_HandleTypeDef *)USBH_malloc(sizeof(HUB_HandleTypeDef));
+  HUB_Handle = (HUB_HandleTypeDef *) phost->pActiveClass->pData;
+
+  if (HUB_Handle == NULL)
+  {
+    USBH_DbgLog("Cannot allocate memory for HUB Handle");
+    (void)USBH_FreePipe(phost, pipe);
+    return USBH_FAIL;
+  }
+
+  /* Initialize hub handler */
+  (void)USBH_memset(HUB_Handle, 0, sizeof(HUB_HandleTypeDef));
+
+  HUB_Handle->state      = HUB_IDLE;
+  HUB_Handle->ctl_state  = HUB_REQ_GET_DESC;
+  HUB_Handle->poll_state = HUB_GET_DATA;
+  HUB_Handle->InPipe     = pipe;
+  HUB_Handle->InEp       = ep->bEndpointAddress;
+  HUB_Handle->length     = (uint8_t)((ep->wMaxPacketSize < sizeof(HUB_Handle->data)) ?
+                                     ep->wMaxPacketSize : sizeof(HUB_Handle->data));
+  HUB_Handle->poll       = (ep->bInterval != 0U) ? ep->bInterval : 1U;
+
+  (void)USBH_OpenPipe(phost, HUB_Handle->InPipe, HUB_Handle->InEp, phost->device.address,
+                      phost->device.speed, USB_EP_TYPE_INTR, ep->wMaxPacketSize);
+
+  (void)USBH_LL_SetToggle(phost, HUB_Handle->InPipe, 0U);
+
+  /* Every port gets a Host Handle with the registered classes except this one */
+  for (port = 1U; port <= USBH_HUB_MAX_PORTS; port++)
+  {
+    child = &HUB_Devices[port - 1U];
+    (void)USBH_InitHubDevice(child, phost, port);
+
+    n = 0U;
+    for (idx = 0U; idx < phost->ClassNumber; idx++)
+    {
+      if (phost->pClass[idx]->ClassCode != USB_HUB_CLASS)
+      {
+        HUB_DeviceClasses[port - 1U][n] = *phost->pClass[idx];
+        HUB_DeviceClasses[port - 1U][n].pData = NULL;
+        (void)USBH_RegisterClass(child, &HUB_DeviceClasses[port - 1U][n]);
+        n++;
+      }
+    }
+  }
+
+  return USBH_OK;
+}
+
+/**
+  * @brief  USBH_HUB_InterfaceDeInit
+  *         The function DeInit the Pipes used for the HUB class and the
+  *         devices behind the hub.
+  * @param  phost: Host handle
+  * @retval USBH Status
+  */
+static USBH_StatusTypeDef USBH_HUB_InterfaceDeInit(USBH_HandleTypeDef *phost)
+{
+  HUB_HandleTypeDef *HUB_Handle = (HUB_HandleTypeDef *) phost->pActiveClass->pData;
+  USBH_HandleTypeDef *child;
+  uint8_t port;
+
+  if (HUB_Handle == NULL)
+  {
+    return USBH_OK;
+  }
+
+  /* The devices are gone with the hub */
+  for (port = 1U; port <= USBH_HUB_MAX_PORTS; port++)
+  {
+    child = &HUB_Devices[port - 1U];
+    if ((child->device.is_connected != 0U) || (child->gState != HOST_IDLE))
+    {
+      child->device.is_disconnected = 1U;
+      child->device.is_connected = 0U;
+      (void)USBH_Process(child);
+    }
+  }
+
+  (void)USBH_ClosePipe(phost, HUB_Handle->InPipe);
+  (void)USBH_FreePipe(phost, HUB_Handle->InPipe);
+
+  USBH_free(phost->pActiveClass->pData);
+  phost->pActiveClass->pData = NULL;
+
+  return USBH_OK;
+}
+
+/**
+  * @brief  USBH_HUB_ClassRequest
+  *         The function is responsible for handling Standard requests
+  *         for HUB class: reads the hub descriptor and powers the ports.
+  * @param  phost: Host handle
+  * @retval USBH Status
+  */
+static USBH_StatusTypeDef USBH_HUB_ClassRequest(USBH_HandleTypeDef *phost)
+{
+  HUB_HandleTypeDef *HUB_Handle = (HUB_HandleTypeDef *) phost->pActiveClass->pData;
+  USBH_StatusTypeDef status = USBH_BUSY;
+  USBH_StatusTypeDef classReqStatus;
+
+  switch (HUB_Handle->ctl_state)
+  {
+    case HUB_REQ_GET_DESC:
+      /* The descriptor of a hub with up to 7 ports */
+      classReqStatus = USBH_HUB_GetHubDescriptor(phost, 9U);
+      if (classReqStatus == USBH_OK)
+      {
+        USBH_UsrLog("Hub with %d ports found!", phost->device.Data[2]);
+
+        HUB_Handle->NbrPorts = (phost->device.Data[2] < USBH_HUB_MAX_PORTS) ?
+                               phost->device.Data[2] : (uint8_t)USBH_HUB_MAX_PORTS;
+        HUB_Handle->PwrOn2PwrGood = (uint16_t)phost->device.Data[5] * 2U;
+        HUB_Handle->port = 1U;
+        HUB_Handle->ctl_state = HUB_REQ_POWER_ON;
+      }
+      else if (classReqStatus == USBH_NOT_SUPPORTED)
+      {
+        USBH_ErrLog("Control error: HUB: Device Get Hub Descriptor request failed");
+        status = USBH_FAIL;
+      }
+      else
+      {
+        /* .. */
+      }
+      break;
+
+    case HUB_REQ_POWER_ON:
+      if (HUB_Handle->port > HUB_Handle->NbrPorts)
+      {
+        HUB_Handle->timer = phost->Timer;
+        HUB_Handle->ctl_state = HUB_REQ_POWER_GOOD;
+        break;
+      }
+
+      classReqStatus = USBH_HUB_SetPortFeature(phost, HUB_Handle->port, HUB_FEAT_PORT_POWER);
+      if (classReqStatus == USBH_OK)
+      {
+        HUB_Handle->port++;
+      }
+      else if (classReqStatus == USBH_NOT_SUPPORTED)
+      {
+        USBH_ErrLog("Control error: HUB: Device Set Port Power request failed");
+        status = USBH_FAIL;
+      }
+      else
+      {
+        /* .. */
+      }
+      break;
+
+    case HUB_REQ_POWER_GOOD:
+      if ((phost->Timer - HUB_Handle->timer) >= HUB_Handle->PwrOn2PwrGood)
+      {
+        /* The hub reports the devices on its ports with the status change endpoint */
+        HUB_Handle->ctl_state = HUB_REQ_IDLE;
+        phost->pUser(phost, HOST_USER_CLASS_ACTIVE);
+        status = USBH_OK;
+      }
+      break;
+
+    case HUB_REQ_IDLE:
+    default:
+      break;
+  }
+
+  return status;
+}
+
+/**
+  * @brief  USBH_HUB_Process
+  *         The function is for managing state machine for HUB data transfers
+  *         and runs the devices behind the hub.
+  * @param  phost: Host handle
+  * @retval USBH Status
+  */
+static USBH_StatusTypeDef USBH_HUB_Process(USBH_HandleTypeDef *phost)
+{
+  HUB_HandleTypeDef *HUB_Handle = (HUB_HandleTypeDef *) phost->pActiveClass->pData;
+  uint8_t port;
+
+  USBH_HUB_PollProcess(phost, HUB_Handle);
+  USBH_HUB_PortProcess(phost, HUB_Handle);
+
+  for (port = 1U; port <= HUB_Handle->NbrPorts; port++)
+  {
+    (void)USBH_Process(&HUB_Devices[port - 1U]);
+  }
+
+  return USBH_OK;
+}
+
+/**
+  * @brief  USBH_HUB_PollProcess
+  *         Polls the status change endpoint, the changed ports are collected
+  *         for the port state machine.
+  * @param  phost: Host handle
+  * @param  HUB_Handle: HUB handle
+  * @retval None
+  */
+static void USBH_HUB_PollProcess(USBH_HandleTypeDef *phost, HUB_HandleTypeDef *HUB_Handle)
+{
+  uint32_t XferSize;
+  uint32_t idx;
+
+  switch (HUB_Handle->poll_state)
+  {
+    case HUB_GET_DATA:
+      (void)USBH_InterruptReceiveData(phost, HUB_Handle->data, HUB_Handle->length,
+                                      HUB_Handle->InPipe);
+
+      HUB_Handle->poll_state = HUB_POLL;
+      HUB_Handle->timer = phost->Timer;
+      HUB_Handle->DataReady = 0U;
+      break;
+
+    case HUB_POLL:
+      if (USBH_LL_GetURBState(phost, HUB_Handle->InPipe) == USBH_URB_DONE)
+      {
+        XferSize = USBH_LL_GetLastXferSize(phost, HUB_Handle->InPipe);
+
+        if ((HUB_Handle->DataReady == 0U) && (XferSize != 0U))
+        {
+          /* Bit 0 is the hub itself, its changes are not handled */
+          for (idx = 0U; (idx < XferSize) && (idx < sizeof(uint32_t)); idx++)
+          {
+            HUB_Handle->changes |= (uint32_t)HUB_Handle->data[idx] << (idx * 8U);
+          }
+          HUB_Handle->changes &= (2UL << HUB_Handle->NbrPorts) - 2UL;
+          HUB_Handle->DataReady = 1U;
+        }
+      }
+      else
+      {
+        /* IN Endpoint Stalled */
+        if (USBH_LL_GetURBState(phost, HUB_Handle->InPipe) == USBH_URB_STALL)
+        {
+          /* Issue Clear Feature on interrupt IN endpoint */
+          if (USBH_ClrFeature(phost, HUB_Handle->InEp) == USBH_OK)
+          {
+            /* Change state to issue next IN token */
+            HUB_Handle->poll_state = HUB_GET_DATA;
+          }
+        }
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+/**
+  * @brief  USBH_HUB_PortProcess
+  *         Reads and acknowledges the changes of the ports one at a time and
+  *         resets the ports with a new device.
+  * @param  phost: Host handle
+  * @param  HUB_Handle: HUB handle
+  * @retval None
+  */
+static void USBH_HUB_PortProcess(USBH_HandleTypeDef *phost, HUB_HandleTypeDef *HUB_Handle)
+{
+  USBH_StatusTypeDef status;
+  USBH_HandleTypeDef *child;
+  uint8_t port;
+
+  switch (HUB_Handle->state)
+  {
+    case HUB_IDLE:
+      for (port = 1U; port <= HUB_Handle->NbrPorts; port++)
+      {
+        if ((HUB_Handle->changes & (1UL << port)) != 0U)
+        {
+          HUB_Handle->changes &= ~(1UL << port);
+          HUB_Handle->port = port;
+          HUB_Handle->state = HUB_PORT_STATUS;
+          return;
+        }
+      }
+
+      port = USBH_HUB_PortToReset(phost, HUB_Handle);
+      if (port != 0U)
+      {
+        HUB_Handle->port = port;
+        HUB_Handle->state = HUB_PORT_RESET;
+      }
+      break;
+
+    case HUB_PORT_STATUS:
+      status = USBH_HUB_GetPortStatus(phost, HUB_Handle->port, HUB_Handle->status);
+      if (status == USBH_OK)
+      {
+        HUB_Handle->feature = USBH_HUB_PortChange(phost, HUB_Handle);
+        HUB_Handle->state = (HUB_Handle->feature != 0U) ? HUB_PORT_CLEAR : HUB_IDLE;
+      }
+      else if (status != USBH_BUSY)
+      {
+        HUB_Handle->state = HUB_IDLE;
+      }
+      else
+      {
+        /* .. */
+      }
+      break;
+
+    case HUB_PORT_CLEAR:
+      status = USBH_HUB_ClearPortFeature(phost, HUB_Handle->port, HUB_Handle->feature);
+      if (status == USBH_OK)
+      {
+        /* Until every change of the port is acknowledged */
+        HUB_Handle->state = HUB_PORT_STATUS;
+      }
+      else if (status != USBH_BUSY)
+      {
+        HUB_Handle->state = HUB_IDLE;
+      }
+      else
+      {
+        /* .. */
+      }
+      break;
+
+    case HUB_PORT_RESET:
+      status = USBH_HUB_SetPortFeature(phost, HUB_Handle->port, HUB_FEAT_PORT_RESET);
+      if (status == USBH_OK)
+      {
+        /* The core waits for the end of the reset and resets again on timeout */
+        child = &HUB_Devices[HUB_Handle->port - 1U];
+        child->device.address = USBH_DEVICE_ADDRESS_DEFAULT;
+        child->device.PortEnabled = 0U;
+        child->Timeout = 0U;
+        child->gState = HOST_DEV_WAIT_FOR_ATTACHMENT;
+        HUB_Handle->port_tick[HUB_Handle->port - 1U] = phost->Timer;
+        HUB_Handle->state = HUB_IDLE;
+      }
+      else if (status != USBH_BUSY)
+      {
+        HUB_Handle->state = HUB_IDLE;
+      }
+      else
+      {
+        /* .. */
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+/**
+  * @brief  USBH_HUB_PortChange
+  *         Applies the status of the port read by USBH_HUB_GetPortStatus to
+  *         the device behind it.
+  * @param  phost: Host handle
+  * @param  HUB_Handle: HUB handle
+  * @retval Change feature to clear, 0 - no changes left
+  */
+static uint8_t USBH_HUB_PortChange(USBH_HandleTypeDef *phost, HUB_HandleTypeDef *HUB_Handle)
+{
+  USBH_HandleTypeDef *child = &HUB_Devices[HUB_Handle->port - 1U];
+  uint16_t port_status = LE16(&HUB_Handle->status[0]);
+  uint16_t port_change = LE16(&HUB_Handle->status[2]);
+
+  if ((port_change & HUB_C_PORT_CONNECTION) != 0U)
+  {
+    /* The device that was there is gone, even if a new one is plugged in already */
+    if (child->device.is_connected != 0U)
+    {
+      child->device.is_disconnected = 1U;
+    }
+
+    child->device.is_connected = ((port_status & HUB_PORT_CONNECTION) != 0U) ? 1U : 0U;
+    child->device.PortEnabled = 0U;
+    HUB_Handle->port_tick[HUB_Handle->port - 1U] = phost->Timer;
+    USBH_UsrLog("HUB: port %d %s", HUB_Handle->port,
+                (child->device.is_connected != 0U) ? "connected" : "disconnected");
+    return HUB_FEAT_C_PORT_CONNECTION;
+  }
+
+  if ((port_change & HUB_C_PORT_RESET) != 0U)
+  {
+    if (((port_status & HUB_PORT_ENABLE) != 0U) && (child->gState == HOST_DEV_WAIT_FOR_ATTACHMENT))
+    {
+      child->device.speed = ((port_status & HUB_PORT_LOW_SPEED) != 0U) ?
+                            (uint8_t)USBH_SPEED_LOW : (uint8_t)USBH_SPEED_FULL;
+      child->device.PortEnabled = 1U;
+    }
+    return HUB_FEAT_C_PORT_RESET;
+  }
+
+  if ((port_change & HUB_C_PORT_ENABLE) != 0U)
+  {
+    return HUB_FEAT_C_PORT_ENABLE;
+  }
+
+  if ((port_change & HUB_C_PORT_SUSPEND) != 0U)
+  {
+    return HUB_FEAT_C_PORT_SUSPEND;
+  }
+
+  if ((port_change & HUB_C_PORT_OVER_CURRENT) != 0U)
+  {
+    return HUB_FEAT_C_PORT_OVER_CURRENT;
+  }
+
+  return 0U;
+}
+
+/**
+  * @brief  USBH_HUB_PortToReset
+  *         Finds a connected device waiting for the reset of its port. Only
+  *         one device at a time is at the default address.
+  * @param  phost: Host handle
+  * @param  HUB_Handle: HUB handle
+  * @retval Port, 0 - none
+  */
+static uint8_t USBH_HUB_PortToReset(USBH_HandleTypeDef *phost, HUB_HandleTypeDef *HUB_Handle)
+{
+  USBH_HandleTypeDef *child;
+  uint8_t port;
+  uint8_t found = 0U;
+
+  for (port = 1U; port <= HUB_Handle->NbrPorts; port++)
+  {
+    child = &HUB_Devices[port - 1U];
+
+    if ((child->gState == HOST_DEV_WAIT_FOR_ATTACHMENT) || (child->gState == HOST_DEV_ATTACHED) ||
+        ((child->gState == HOST_ENUMERATION) && (child->device.address == USBH_DEVICE_ADDRESS_DEFAULT)))
+    {
+      return 0U;
+    }
+
+    if ((found == 0U) && (child->gState == HOST_IDLE) &&
+        (child->device.is_connected != 0U) && (child->device.is_disconnected == 0U) &&
+        ((phost->Timer - HUB_Handle->port_tick[port - 1U]) >= HUB_RESET_DELAY))
+    {
+      found = port;
+    }
+  }
+
+  return found;
+}
+
+/**
+  * @brief  USBH_HUB_SOFProcess
+  *         The function is for managing the SOF callback, the devices behind
+  *         the hub count the frames as well.
+  * @param  phost: Host handle
+  * @retval USBH Status
+  */
+static USBH_StatusTypeDef USBH_HUB_SOFProcess(USBH_HandleTypeDef *phost)
+{
+  HUB_HandleTypeDef *HUB_Handle = (HUB_HandleTypeDef *) phost->pActiveClass->pData;
+  uint8_t port;
+
+  if ((HUB_Handle->poll_state == HUB_POLL) && ((phost->Timer - HUB_Handle->timer) >= HUB_Handle->poll))
+  {
+    HUB_Handle->poll_state = HUB_GET_DATA;
+  }
+
+  for (port = 1U; port <= HUB_Handle->NbrPorts; port++)
+  {
+    USBH_LL_IncTimer(&HUB_Devices[port - 1U]);
+  }
+
+  return USBH_OK;
+}
+
+/**
+  * @brief  USBH_HUB_GetHubDescriptor
+  *         Issue Get Hub Descriptor command to the device. Once the response
+  *         received, it is in phost->device.Data.
+  * @param  phost: Host handle
+  * @param  length: length of the descriptor
+  * @retval USBH Status
+  */
+static USBH_StatusTypeDef USBH_HUB_GetHubDescriptor(USBH_HandleTypeDef *phost, uint16_t length)
+{
+  phost->Control.setup.b.bmRequestType = USB_D2H | USB_REQ_RECIPIENT_DEVICE | USB_REQ_TYPE_CLASS;
+  phost->Control.setup.b.bRequest = USB_REQ_GET_DESCRIPTOR;
+  phost->Control.setup.b.wValue.w = USB_DESC_HUB;
+  phost->Control.setup.b.wIndex.w = 0U;
+  phost->Control.setup.b.wLength.w = length;
+
+  return USBH_CtlReq(phost, phost->device.Data, length);
+}
+
+/**
+  * @brief  USBH_HUB_GetPortStatus
+  *         Issue Get Port Status command to the hub.
+  * @param  phost: Host handle
+  * @param  port: Port of the hub
+  * @param  buff: Buffer for wPortStatus and wPortChange
+  * @retval USBH Status
+  */
+static USBH_StatusTypeDef USBH_HUB_GetPortStatus(USBH_HandleTypeDef *phost, uint8_t port, uint8_t *buff)
+{
+  phost->Control.setup.b.bmRequestType = USB_D2H | USB_REQ_RECIPIENT_OTHER | USB_REQ_TYPE_CLASS;
+  phost->Control.setup.b.bRequest = USB_REQ_GET_STATUS;
+  phost->Control.setup.b.wValue.w = 0U;
+  phost->Control.setup.b.wIndex.w = port;
+  phost->Control.setup.b.wLength.w = 4U;
+
+  return USBH_CtlReq(phost, buff, 4U);
+}
+
+/**
+  * @brief  USBH_HUB_SetPortFeature
+  *         Issue Set Port Feature command to the hub.
+  * @param  phost: Host handle
+  * @param  port: Port of the hub
+  * @param  feature: Feature selector
+  * @retval USBH Status
+  */
+static USBH_StatusTypeDef USBH_HUB_SetPortFeature(USBH_HandleTypeDef *phost, uint8_t port, uint8_t feature)
+{
+  phost->Control.setup.b.bmRequestType = USB_H2D | USB_REQ_RECIPIENT_OTHER | USB_REQ_TYPE_CLASS;
+  phost->Control.setup.b.bRequest = USB_REQ_SET_FEATURE;
+  phost->Control.setup.b.wValue.w = feature;
+  phost->Control.setup.b.wIndex.w = port;
+  phost->Control.setup.b.wLength.w = 0U;
+
+  return USBH_CtlReq(phost, NULL, 0U);
+}
+
+/**
+  * @brief  USBH_HUB_ClearPortFeature
+  *         Issue Clear Port Feature command to the hub.
+  * @param  phost: Host handle
+  * @param  port: Port of the hub
+  * @param  feature: Feature selector
+  * @retval USBH Status
+  */
+static USBH_StatusTypeDef USBH_HUB_ClearPortFeature(USBH_HandleTypeDef *phost, uint8_t port, uint8_t feature)
+{
+  phost->Control.setup.b.bmRequestType = USB_H2D | USB_REQ_RECIPIENT_OTHER | USB_REQ_TYPE_CLASS;
+  phost->Control.setup.b.bRequest = USB_REQ_CLEAR_FEATURE;
+  phost->Control.setup.b.wValue.w = feature;
+  phost->Control.setup.b.wIndex.w = port;
+  phost->Control.setup.b.wLength.w = 0U;
+
+  return USBH_CtlReq(phost, NULL, 0U);
+}
+
+/**
+  * @brief  USBH_HUB_GetDevice
+  *         Host Handle of the device behind a port of the hub on the root
+  *         port. The device is running when its gState is HOST_CLASS.
+  * @param  phost: Host handle of the root port
+  * @param  port: Port of the hub, 1..
+  * @retval Host handle, NULL if there is no hub or no such port
+  */
+USBH_HandleTypeDef *USBH_HUB_GetDevice(USBH_HandleTypeDef *phost, uint8_t port)
+{
+  HUB_HandleTypeDef *HUB_Handle;
+
+  if ((phost->gState != HOST_CLASS) || (phost->pActiveClass != USBH_HUB_CLASS))
+  {
+    return NULL;
+  }
+
+  HUB_Handle = (HUB_HandleTypeDef *) phost->pActiveClass->pData;
+  if ((port == 0U) || (port > HUB_Handle->NbrPorts))
+  {
+    return NULL;
+  }
+
+  return &HUB_Devices[port - 1U];
+}
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
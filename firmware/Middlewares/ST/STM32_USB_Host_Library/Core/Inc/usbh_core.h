@@ -89,6 +89,8 @@ extern "C" {
 
 USBH_StatusTypeDef  USBH_Init(USBH_HandleTypeDef *phost, void (*pUsrFunc)(USBH_HandleTypeDef *phost, uint8_t id), uint8_t id);
 USBH_StatusTypeDef  USBH_DeInit(USBH_HandleTypeDef *phost);
+USBH_StatusTypeDef  USBH_InitHubDevice(USBH_HandleTypeDef *phost,
+                                       USBH_HandleTypeDef *pParent, uint8_t port);
 USBH_StatusTypeDef  USBH_RegisterClass(USBH_HandleTypeDef *phost, USBH_ClassTypeDef *pclass);
 USBH_StatusTypeDef  USBH_SelectInterface(USBH_HandleTypeDef *phost, uint8_t interface);
 uint8_t             USBH_FindInterface(USBH_HandleTypeDef *phost,
@@ -102,6 +104,7 @@ uint8_t             USBH_FindInterfaceIndex(USBH_HandleTypeDef *phost,
                                             uint8_t alt_settings);
 
 uint8_t              USBH_IsPortEnabled(USBH_HandleTypeDef *phost);
+uint8_t              USBH_WaitPending(USBH_HandleTypeDef *phost);
 
 USBH_StatusTypeDef  USBH_Start(USBH_HandleTypeDef *phost);
 USBH_StatusTypeDef  USBH_Stop(USBH_HandleTypeDef *phost);
@@ -118,6 +121,7 @@ USBH_StatusTypeDef   USBH_LL_Connect(USBH_HandleTypeDef *phost);
 USBH_StatusTypeDef   USBH_LL_Disconnect(USBH_HandleTypeDef *phost);
 USBH_SpeedTypeDef    USBH_LL_GetSpeed(USBH_HandleTypeDef *phost);
 USBH_StatusTypeDef   USBH_LL_ResetPort(USBH_HandleTypeDef *phost);
+USBH_StatusTypeDef   USBH_LL_ResetPort2(USBH_HandleTypeDef *phost, uint32_t resetActiveState);
 uint32_t             USBH_LL_GetLastXferSize(USBH_HandleTypeDef *phost,
                                              uint8_t pipe);
 
@@ -164,6 +168,7 @@ void USBH_LL_SetTimer(USBH_HandleTypeDef *phost, uint32_t time);
 void USBH_LL_IncTimer(USBH_HandleTypeDef *phost);
 
 void USBH_Delay(uint32_t Delay);
+uint32_t USBH_GetTick(void);
 
 /**
   * @}
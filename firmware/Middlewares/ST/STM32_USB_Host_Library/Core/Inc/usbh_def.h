@@ -201,6 +201,9 @@ extern "C" {
   */
 
 
+/* Bytes kept of the first class-specific descriptor of an interface (the HID descriptor) */
+#define USBH_CLASS_DESC_SIZE                               0x09U
+
 #define USBH_CONFIGURATION_DESCRIPTOR_SIZE (USB_CONFIGURATION_DESC_SIZE \
                                             + USB_INTERFACE_DESC_SIZE\
                                             + (USBH_MAX_NUM_ENDPOINTS * USB_ENDPOINT_DESC_SIZE))
@@ -289,6 +292,7 @@ typedef struct _InterfaceDescriptor
   uint8_t bInterfaceSubClass;   /* Subclass Code (Assigned by USB Org) */
   uint8_t bInterfaceProtocol;   /* Protocol Code */
   uint8_t iInterface;           /* Index of String Descriptor Describing this interface */
+  uint8_t ClassDesc[USBH_CLASS_DESC_SIZE]; /* First class-specific descriptor, zero if none */
   USBH_EpDescTypeDef               Ep_Desc[USBH_MAX_NUM_ENDPOINTS];
 }
 USBH_InterfaceDescTypeDef;
@@ -320,6 +324,18 @@ typedef enum
   USBH_ERROR_SPEED_UNKNOWN,
 } USBH_StatusTypeDef;
 
+/* Configuration descriptor parser, the descriptor is parsed as it arrives
+   and only the fields used by the host are kept */
+typedef struct
+{
+  uint8_t               head[USBH_CLASS_DESC_SIZE]; /* First bytes of the current descriptor */
+  uint8_t               fill;       /* Bytes of the current descriptor received */
+  uint8_t               itf;        /* Interface waiting for its endpoints, 0xFF if none */
+  uint8_t               itf_count;  /* Interfaces parsed */
+  uint8_t               ep_ix;      /* Endpoints of itf received */
+  USBH_StatusTypeDef    status;
+} USBH_CfgParseTypeDef;
+
 
 /** @defgroup USBH_CORE_Exported_Types
   * @{
@@ -337,6 +353,7 @@ typedef enum
 typedef enum
 {
   HOST_IDLE = 0U,
+  HOST_DEV_RESET,
   HOST_DEV_WAIT_FOR_ATTACHMENT,
   HOST_DEV_ATTACHED,
   HOST_DEV_DISCONNECTED,
@@ -358,6 +375,7 @@ typedef enum
   ENUM_IDLE = 0U,
   ENUM_GET_FULL_DEV_DESC,
   ENUM_SET_ADDR,
+  ENUM_WAIT_ADDR,
   ENUM_GET_CFG_DESC,
   ENUM_GET_FULL_CFG_DESC,
   ENUM_GET_MFC_STRING_DESC,
@@ -413,6 +431,13 @@ typedef enum
 }
 USBH_OSEventTypeDef;
 
+struct _USBH_HandleTypeDef;
+
+/* Receives the Data IN stage of a control request in chunks as it arrives,
+   offset 0 starts the data again after a retried request */
+typedef void (*USBH_CtlSinkTypeDef)(struct _USBH_HandleTypeDef *phost, uint16_t offset,
+                                    const uint8_t *data, uint16_t length);
+
 /* Control request structure */
 typedef struct
 {
@@ -425,13 +450,15 @@ typedef struct
   USB_Setup_TypeDef     setup;
   CTRL_StateTypeDef     state;
   uint8_t               errorcount;
+  USBH_CtlSinkTypeDef   sink;         /* NULL - the whole Data IN stage goes to buff */
+  uint16_t              offset;       /* Data IN bytes passed to the sink */
+  uint16_t              chunk;        /* Size of the Data IN request in progress */
 
 } USBH_CtrlTypeDef;
 
 /* Attached device structure */
 typedef struct
 {
-  uint8_t                           CfgDesc_Raw[USBH_MAX_SIZE_CONFIGURATION];
   uint8_t                           Data[USBH_MAX_DATA_BUFFER];
   uint8_t                           address;
   uint8_t                           speed;
@@ -442,12 +469,15 @@ typedef struct
   __IO uint8_t                      is_ReEnumerated;
   uint8_t                           PortEnabled;
   uint8_t                           current_interface;
+  uint8_t                           CfgCached;
+#if (USBH_CFG_CACHE_SIZE > 0U)
+  uint8_t                           ClassCache[USBH_CFG_CACHE_CLASS_SIZE];
+#endif
   USBH_DevDescTypeDef               DevDesc;
   USBH_CfgDescTypeDef               CfgDesc;
+  USBH_CfgParseTypeDef              CfgParse;
 } USBH_DeviceTypeDef;
 
-struct _USBH_HandleTypeDef;
-
 /* USB Host Class structure */
 typedef struct
 {
@@ -475,9 +505,16 @@ typedef struct _USBH_HandleTypeDef
   uint32_t              Pipes[16];
   __IO uint32_t         Timer;
   uint32_t              Timeout;
+  uint32_t              WaitStart;
+  uint32_t              WaitDelay;
+  uint16_t              WaitState;    /* gState and EnumState the wait was started in */
+  uint8_t               WaitActive;
   uint8_t               id;
   void                 *pData;
   void (* pUser)(struct _USBH_HandleTypeDef *pHandle, uint8_t id);
+  struct _USBH_HandleTypeDef *pParent;   /* Hub of the device, NULL on the root port */
+  struct _USBH_HandleTypeDef *pCtlOwner; /* Root port: device using the control pipes */
+  uint8_t               hub_port;
 
 #if (USBH_USE_OS == 1U)
 #if osCMSIS < 0x20000
@@ -492,6 +529,9 @@ typedef struct _USBH_HandleTypeDef
 
 } USBH_HandleTypeDef;
 
+/* Devices behind a hub share the host channels of the root port */
+#define USBH_ROOT(phost)  (((phost)->pParent != NULL) ? (phost)->pParent : (phost))
+
 
 #if  defined ( __GNUC__ )
 #ifndef __weak
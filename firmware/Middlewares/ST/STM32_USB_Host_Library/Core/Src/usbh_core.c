@@ -76,6 +76,27 @@ osThreadAttr_t USBH_Thread_Atrr;
 static USBH_StatusTypeDef USBH_HandleEnum(USBH_HandleTypeDef *phost);
 static void USBH_HandleSof(USBH_HandleTypeDef *phost);
 static USBH_StatusTypeDef DeInitStateMachine(USBH_HandleTypeDef *phost);
+static USBH_StatusTypeDef USBH_Wait(USBH_HandleTypeDef *phost, uint32_t Delay);
+static uint8_t USBH_WaitStarted(USBH_HandleTypeDef *phost);
+#if (USBH_CFG_CACHE_SIZE > 0U)
+static USBH_StatusTypeDef USBH_CfgCacheLoad(USBH_HandleTypeDef *phost);
+static void USBH_CfgCacheStore(USBH_HandleTypeDef *phost);
+#endif
+
+#if (USBH_CFG_CACHE_SIZE > 0U)
+typedef struct
+{
+  uint8_t               valid;
+  uint16_t              idVendor;
+  uint16_t              idProduct;
+  uint16_t              bcdDevice;
+  USBH_CfgDescTypeDef   CfgDesc;
+  uint8_t               ClassCache[USBH_CFG_CACHE_CLASS_SIZE];
+} USBH_CfgCacheTypeDef;
+
+static USBH_CfgCacheTypeDef USBH_CfgCache[USBH_CFG_CACHE_SIZE];
+static uint8_t USBH_CfgCacheNext;
+#endif
 
 #if (USBH_USE_OS == 1U)
 #if (osCMSIS < 0x20000U)
@@ -237,6 +258,7 @@ static USBH_StatusTypeDef DeInitStateMachine(USBH_HandleTypeDef *phost)
   phost->EnumState = ENUM_IDLE;
   phost->RequestState = CMD_SEND;
   phost->Timer = 0U;
+  phost->WaitActive = 0U;
 
   phost->Control.state = CTRL_SETUP;
   phost->Control.pipe_size = USBH_MPS_DEFAULT;
@@ -246,6 +268,170 @@ static USBH_StatusTypeDef DeInitStateMachine(USBH_HandleTypeDef *phost)
   phost->device.speed = (uint8_t)USBH_SPEED_FULL;
   phost->device.RstCnt = 0U;
   phost->device.EnumCnt = 0U;
+  phost->device.CfgCached = 0U;
+
+  /* Give up the control pipes, the request in progress is abandoned */
+  if ((phost->pParent == NULL) || (phost->pParent->pCtlOwner == phost))
+  {
+    USBH_ROOT(phost)->pCtlOwner = NULL;
+  }
+
+  return USBH_OK;
+}
+
+
+/**
+  * @brief  USBH_Wait
+  *         Non-blocking delay for the state machines. The first call starts
+  *         the delay, the following calls return USBH_BUSY until it expires.
+  *         A wait belongs to the state it was started in, a state left with
+  *         a wait running starts a new one in the next state.
+  * @param  phost: Host Handle
+  * @param  Delay: Delay in ms
+  * @retval USBH Status
+  */
+static USBH_StatusTypeDef USBH_Wait(USBH_HandleTypeDef *phost, uint32_t Delay)
+{
+  if (USBH_WaitStarted(phost) == 0U)
+  {
+    phost->WaitStart = USBH_GetTick();
+    phost->WaitDelay = Delay;
+    phost->WaitState = (uint16_t)(((uint16_t)phost->gState << 8) | (uint16_t)phost->EnumState);
+    phost->WaitActive = 1U;
+  }
+
+  if ((USBH_GetTick() - phost->WaitStart) < Delay)
+  {
+    return USBH_BUSY;
+  }
+
+  phost->WaitActive = 0U;
+  return USBH_OK;
+}
+
+/**
+  * @brief  USBH_WaitStarted
+  *         Is a wait of the current state running
+  * @param  phost: Host Handle
+  * @retval 1 - running
+  */
+static uint8_t USBH_WaitStarted(USBH_HandleTypeDef *phost)
+{
+  const uint16_t state = (uint16_t)(((uint16_t)phost->gState << 8) | (uint16_t)phost->EnumState);
+
+  return ((phost->WaitActive != 0U) && (phost->WaitState == state)) ? 1U : 0U;
+}
+
+/**
+  * @brief  USBH_WaitPending
+  *         Is the current state only waiting out a delay, USBH_Process has
+  *         nothing to do until it expires
+  * @param  phost: Host Handle
+  * @retval 1 - waiting
+  */
+uint8_t USBH_WaitPending(USBH_HandleTypeDef *phost)
+{
+  return ((USBH_WaitStarted(phost) != 0U) &&
+          ((USBH_GetTick() - phost->WaitStart) < phost->WaitDelay)) ? 1U : 0U;
+}
+
+
+#if (USBH_CFG_CACHE_SIZE > 0U)
+/**
+  * @brief  USBH_CfgCacheFind
+  *         Find the cache entry of the device
+  * @param  phost: Host Handle
+  * @retval Cache entry or NULL
+  */
+static USBH_CfgCacheTypeDef *USBH_CfgCacheFind(USBH_HandleTypeDef *phost)
+{
+  uint32_t i;
+
+  for (i = 0U; i < USBH_CFG_CACHE_SIZE; i++)
+  {
+    USBH_CfgCacheTypeDef *entry = &USBH_CfgCache[i];
+    if ((entry->valid != 0U) &&
+        (entry->idVendor == phost->device.DevDesc.idVendor) &&
+        (entry->idProduct == phost->device.DevDesc.idProduct) &&
+        (entry->bcdDevice == phost->device.DevDesc.bcdDevice))
+    {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+
+/**
+  * @brief  USBH_CfgCacheLoad
+  *         Restore the configuration descriptor of a known device
+  * @param  phost: Host Handle
+  * @retval USBH_OK if the device is known
+  */
+static USBH_StatusTypeDef USBH_CfgCacheLoad(USBH_HandleTypeDef *phost)
+{
+  const USBH_CfgCacheTypeDef *entry = USBH_CfgCacheFind(phost);
+
+  if (entry == NULL)
+  {
+    return USBH_FAIL;
+  }
+
+  (void)USBH_memcpy(&phost->device.CfgDesc, &entry->CfgDesc, sizeof(phost->device.CfgDesc));
+  (void)USBH_memcpy(phost->device.ClassCache, entry->ClassCache, sizeof(phost->device.ClassCache));
+  phost->device.CfgCached = 1U;
+  return USBH_OK;
+}
+
+
+/**
+  * @brief  USBH_CfgCacheStore
+  *         Remember the configuration descriptor and the class state of
+  *         a device that started its class, replacing the oldest entry
+  * @param  phost: Host Handle
+  * @retval None
+  */
+static void USBH_CfgCacheStore(USBH_HandleTypeDef *phost)
+{
+  USBH_CfgCacheTypeDef *entry = USBH_CfgCacheFind(phost);
+
+  if (entry == NULL)
+  {
+    entry = &USBH_CfgCache[USBH_CfgCacheNext];
+    USBH_CfgCacheNext = (uint8_t)((USBH_CfgCacheNext + 1U) % USBH_CFG_CACHE_SIZE);
+  }
+
+  entry->valid = 1U;
+  entry->idVendor = phost->device.DevDesc.idVendor;
+  entry->idProduct = phost->device.DevDesc.idProduct;
+  entry->bcdDevice = phost->device.DevDesc.bcdDevice;
+  (void)USBH_memcpy(&entry->CfgDesc, &phost->device.CfgDesc, sizeof(entry->CfgDesc));
+  (void)USBH_memcpy(entry->ClassCache, phost->device.ClassCache, sizeof(entry->ClassCache));
+}
+#endif
+
+
+/**
+  * @brief  USBH_InitHubDevice
+  *         Prepare the Host Handle of a device behind a hub. The device uses
+  *         the host controller and the control pipes of the root port.
+  * @param  phost: Host Handle of the device
+  * @param  pParent: Host Handle of the hub
+  * @param  port: Port of the hub, 1..
+  * @retval USBH Status
+  */
+USBH_StatusTypeDef USBH_InitHubDevice(USBH_HandleTypeDef *phost,
+                                      USBH_HandleTypeDef *pParent, uint8_t port)
+{
+  (void)USBH_memset(phost, 0, sizeof(USBH_HandleTypeDef));
+
+  phost->id = pParent->id;
+  phost->pData = pParent->pData;
+  phost->pUser = pParent->pUser;
+  phost->pParent = pParent;
+  phost->hub_port = port;
+
+  (void)DeInitStateMachine(phost);
 
   return USBH_OK;
 }
@@ -485,14 +671,20 @@ USBH_StatusTypeDef  USBH_Process(USBH_HandleTypeDef *phost)
   {
     case HOST_IDLE :
 
-      if ((phost->device.is_connected) != 0U)
+      /* The hub resets the port of a device behind it */
+      if (phost->pParent != NULL)
+      {
+        break;
+      }
+
+      /* Wait for 200 ms after connection */
+      if (((phost->device.is_connected) != 0U) && (USBH_Wait(phost, 200U) == USBH_OK))
       {
         USBH_UsrLog("USB Device Connected");
 
-        /* Wait for 200 ms after connection */
-        phost->gState = HOST_DEV_WAIT_FOR_ATTACHMENT;
-        USBH_Delay(200U);
-        (void)USBH_LL_ResetPort(phost);
+        /* The reset is timed by HOST_DEV_RESET, USBH_LL_ResetPort would block for 110 ms */
+        phost->gState = HOST_DEV_RESET;
+        (void)USBH_LL_ResetPort2(phost, 1U);
 
         /* Make sure to start with Default address */
         phost->device.address = USBH_ADDRESS_DEFAULT;
@@ -509,6 +701,15 @@ USBH_StatusTypeDef  USBH_Process(USBH_HandleTypeDef *phost)
       }
       break;
 
+    case HOST_DEV_RESET:
+      /* Release the port reset after 100 ms, the recovery time is in HOST_DEV_ATTACHED */
+      if (USBH_Wait(phost, 100U) == USBH_OK)
+      {
+        (void)USBH_LL_ResetPort2(phost, 0U);
+        phost->gState = HOST_DEV_WAIT_FOR_ATTACHMENT;
+      }
+      break;
+
     case HOST_DEV_WAIT_FOR_ATTACHMENT: /* Wait for Port Enabled */
 
       if (phost->device.PortEnabled == 1U)
@@ -533,10 +734,13 @@ USBH_StatusTypeDef  USBH_Process(USBH_HandleTypeDef *phost)
             phost->gState = HOST_IDLE;
           }
         }
-        else
+        else if (USBH_Wait(phost, 10U) == USBH_OK)
         {
           phost->Timeout += 10U;
-          USBH_Delay(10U);
+        }
+        else
+        {
+          /* .. */
         }
       }
 #if (USBH_USE_OS == 1U)
@@ -551,18 +755,29 @@ USBH_StatusTypeDef  USBH_Process(USBH_HandleTypeDef *phost)
 
     case HOST_DEV_ATTACHED :
 
-      if (phost->pUser != NULL)
+      if ((phost->pUser != NULL) && (USBH_WaitStarted(phost) == 0U))
       {
         phost->pUser(phost, HOST_USER_CONNECTION);
       }
 
       /* Wait for 100 ms after Reset */
-      USBH_Delay(100U);
-
-      phost->device.speed = (uint8_t)USBH_LL_GetSpeed(phost);
+      if (USBH_Wait(phost, 100U) != USBH_OK)
+      {
+        break;
+      }
 
       phost->gState = HOST_ENUMERATION;
 
+      /* The hub reports the speed, the control pipes are those of the root port */
+      if (phost->pParent != NULL)
+      {
+        phost->Control.pipe_out = phost->pParent->Control.pipe_out;
+        phost->Control.pipe_in = phost->pParent->Control.pipe_in;
+        break;
+      }
+
+      phost->device.speed = (uint8_t)USBH_LL_GetSpeed(phost);
+
       phost->Control.pipe_out = USBH_AllocPipe(phost, 0x00U);
       phost->Control.pipe_in  = USBH_AllocPipe(phost, 0x80U);
 
@@ -700,7 +915,7 @@ USBH_StatusTypeDef  USBH_Process(USBH_HandleTypeDef *phost)
       {
         phost->pActiveClass = NULL;
 
-        for (idx = 0U; idx < USBH_MAX_NUM_SUPPORTED_CLASS; idx++)
+        for (idx = 0U; idx < phost->ClassNumber; idx++)
         {
           if (phost->pClass[idx]->ClassCode == phost->device.CfgDesc.Itf_Desc[0].bInterfaceClass)
           {
@@ -751,6 +966,9 @@ USBH_StatusTypeDef  USBH_Process(USBH_HandleTypeDef *phost)
         if (status == USBH_OK)
         {
           phost->gState = HOST_CLASS;
+#if (USBH_CFG_CACHE_SIZE > 0U)
+          USBH_CfgCacheStore(phost);
+#endif
         }
         else if (status == USBH_FAIL)
         {
@@ -803,7 +1021,17 @@ USBH_StatusTypeDef  USBH_Process(USBH_HandleTypeDef *phost)
       }
       USBH_UsrLog("USB Device disconnected");
 
-      if (phost->device.is_ReEnumerated == 1U)
+      if (phost->pParent == NULL)
+      {
+        /* A disconnection during HOST_DEV_RESET leaves the port reset asserted */
+        (void)USBH_LL_ResetPort2(phost, 0U);
+      }
+
+      if (phost->pParent != NULL)
+      {
+        /* The port of the hub stays up, the hub reports the next device */
+      }
+      else if (phost->device.is_ReEnumerated == 1U)
       {
         phost->device.is_ReEnumerated = 0U;
 
@@ -854,17 +1082,8 @@ static USBH_StatusTypeDef USBH_HandleEnum(USBH_HandleTypeDef *phost)
       {
         phost->Control.pipe_size = phost->device.DevDesc.bMaxPacketSize;
 
+        /* The control pipes take the MaxPacket size with the next request */
         phost->EnumState = ENUM_GET_FULL_DEV_DESC;
-
-        /* modify control channels configuration for MaxPacket size */
-        (void)USBH_OpenPipe(phost, phost->Control.pipe_in, 0x80U, phost->device.address,
-                            phost->device.speed, USBH_EP_CONTROL,
-                            (uint16_t)phost->Control.pipe_size);
-
-        /* Open Control pipes */
-        (void)USBH_OpenPipe(phost, phost->Control.pipe_out, 0x00U, phost->device.address,
-                            phost->device.speed, USBH_EP_CONTROL,
-                            (uint16_t)phost->Control.pipe_size);
       }
       else if (ReqStatus == USBH_NOT_SUPPORTED)
       {
@@ -931,25 +1150,12 @@ static USBH_StatusTypeDef USBH_HandleEnum(USBH_HandleTypeDef *phost)
 
     case ENUM_SET_ADDR:
       /* set address */
-      ReqStatus = USBH_SetAddress(phost, USBH_DEVICE_ADDRESS);
+      /* Devices behind a hub are numbered after its ports */
+      ReqStatus = USBH_SetAddress(phost, (uint8_t)(USBH_DEVICE_ADDRESS + phost->hub_port));
       if (ReqStatus == USBH_OK)
       {
-        USBH_Delay(2U);
-        phost->device.address = USBH_DEVICE_ADDRESS;
-
-        /* user callback for device address assigned */
-        USBH_UsrLog("Address (#%d) assigned.", phost->device.address);
-        phost->EnumState = ENUM_GET_CFG_DESC;
-
-        /* modify control channels to update device address */
-        (void)USBH_OpenPipe(phost, phost->Control.pipe_in, 0x80U,  phost->device.address,
-                            phost->device.speed, USBH_EP_CONTROL,
-                            (uint16_t)phost->Control.pipe_size);
-
-        /* Open Control pipes */
-        (void)USBH_OpenPipe(phost, phost->Control.pipe_out, 0x00U, phost->device.address,
-                            phost->device.speed, USBH_EP_CONTROL,
-                            (uint16_t)phost->Control.pipe_size);
+        /* Give the device 2 ms to apply the address */
+        phost->EnumState = ENUM_WAIT_ADDR;
       }
       else if (ReqStatus == USBH_NOT_SUPPORTED)
       {
@@ -966,6 +1172,27 @@ static USBH_StatusTypeDef USBH_HandleEnum(USBH_HandleTypeDef *phost)
       }
       break;
 
+    case ENUM_WAIT_ADDR:
+      if (USBH_Wait(phost, 2U) == USBH_OK)
+      {
+        /* The control pipes take the address with the next request */
+        phost->device.address = (uint8_t)(USBH_DEVICE_ADDRESS + phost->hub_port);
+
+        /* user callback for device address assigned */
+        USBH_UsrLog("Address (#%d) assigned.", phost->device.address);
+        phost->EnumState = ENUM_GET_CFG_DESC;
+
+#if (USBH_CFG_CACHE_SIZE > 0U)
+        /* Known device, its configuration is already here */
+        if (USBH_CfgCacheLoad(phost) == USBH_OK)
+        {
+          USBH_UsrLog("Configuration restored from cache.");
+          Status = USBH_OK;
+        }
+#endif
+      }
+      break;
+
     case ENUM_GET_CFG_DESC:
       /* get standard configuration descriptor */
       ReqStatus = USBH_Get_CfgDesc(phost, USB_CONFIGURATION_DESC_SIZE);
@@ -1005,7 +1232,11 @@ static USBH_StatusTypeDef USBH_HandleEnum(USBH_HandleTypeDef *phost)
       ReqStatus = USBH_Get_CfgDesc(phost, phost->device.CfgDesc.wTotalLength);
       if (ReqStatus == USBH_OK)
       {
+#if (USBH_SKIP_STRING_DESC == 1U)
+        Status = USBH_OK;
+#else
         phost->EnumState = ENUM_GET_MFC_STRING_DESC;
+#endif
       }
       else if (ReqStatus == USBH_NOT_SUPPORTED)
       {
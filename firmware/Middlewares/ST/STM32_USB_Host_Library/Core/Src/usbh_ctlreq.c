@@ -74,8 +74,18 @@ static USBH_StatusTypeDef USBH_HandleControl(USBH_HandleTypeDef *phost);
 static void USBH_ParseDevDesc(USBH_DevDescTypeDef *dev_desc,
                               uint8_t *buf, uint16_t length);
 
-static USBH_StatusTypeDef USBH_ParseCfgDesc(USBH_HandleTypeDef *phost,
-                                            uint8_t *buf, uint16_t length);
+static void USBH_CfgDescSink(USBH_HandleTypeDef *phost, uint16_t offset,
+                             const uint8_t *data, uint16_t length);
+static void USBH_ParseCfgItem(USBH_HandleTypeDef *phost, USBH_CfgParseTypeDef *parse);
+static USBH_StatusTypeDef USBH_ParseCfgEnd(USBH_HandleTypeDef *phost);
+
+static USBH_StatusTypeDef USBH_GetDescriptorSink(USBH_HandleTypeDef *phost,
+                                                 uint8_t  req_type, uint16_t value_idx,
+                                                 uint16_t index, uint8_t *buff,
+                                                 uint16_t length, USBH_CtlSinkTypeDef sink);
+static USBH_StatusTypeDef USBH_CtlReqSink(USBH_HandleTypeDef *phost, uint8_t *buff,
+                                          uint16_t length, USBH_CtlSinkTypeDef sink);
+static USBH_StatusTypeDef USBH_CtlAcquire(USBH_HandleTypeDef *phost);
 
 static USBH_StatusTypeDef USBH_ParseEPDesc(USBH_HandleTypeDef *phost, USBH_EpDescTypeDef  *ep_descriptor, uint8_t *buf);
 static void USBH_ParseStringDesc(uint8_t *psrc, uint8_t *pdest, uint16_t length);
@@ -122,9 +132,9 @@ USBH_StatusTypeDef USBH_Get_DevDesc(USBH_HandleTypeDef *phost, uint8_t length)
 
 /**
   * @brief  USBH_Get_CfgDesc
-  *         Issues Configuration Descriptor to the device. Once the response
-  *         received, it parses the configuration descriptor and updates the
-  *         status.
+  *         Issues Configuration Descriptor to the device. The descriptor is
+  *         parsed chunk by chunk as it arrives, so its length is not limited
+  *         by a buffer. Once the response received, it updates the status.
   * @param  phost: Host Handle
   * @param  length: Length of the descriptor
   * @retval USBH Status
@@ -134,15 +144,14 @@ USBH_StatusTypeDef USBH_Get_CfgDesc(USBH_HandleTypeDef *phost,
 
 {
   USBH_StatusTypeDef status;
-  uint8_t *pData = phost->device.CfgDesc_Raw;
 
-  status = USBH_GetDescriptor(phost, (USB_REQ_RECIPIENT_DEVICE | USB_REQ_TYPE_STANDARD),
-                              USB_DESC_CONFIGURATION, pData, length);
+  status = USBH_GetDescriptorStream(phost, (USB_REQ_RECIPIENT_DEVICE | USB_REQ_TYPE_STANDARD),
+                                    USB_DESC_CONFIGURATION, 0U, length, USBH_CfgDescSink);
 
-  if (status == USBH_OK)
+  if ((status == USBH_OK) && (length > USB_CONFIGURATION_DESC_SIZE))
   {
     /* Commands successfully sent and Response Received  */
-    status = USBH_ParseCfgDesc(phost, pData, length);
+    status = USBH_ParseCfgEnd(phost);
   }
 
   return status;
@@ -165,6 +174,9 @@ USBH_StatusTypeDef USBH_Get_StringDesc(USBH_HandleTypeDef *phost,
 {
   USBH_StatusTypeDef status;
 
+  /* Long strings are cut to the data buffer */
+  length = MIN(length, (uint16_t)USBH_MAX_DATA_BUFFER);
+
   status = USBH_GetDescriptor(phost,
                               USB_REQ_RECIPIENT_DEVICE | USB_REQ_TYPE_STANDARD,
                               USB_DESC_STRING | string_index,
@@ -173,7 +185,7 @@ USBH_StatusTypeDef USBH_Get_StringDesc(USBH_HandleTypeDef *phost,
   if (status == USBH_OK)
   {
     /* Commands successfully sent and Response Received  */
-    USBH_ParseStringDesc(phost->device.Data, buff, length);
+    USBH_ParseStringDesc(phost->device.Data, buff, length - 2U);
   }
 
   return status;
@@ -196,6 +208,54 @@ USBH_StatusTypeDef USBH_GetDescriptor(USBH_HandleTypeDef *phost,
                                       uint16_t value_idx,
                                       uint8_t *buff,
                                       uint16_t length)
+{
+  return USBH_GetDescriptorSink(phost, req_type, value_idx, 0U, buff, length, NULL);
+}
+
+
+/**
+  * @brief  USBH_GetDescriptorStream
+  *         Issues Descriptor command to the device. The descriptor is received
+  *         through phost->device.Data in chunks, each one is passed to the sink
+  *         as soon as it arrives.
+  * @param  phost: Host Handle
+  * @param  req_type: Descriptor type
+  * @param  value_idx: Value for the GetDescriptr request
+  * @param  index: wIndex, the interface number for interface descriptors
+  * @param  length: Length of the descriptor
+  * @param  sink: Receiver of the descriptor chunks
+  * @retval USBH Status
+  */
+USBH_StatusTypeDef USBH_GetDescriptorStream(USBH_HandleTypeDef *phost,
+                                            uint8_t  req_type,
+                                            uint16_t value_idx,
+                                            uint16_t index,
+                                            uint16_t length,
+                                            USBH_CtlSinkTypeDef sink)
+{
+  return USBH_GetDescriptorSink(phost, req_type, value_idx, index, phost->device.Data, length, sink);
+}
+
+
+/**
+  * @brief  USBH_GetDescriptorSink
+  *         Issues Descriptor command to the device
+  * @param  phost: Host Handle
+  * @param  req_type: Descriptor type
+  * @param  value_idx: Value for the GetDescriptr request
+  * @param  index: wIndex, the language ID is used for strings
+  * @param  buff: Buffer to store the descriptor or its chunks
+  * @param  length: Length of the descriptor
+  * @param  sink: Receiver of the descriptor chunks, NULL - the whole descriptor goes to buff
+  * @retval USBH Status
+  */
+static USBH_StatusTypeDef USBH_GetDescriptorSink(USBH_HandleTypeDef *phost,
+                                                 uint8_t  req_type,
+                                                 uint16_t value_idx,
+                                                 uint16_t index,
+                                                 uint8_t *buff,
+                                                 uint16_t length,
+                                                 USBH_CtlSinkTypeDef sink)
 {
   if (phost->RequestState == CMD_SEND)
   {
@@ -209,12 +269,12 @@ USBH_StatusTypeDef USBH_GetDescriptor(USBH_HandleTypeDef *phost,
     }
     else
     {
-      phost->Control.setup.b.wIndex.w = 0U;
+      phost->Control.setup.b.wIndex.w = index;
     }
     phost->Control.setup.b.wLength.w = length;
   }
 
-  return USBH_CtlReq(phost, buff, length);
+  return USBH_CtlReqSink(phost, buff, length, sink);
 }
 
 
@@ -392,116 +452,169 @@ static void  USBH_ParseDevDesc(USBH_DevDescTypeDef *dev_desc, uint8_t *buf,
 
 
 /**
-  * @brief  USBH_ParseCfgDesc
-  *         This function Parses the configuration descriptor
+  * @brief  USBH_CfgDescSink
+  *         Parses a chunk of the configuration descriptor. Only the first bytes
+  *         of every descriptor are collected, the rest is skipped.
   * @param  phost: USB Host handler
-  * @param  buf: Buffer where the source descriptor is available
-  * @param  length: Length of the descriptor
-  * @retval USBH statuse
+  * @param  offset: Offset of the chunk in the descriptor
+  * @param  data: Chunk
+  * @param  length: Length of the chunk
+  * @retval None
   */
-static USBH_StatusTypeDef USBH_ParseCfgDesc(USBH_HandleTypeDef *phost, uint8_t *buf, uint16_t length)
+static void USBH_CfgDescSink(USBH_HandleTypeDef *phost, uint16_t offset,
+                             const uint8_t *data, uint16_t length)
 {
-  USBH_CfgDescTypeDef *cfg_desc = &phost->device.CfgDesc;
-  USBH_StatusTypeDef           status = USBH_OK;
-  USBH_InterfaceDescTypeDef    *pif ;
-  USBH_EpDescTypeDef           *pep;
-  USBH_DescHeader_t            *pdesc = (USBH_DescHeader_t *)(void *)buf;
-  uint16_t                     ptr;
-  uint8_t                      if_ix = 0U;
-  uint8_t                      ep_ix = 0U;
-
-  pdesc   = (USBH_DescHeader_t *)(void *)buf;
-
-  /* Parse configuration descriptor */
-  cfg_desc->bLength             = *(uint8_t *)(buf + 0);
-  cfg_desc->bDescriptorType     = *(uint8_t *)(buf + 1);
-  cfg_desc->wTotalLength        = MIN(((uint16_t) LE16(buf + 2)), ((uint16_t)USBH_MAX_SIZE_CONFIGURATION));
-  cfg_desc->bNumInterfaces      = *(uint8_t *)(buf + 4);
-  cfg_desc->bConfigurationValue = *(uint8_t *)(buf + 5);
-  cfg_desc->iConfiguration      = *(uint8_t *)(buf + 6);
-  cfg_desc->bmAttributes        = *(uint8_t *)(buf + 7);
-  cfg_desc->bMaxPower           = *(uint8_t *)(buf + 8);
-
-  /* Make sure that the Confguration descriptor's bLength is equal to USB_CONFIGURATION_DESC_SIZE */
-  if (cfg_desc->bLength  != USB_CONFIGURATION_DESC_SIZE)
+  USBH_CfgParseTypeDef *parse = &phost->device.CfgParse;
+  uint8_t size;
+
+  if (offset == 0U)
   {
-    cfg_desc->bLength = USB_CONFIGURATION_DESC_SIZE;
+    (void)USBH_memset(&phost->device.CfgDesc, 0, sizeof(phost->device.CfgDesc));
+    (void)USBH_memset(parse, 0, sizeof(*parse));
+    parse->itf = 0xFFU;
+    parse->status = USBH_OK;
   }
 
-  if (length > USB_CONFIGURATION_DESC_SIZE)
+  while ((length != 0U) && (parse->status != USBH_FAIL))
   {
-    ptr = USB_LEN_CFG_DESC;
-    pif = (USBH_InterfaceDescTypeDef *)NULL;
+    if (parse->fill == 0U)
+    {
+      (void)USBH_memset(parse->head, 0, sizeof(parse->head));
+    }
+    if (parse->fill < USBH_CLASS_DESC_SIZE)
+    {
+      parse->head[parse->fill] = *data;
+    }
+    parse->fill++;
+    data++;
+    length--;
 
-    while ((if_ix < USBH_MAX_NUM_INTERFACES) && (ptr < cfg_desc->wTotalLength))
+    /* bLength is the first byte */
+    size = parse->head[0];
+    if (size < 2U)
     {
-      pdesc = USBH_GetNextDesc((uint8_t *)(void *)pdesc, &ptr);
-      if (pdesc->bDescriptorType == USB_DESC_TYPE_INTERFACE)
-      {
-        /* Make sure that the interface descriptor's bLength is equal to USB_INTERFACE_DESC_SIZE */
-        if (pdesc->bLength != USB_INTERFACE_DESC_SIZE)
-        {
-          pdesc->bLength = USB_INTERFACE_DESC_SIZE;
-        }
+      USBH_ErrLog("Malformed configuration descriptor");
+      parse->status = USBH_FAIL;
+      break;
+    }
 
-        pif = &cfg_desc->Itf_Desc[if_ix];
-        USBH_ParseInterfaceDesc(pif, (uint8_t *)(void *)pdesc);
+    if (parse->fill == MIN(size, (uint8_t)USBH_CLASS_DESC_SIZE))
+    {
+      USBH_ParseCfgItem(phost, parse);
+    }
 
-        ep_ix = 0U;
-        pep = (USBH_EpDescTypeDef *)NULL;
+    if (parse->fill == size)
+    {
+      parse->fill = 0U;
+    }
+  }
+}
 
-        while ((ep_ix < pif->bNumEndpoints) && (ptr < cfg_desc->wTotalLength))
-        {
-          pdesc = USBH_GetNextDesc((uint8_t *)(void *)pdesc, &ptr);
 
-          if (pdesc->bDescriptorType == USB_DESC_TYPE_ENDPOINT)
-          {
-            /* Check if the endpoint is appartening to an audio streaming interface */
-            if ((pif->bInterfaceClass == 0x01U) && (pif->bInterfaceSubClass == 0x02U))
-            {
-              /* Check if it is supporting the USB AUDIO 01 class specification */
-              if ((pif->bInterfaceProtocol == 0x00U) && (pdesc->bLength != 0x09U))
-              {
-                pdesc->bLength = 0x09U;
-              }
-            }
-            /* Make sure that the endpoint descriptor's bLength is equal to
-               USB_ENDPOINT_DESC_SIZE for all other endpoints types */
-            else if (pdesc->bLength != USB_ENDPOINT_DESC_SIZE)
-            {
-              pdesc->bLength = USB_ENDPOINT_DESC_SIZE;
-            }
-            else
-            {
-              /* ... */
-            }
-
-            pep = &cfg_desc->Itf_Desc[if_ix].Ep_Desc[ep_ix];
-
-            status = USBH_ParseEPDesc(phost, pep, (uint8_t *)(void *)pdesc);
-
-            ep_ix++;
-          }
-        }
+/**
+  * @brief  USBH_ParseCfgItem
+  *         Parses one descriptor of the configuration
+  * @param  phost: USB Host handler
+  * @param  parse: Parser with the first bytes of the descriptor
+  * @retval None
+  */
+static void USBH_ParseCfgItem(USBH_HandleTypeDef *phost, USBH_CfgParseTypeDef *parse)
+{
+  USBH_CfgDescTypeDef          *cfg_desc = &phost->device.CfgDesc;
+  USBH_InterfaceDescTypeDef    *pif = (USBH_InterfaceDescTypeDef *)NULL;
+  uint8_t                      *buf = parse->head;
+
+  if (parse->itf != 0xFFU)
+  {
+    pif = &cfg_desc->Itf_Desc[parse->itf];
+  }
+
+  switch (buf[1])
+  {
+    case USB_DESC_TYPE_CONFIGURATION:
+      cfg_desc->bLength             = USB_CONFIGURATION_DESC_SIZE;
+      cfg_desc->bDescriptorType     = *(uint8_t *)(buf + 1);
+      cfg_desc->wTotalLength        = LE16(buf + 2);
+      cfg_desc->bNumInterfaces      = *(uint8_t *)(buf + 4);
+      cfg_desc->bConfigurationValue = *(uint8_t *)(buf + 5);
+      cfg_desc->iConfiguration      = *(uint8_t *)(buf + 6);
+      cfg_desc->bmAttributes        = *(uint8_t *)(buf + 7);
+      cfg_desc->bMaxPower           = *(uint8_t *)(buf + 8);
+      break;
 
-        /* Check if the required endpoint(s) data are parsed */
-        if (ep_ix < pif->bNumEndpoints)
+    case USB_DESC_TYPE_INTERFACE:
+      /* Check if the required endpoint(s) data of the previous interface are parsed */
+      if ((pif != NULL) && (parse->ep_ix < pif->bNumEndpoints))
+      {
+        parse->status = USBH_NOT_SUPPORTED;
+      }
+
+      /* Interfaces that do not fit are ignored */
+      parse->itf = 0xFFU;
+      if (parse->itf_count < USBH_MAX_NUM_INTERFACES)
+      {
+        parse->itf = parse->itf_count;
+        parse->itf_count++;
+        parse->ep_ix = 0U;
+        pif = &cfg_desc->Itf_Desc[parse->itf];
+        USBH_ParseInterfaceDesc(pif, buf);
+        pif->bLength = USB_INTERFACE_DESC_SIZE;
+      }
+      break;
+
+    case USB_DESC_TYPE_ENDPOINT:
+      if ((pif != NULL) && (parse->ep_ix < pif->bNumEndpoints))
+      {
+        if ((parse->ep_ix < USBH_MAX_NUM_ENDPOINTS) &&
+            (USBH_ParseEPDesc(phost, &pif->Ep_Desc[parse->ep_ix], buf) != USBH_OK) &&
+            (parse->status == USBH_OK))
         {
-          return USBH_NOT_SUPPORTED;
+          parse->status = USBH_NOT_SUPPORTED;
         }
+        parse->ep_ix++;
+      }
+      break;
 
-        if_ix++;
+    default:
+      /* Class-specific descriptors follow their interface, HID before the endpoints */
+      if ((pif != NULL) && (pif->ClassDesc[0] == 0U))
+      {
+        (void)USBH_memcpy(pif->ClassDesc, buf, USBH_CLASS_DESC_SIZE);
       }
-    }
+      break;
+  }
+}
 
-    /* Check if the required interface(s) data are parsed */
-    if (if_ix < MIN(cfg_desc->bNumInterfaces, (uint8_t)USBH_MAX_NUM_INTERFACES))
-    {
-      return USBH_NOT_SUPPORTED;
-    }
+
+/**
+  * @brief  USBH_ParseCfgEnd
+  *         Checks the configuration descriptor once it is received
+  * @param  phost: USB Host handler
+  * @retval USBH statuse
+  */
+static USBH_StatusTypeDef USBH_ParseCfgEnd(USBH_HandleTypeDef *phost)
+{
+  USBH_CfgDescTypeDef *cfg_desc = &phost->device.CfgDesc;
+  USBH_CfgParseTypeDef *parse = &phost->device.CfgParse;
+
+  if (parse->status != USBH_OK)
+  {
+    return (parse->status == USBH_FAIL) ? USBH_NOT_SUPPORTED : parse->status;
   }
 
-  return status;
+  /* Check if the required endpoint(s) data of the last interface are parsed */
+  if ((parse->itf != 0xFFU) && (parse->ep_ix < cfg_desc->Itf_Desc[parse->itf].bNumEndpoints))
+  {
+    return USBH_NOT_SUPPORTED;
+  }
+
+  /* Check if the required interface(s) data are parsed */
+  if (parse->itf_count < MIN(cfg_desc->bNumInterfaces, (uint8_t)USBH_MAX_NUM_INTERFACES))
+  {
+    return USBH_NOT_SUPPORTED;
+  }
+
+  return USBH_OK;
 }
 
 
@@ -681,6 +794,23 @@ USBH_DescHeader_t  *USBH_GetNextDesc(uint8_t   *pbuf, uint16_t  *ptr)
   */
 USBH_StatusTypeDef USBH_CtlReq(USBH_HandleTypeDef *phost, uint8_t *buff,
                                uint16_t length)
+{
+  return USBH_CtlReqSink(phost, buff, length, NULL);
+}
+
+
+/**
+  * @brief  USBH_CtlReqSink
+  *         Sends a control request, the Data IN stage goes to the sink in
+  *         chunks of buff size when the sink is set
+  * @param  phost: Host Handle
+  * @param  buff: data buffer address to store the response or its chunks
+  * @param  length: length of the response
+  * @param  sink: Receiver of the response chunks, NULL - the whole response goes to buff
+  * @retval USBH Status
+  */
+static USBH_StatusTypeDef USBH_CtlReqSink(USBH_HandleTypeDef *phost, uint8_t *buff,
+                                          uint16_t length, USBH_CtlSinkTypeDef sink)
 {
   USBH_StatusTypeDef status;
   status = USBH_BUSY;
@@ -688,9 +818,16 @@ USBH_StatusTypeDef USBH_CtlReq(USBH_HandleTypeDef *phost, uint8_t *buff,
   switch (phost->RequestState)
   {
     case CMD_SEND:
+      /* Devices behind a hub take turns on the control pipes */
+      if (USBH_CtlAcquire(phost) != USBH_OK)
+      {
+        break;
+      }
+
       /* Start a SETUP transfer */
       phost->Control.buff = buff;
       phost->Control.length = length;
+      phost->Control.sink = sink;
       phost->Control.state = CTRL_SETUP;
       phost->RequestState = CMD_WAIT;
       status = USBH_BUSY;
@@ -722,6 +859,11 @@ USBH_StatusTypeDef USBH_CtlReq(USBH_HandleTypeDef *phost, uint8_t *buff,
       {
         /* .. */
       }
+
+      if (status != USBH_BUSY)
+      {
+        USBH_ROOT(phost)->pCtlOwner = NULL;
+      }
 #if (USBH_USE_OS == 1U)
       phost->os_msg = (uint32_t)USBH_CONTROL_EVENT;
 #if (osCMSIS < 0x20000U)
@@ -739,6 +881,37 @@ USBH_StatusTypeDef USBH_CtlReq(USBH_HandleTypeDef *phost, uint8_t *buff,
 }
 
 
+/**
+  * @brief  USBH_CtlAcquire
+  *         Takes the control pipes of the root port for a request. They are
+  *         shared by the devices behind a hub, so they are reopened with the
+  *         address, speed and packet size of the requesting device.
+  * @param  phost: Host Handle
+  * @retval USBH_OK, USBH_BUSY while another device uses them
+  */
+static USBH_StatusTypeDef USBH_CtlAcquire(USBH_HandleTypeDef *phost)
+{
+  USBH_HandleTypeDef *root = USBH_ROOT(phost);
+
+  if ((root->pCtlOwner != NULL) && (root->pCtlOwner != phost))
+  {
+    return USBH_BUSY;
+  }
+
+  root->pCtlOwner = phost;
+
+  (void)USBH_OpenPipe(phost, phost->Control.pipe_in, 0x80U, phost->device.address,
+                      phost->device.speed, USBH_EP_CONTROL,
+                      (uint16_t)phost->Control.pipe_size);
+
+  (void)USBH_OpenPipe(phost, phost->Control.pipe_out, 0x00U, phost->device.address,
+                      phost->device.speed, USBH_EP_CONTROL,
+                      (uint16_t)phost->Control.pipe_size);
+
+  return USBH_OK;
+}
+
+
 /**
   * @brief  USBH_HandleControl
   *         Handles the USB control transfer state machine
@@ -748,6 +921,7 @@ USBH_StatusTypeDef USBH_CtlReq(USBH_HandleTypeDef *phost, uint8_t *buff,
 static USBH_StatusTypeDef USBH_HandleControl(USBH_HandleTypeDef *phost)
 {
   uint8_t direction;
+  uint16_t chunk;
   USBH_StatusTypeDef status = USBH_BUSY;
   USBH_URBStateTypeDef URB_Status = USBH_URB_IDLE;
 
@@ -769,6 +943,10 @@ static USBH_StatusTypeDef USBH_HandleControl(USBH_HandleTypeDef *phost)
       {
         direction = (phost->Control.setup.b.bmRequestType & USB_REQ_DIR_MASK);
 
+        /* Data IN and Status IN stages start with DATA1 */
+        (void)USBH_LL_SetToggle(phost, phost->Control.pipe_in, 1U);
+        phost->Control.offset = 0U;
+
         /* check if there is a data stage */
         if (phost->Control.setup.b.wLength.w != 0U)
         {
@@ -829,8 +1007,19 @@ static USBH_StatusTypeDef USBH_HandleControl(USBH_HandleTypeDef *phost)
     case CTRL_DATA_IN:
       /* Issue an IN token */
       phost->Control.timer = (uint16_t)phost->Timer;
-      (void)USBH_CtlReceiveData(phost, phost->Control.buff,
-                                phost->Control.length, phost->Control.pipe_in);
+      if (phost->Control.sink != NULL)
+      {
+        /* Whole packets that fit the buffer, the sink takes them before the next chunk */
+        chunk = (uint16_t)(USBH_MAX_DATA_BUFFER - (USBH_MAX_DATA_BUFFER % phost->Control.pipe_size));
+        phost->Control.chunk = MIN((uint16_t)(phost->Control.length - phost->Control.offset), chunk);
+        (void)USBH_CtlReceiveData(phost, phost->Control.buff,
+                                  phost->Control.chunk, phost->Control.pipe_in);
+      }
+      else
+      {
+        (void)USBH_CtlReceiveData(phost, phost->Control.buff,
+                                  phost->Control.length, phost->Control.pipe_in);
+      }
 
       phost->Control.state = CTRL_DATA_IN_WAIT;
       break;
@@ -844,6 +1033,19 @@ static USBH_StatusTypeDef USBH_HandleControl(USBH_HandleTypeDef *phost)
       {
         phost->Control.state = CTRL_STATUS_OUT;
 
+        if (phost->Control.sink != NULL)
+        {
+          chunk = (uint16_t)USBH_LL_GetLastXferSize(phost, phost->Control.pipe_in);
+          phost->Control.sink(phost, phost->Control.offset, phost->Control.buff, chunk);
+          phost->Control.offset += chunk;
+
+          /* A short packet or the requested length ends the Data IN stage */
+          if ((chunk == phost->Control.chunk) && (phost->Control.offset < phost->Control.length))
+          {
+            phost->Control.state = CTRL_DATA_IN;
+          }
+        }
+
 #if (USBH_USE_OS == 1U)
         phost->os_msg = (uint32_t)USBH_CONTROL_EVENT;
 #if (osCMSIS < 0x20000U)
@@ -122,7 +122,7 @@ uint8_t USBH_AllocPipe(USBH_HandleTypeDef *phost, uint8_t ep_addr)
 
   if (pipe != 0xFFFFU)
   {
-    phost->Pipes[pipe & 0xFU] = (uint32_t)(0x8000U | ep_addr);
+    USBH_ROOT(phost)->Pipes[pipe & 0xFU] = (uint32_t)(0x8000U | ep_addr);
   }
 
   return (uint8_t)pipe;
@@ -138,9 +138,16 @@ uint8_t USBH_AllocPipe(USBH_HandleTypeDef *phost, uint8_t ep_addr)
   */
 USBH_StatusTypeDef USBH_FreePipe(USBH_HandleTypeDef *phost, uint8_t idx)
 {
+  /* Devices behind a hub borrow the control pipes of the root port */
+  if ((phost->pParent != NULL) &&
+      ((idx == phost->Control.pipe_in) || (idx == phost->Control.pipe_out)))
+  {
+    return USBH_OK;
+  }
+
   if (idx < USBH_MAX_PIPES_NBR)
   {
-    phost->Pipes[idx] &= 0x7FFFU;
+    USBH_ROOT(phost)->Pipes[idx] &= 0x7FFFU;
   }
 
   return USBH_OK;
@@ -159,7 +166,7 @@ static uint16_t USBH_GetFreePipe(USBH_HandleTypeDef *phost)
 
   for (idx = 0U ; idx < USBH_MAX_PIPES_NBR ; idx++)
   {
-    if ((phost->Pipes[idx] & 0x8000U) == 0U)
+    if ((USBH_ROOT(phost)->Pipes[idx] & 0x8000U) == 0U)
     {
       return (uint16_t)idx;
     }
@@ -25,6 +25,7 @@
 #include "usbh_hid.h"
 
 /* USER CODE BEGIN Includes */
+#include "usbh_hub.h"
 
 /* USER CODE END Includes */
 
@@ -85,6 +86,11 @@ void MX_USB_HOST_Init(void)
     Error_Handler();
   }
   /* USER CODE BEGIN USB_HOST_Init_PostTreatment */
+  /* Keyboards behind a hub, every port gets the classes registered above */
+  if (USBH_RegisterClass(&hUsbHostFS, USBH_HUB_CLASS) != USBH_OK)
+  {
+    Error_Handler();
+  }
 
   /* USER CODE END USB_HOST_Init_PostTreatment */
 }
@@ -22,6 +22,8 @@
 #include "usbh_core.h"
 
 /* USER CODE BEGIN Includes */
+#include "my_config.h"
+#include "my.h"
 
 /* USER CODE END Includes */
 
@@ -134,6 +136,9 @@ void HAL_HCD_SOF_Callback(HCD_HandleTypeDef *hhcd)
 void HAL_HCD_Connect_Callback(HCD_HandleTypeDef *hhcd)
 {
   USBH_LL_Connect(hhcd->pData);
+#if ZX_STATS
+  MyUsbConnected();
+#endif
 }
 
 /**
@@ -159,6 +164,12 @@ void HAL_HCD_HC_NotifyURBChange_Callback(HCD_HandleTypeDef *hhcd, uint8_t chnum,
 #if (USBH_USE_OS == 1)
   USBH_LL_NotifyURBChange(hhcd->pData);
 #endif
+#if ZX_PUBLISH_IRQ
+  if (urb_state == URB_DONE)
+  {
+    MyUsbTransferDone(chnum);
+  }
+#endif
 }
 /**
 * @brief  Port Port Enabled callback.
@@ -311,6 +322,24 @@ USBH_StatusTypeDef USBH_LL_ResetPort(USBH_HandleTypeDef *phost)
   return usb_status;
 }
 
+/**
+  * @brief  Assert or release the reset of the Host port without waiting.
+  * @param  phost: Host handle
+  * @param  resetActiveState: 1 - assert, 0 - release
+  * @retval USBH status
+  */
+USBH_StatusTypeDef USBH_LL_ResetPort2(USBH_HandleTypeDef *phost, uint32_t resetActiveState)
+{
+  HAL_StatusTypeDef hal_status = HAL_OK;
+  USBH_StatusTypeDef usb_status = USBH_OK;
+
+  hal_status = HAL_HCD_ResetPort2(phost->pData, resetActiveState);
+
+  usb_status = USBH_Get_USB_Status(hal_status);
+
+  return usb_status;
+}
+
 /**
   * @brief  Return the last transferred packet size.
   * @param  phost: Host handle
@@ -461,7 +490,7 @@ USBH_StatusTypeDef USBH_LL_DriverVBUS(USBH_HandleTypeDef *phost, uint8_t state)
       /* USER CODE END DRIVE_LOW_CHARGE_FOR_FS */
     }
   }
-  HAL_Delay(200);
+  /* VBUS is not switched on this board, the 200 ms wait after connection in USBH_Process is enough */
   return USBH_OK;
 }
 
@@ -522,6 +551,16 @@ void USBH_Delay(uint32_t Delay)
   HAL_Delay(Delay);
 }
 
+/**
+  * @brief  Time base for the non-blocking delays of the USB Host Library.
+  *         SOF frames do not run until the port is enabled.
+  * @retval Time in ms
+  */
+uint32_t USBH_GetTick(void)
+{
+  return HAL_GetTick();
+}
+
 /**
   * @brief  Returns the USB status depending on the HAL status:
   * @param  hal_status: HAL status
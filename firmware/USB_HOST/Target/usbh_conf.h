@@ -36,6 +36,52 @@
 
 /* USER CODE BEGIN INCLUDE */
 
+/* Lower limit of the HID interrupt IN poll interval, ms. The class default of 10 ms adds up to 10 ms
+ * to every key press. 1 honors bInterval of full speed devices as is. */
+#ifndef HID_MIN_POLL
+#define HID_MIN_POLL 1U
+#endif
+
+/* Poll HID devices every HID_POLL_OVERRIDE ms whatever bInterval says. 0 - use bInterval. */
+#ifndef HID_POLL_OVERRIDE
+#define HID_POLL_OVERRIDE 0U
+#endif
+
+/* HID report ring. 0 - HID_RING_LATEST, the reader gets the newest report. 1 - HID_RING_KEEP_ALL, the reader
+ * gets every report and the device is not polled while the ring is full. */
+#ifndef HID_RING_POLICY
+#define HID_RING_POLICY 0U
+#endif
+
+/* Do not read the manufacturer, product and serial number strings during enumeration */
+#ifndef USBH_SKIP_STRING_DESC
+#define USBH_SKIP_STRING_DESC 1U
+#endif
+
+/* Remember the configuration of this many devices, by VID/PID/bcdDevice. A known device is configured
+ * without reading its configuration and HID report descriptors. 0 - off. */
+#ifndef USBH_CFG_CACHE_SIZE
+#define USBH_CFG_CACHE_SIZE 4U
+#endif
+
+/* Bytes of class state (HID report plans of up to 4 interfaces) remembered with a cached configuration */
+#define USBH_CFG_CACHE_CLASS_SIZE 264U
+
+/* Compile the keyboard report descriptor and use report protocol, for NKRO keyboards.
+ * Keyboards with unsupported descriptors fall back to boot protocol. 0 - always boot protocol. */
+#ifndef HID_REPORT_PROTOCOL
+#define HID_REPORT_PROTOCOL 1U
+#endif
+
+/* Ports of a hub on the root port that get a device handle. The devices share the 8 host channels:
+ * 2 control, 1 hub status change, the rest HID IN endpoints. */
+#ifndef USBH_HUB_MAX_PORTS
+#define USBH_HUB_MAX_PORTS 4U
+#endif
+
+/* Host channels of the OTG FS core */
+#define USBH_MAX_PIPES_NBR 8U
+
 /* USER CODE END INCLUDE */
 
 /** @addtogroup STM32_USB_HOST_LIBRARY
@@ -65,22 +111,16 @@
 #define USBH_MAX_NUM_ENDPOINTS      2U
 
 /*----------   -----------*/
-#define USBH_MAX_NUM_INTERFACES      2U
+#define USBH_MAX_NUM_INTERFACES      4U
 
 /*----------   -----------*/
 #define USBH_MAX_NUM_CONFIGURATION      1U
 
 /*----------   -----------*/
-#define USBH_KEEP_CFG_DESCRIPTOR      1U
-
-/*----------   -----------*/
-#define USBH_MAX_NUM_SUPPORTED_CLASS      1U
-
-/*----------   -----------*/
-#define USBH_MAX_SIZE_CONFIGURATION      256U
+#define USBH_MAX_NUM_SUPPORTED_CLASS      2U
 
 /*----------   -----------*/
-#define USBH_MAX_DATA_BUFFER      512U
+#define USBH_MAX_DATA_BUFFER      64U
 
 /*----------   -----------*/
 #define USBH_DEBUG_LEVEL      0U
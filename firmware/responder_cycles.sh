@@ -0,0 +1,74 @@
+#!/bin/bash
+# Counts the cycles of the KBD_RD interrupt from the vector fetch to the GPIOA->ODR store (the zx_odr_store label
+# of Core/Src/responder_asm.s) in the linked ELF and fails if they are over the budget.
+# Usage: responder_cycles.sh objdump elf hclk_mhz budget_ns
+# Cortex-M4 TRM 3.3 timings at zero wait states. The path must be straight, without branches.
+
+OBJDUMP=$1
+ELF=$2
+MHZ=$3
+BUDGET_NS=$4
+ENTRY=12 # Exception entry, vector fetch and stacking
+
+symbol() {
+    "$OBJDUMP" -t "$ELF" | awk -v name="$1" '$NF == name { print $1; exit }'
+}
+
+START=$(symbol EXTI9_5_IRQHandler)
+STORE=$(symbol zx_odr_store)
+if [ -z "$STORE" ]; then
+    echo "KBD_RD handler: C responder, not counted"
+    exit 0
+fi
+START=$((0x$START & ~1))
+STOP=$(((0x$STORE & ~1) + 4))
+
+"$OBJDUMP" -d --start-address=$START --stop-address=$STOP "$ELF" | awk -v entry=$ENTRY -v mhz="$MHZ" \
+    -v budget_ns="$BUDGET_NS" -v store=$(printf %x $((0x$STORE & ~1))) '
+    function fail(text) {
+        print "KBD_RD handler: " text > "/dev/stderr"
+        failed = 1
+        exit 1
+    }
+    BEGIN { cycles = entry; load = "" }
+    /^ *[0-9a-f]+:\t/ || /^ *[0-9a-f]+: [0-9a-f ]+\t/ {
+        n = split($0, f, "\t")
+        # GNU objdump: "addr:", code, mnemonic, operands. LLVM: "addr: code", mnemonic, operands.
+        i = f[1] ~ /: *$/ ? 3 : 2
+        op = f[i]
+        args = i < n ? f[i + 1] : ""
+        sub(/\..*$/, "", op)
+        address = substr(f[1], 1, index(f[1], ":") - 1)
+        sub(/^[ 0]*/, "", address)
+        if (op ~ /^(b|bl|blx|bx|cbz|cbnz|it.*|tbb|tbh|pop|push|ldm.*|stm.*|ldrd|strd|[su]div)$/ || op ~ /^b(eq|ne|cs|cc|hs|lo|mi|pl|vs|vc|hi|ls|ge|lt|gt|le)$/)
+            fail(op " makes the time to the ODR store variable")
+        if (op ~ /^ldr/) {
+            # A load after a load takes 1 cycle if its address does not need the previous result
+            base = args
+            sub(/^[^[]*/, "", base)
+            cycles += load != "" && index(base, load) == 0 ? 1 : 2
+            load = args
+            sub(/,.*$/, "", load)
+        } else {
+            cycles += op ~ /^str/ ? 2 : 1
+            load = ""
+        }
+        if (address == store) {
+            found = 1
+            exit 0
+        }
+    }
+    END {
+        if (failed)
+            exit 1
+        if (!found)
+            fail("zx_odr_store not found")
+        budget = int(budget_ns * mhz / 1000)
+        printf "KBD_RD handler: %d cycles to the ODR store, %d ns at %d MHz, budget %d cycles\n", cycles,
+               cycles * 1000 / mhz, mhz, budget
+        if (cycles > budget) {
+            fflush()
+            print "KBD_RD handler: over the budget" > "/dev/stderr"
+            exit 1
+        }
+    }'
@@ -76,6 +76,40 @@ LoopCopyDataInit:
   adds r4, r0, r3
   cmp r4, r1
   bcc CopyDataInit
+
+/* Copy the SRAM code from flash, empty unless something is placed in .ramfunc */
+  ldr r0, =_sramtext
+  ldr r1, =_eramtext
+  ldr r2, =_siramtext
+  movs r3, #0
+  b LoopCopyRamText
+
+CopyRamText:
+  ldr r4, [r2, r3]
+  str r4, [r0, r3]
+  adds r3, r3, #4
+
+LoopCopyRamText:
+  adds r4, r0, r3
+  cmp r4, r1
+  bcc CopyRamText
+
+/* Copy the vector table to SRAM if space is reserved in .ram_vector, VTOR is set by the application */
+  ldr r0, =_sram_vector
+  ldr r1, =_eram_vector
+  ldr r2, =g_pfnVectors
+  movs r3, #0
+  b LoopCopyVectors
+
+CopyVectors:
+  ldr r4, [r2, r3]
+  str r4, [r0, r3]
+  adds r3, r3, #4
+
+LoopCopyVectors:
+  adds r4, r0, r3
+  cmp r4, r1
+  bcc CopyVectors
   
 /* Zero fill the bss segment. */
   ldr r2, =_sbss
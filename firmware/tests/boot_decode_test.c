@@ -0,0 +1,168 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* USBH_HID_KeybdBootDecode against the generic item parser it replaced (USBH_HID_GetKeybdInfo, HID_ReadItem with
+ * the imp_0_ items): the same boot reports must give the same modifiers and keys. Both are timed from the ring. */
+
+#include <stdint.h>
+#include <string.h>
+#include "usbh_hid.h"
+#include "test.h"
+
+#define RANDOM_REPORTS 10000
+#define TIMED_REPORTS 1000000
+
+static USBH_HandleTypeDef host;
+static USBH_ClassTypeDef hid_class;
+static HID_HandleTypeDef hid;
+
+static uint32_t random_state = 1;
+
+static uint32_t Random() {
+    random_state = random_state * 1103515245 + 12345;
+    return random_state >> 16;
+}
+
+static void Start() {
+    hid_class.pData = &hid;
+    host.pActiveClass = &hid_class;
+    hid.length = KEYBD_BOOT_REPORT_SIZE;
+    USBH_HID_RingInit(&hid.ring);
+}
+
+static void Receive(const uint8_t *report) {
+    memcpy(USBH_HID_RingWriteSlot(&hid.ring), report, KEYBD_BOOT_REPORT_SIZE);
+    USBH_HID_RingCommit(&hid.ring, KEYBD_BOOT_REPORT_SIZE);
+}
+
+/* The old path, to the same form as the boot decoder: key codes below KEY_A are error codes, not keys */
+static int DecodeItems(HID_KEYBD_BootTypeDef *boot) {
+    const HID_KEYBD_Info_TypeDef *info = USBH_HID_GetKeybdInfo(&host);
+    unsigned i;
+    if (info == NULL)
+        return 0;
+    memset(boot, 0, sizeof(*boot));
+    boot->modifiers = (uint8_t)(info->lctrl | info->lshift << 1 | info->lalt << 2 | info->lgui << 3 |
+                                info->rctrl << 4 | info->rshift << 5 | info->ralt << 6 | info->rgui << 7);
+    for (i = 0; i < sizeof(info->keys); i++)
+        if (info->keys[i] >= KEY_A)
+            boot->keys[info->keys[i] >> 5] |= 1UL << (info->keys[i] & 31);
+    return 1;
+}
+
+static int DecodeBoot(HID_KEYBD_BootTypeDef *boot) {
+    uint32_t report[HID_RING_REPORT_SIZE / sizeof(uint32_t)];
+    const uint16_t length = USBH_HID_RingRead(&hid.ring, report, hid.length);
+    if (length < KEYBD_BOOT_REPORT_SIZE)
+        return 0;
+    USBH_HID_KeybdBootDecode((const uint8_t *)report, length, boot);
+    return 1;
+}
+
+static int Same(const uint8_t *report) {
+    HID_KEYBD_BootTypeDef items, boot;
+    Receive(report);
+    CHECK(DecodeItems(&items));
+    Receive(report);
+    CHECK(DecodeBoot(&boot));
+    CHECK_EQ(boot.joystick, 0);
+    return items.modifiers == boot.modifiers && memcmp(items.keys, boot.keys, sizeof(boot.keys)) == 0;
+}
+
+static void TestReports() {
+    static const uint8_t reports[][KEYBD_BOOT_REPORT_SIZE] = {
+        {0, 0, 0, 0, 0, 0, 0, 0},
+        {0x01, 0, 0, 0, 0, 0, 0, 0},
+        {0x80, 0, 0, 0, 0, 0, 0, 0},
+        {0xFF, 0, KEY_A, 0, 0, 0, 0, 0},
+        {0x22, 0, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09},
+        {0, 0, 0, 0, 0, 0, 0, KEY_APPLICATION}, /* The last key of the boot descriptor, in the last slot */
+        {0, 0xFF, 0x1E, 0, 0x1E, 0, 0, 0},      /* Reserved byte set, the same key twice */
+        {0x02, 0, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01}, /* Rollover, too many keys: no keys, the modifiers hold */
+        {0, 0, 0x02, 0x03, 0x00, 0x00, 0x00, 0x00},    /* POST fail, undefined error */
+    };
+    unsigned i;
+    Start();
+    for (i = 0; i < sizeof(reports) / sizeof(reports[0]); i++) {
+        if (!Same(reports[i])) {
+            printf("boot report %u decodes differently\n", i);
+            test_failures++;
+        }
+    }
+}
+
+static void TestRandom() {
+    uint8_t report[KEYBD_BOOT_REPORT_SIZE];
+    unsigned n, i;
+    Start();
+    for (n = 0; n < RANDOM_REPORTS; n++) {
+        report[0] = (uint8_t)Random();
+        report[1] = 0;
+        for (i = 2; i < KEYBD_BOOT_REPORT_SIZE; i++)
+            report[i] = Random() % 3 == 0 ? 0 : (uint8_t)(Random() % (KEY_APPLICATION + 1));
+        if (!Same(report)) {
+            printf("random report %u decodes differently\n", n);
+            test_failures++;
+            break;
+        }
+    }
+}
+
+/* The one difference: the imp_0_ items stop at the logical maximum of the boot descriptor, 101, the boot
+ * decoder takes every key code keyboards send in boot protocol */
+static void TestAboveBootRange() {
+    static const uint8_t report[KEYBD_BOOT_REPORT_SIZE] = {0, 0, KEY_F13, 0, 0, 0, 0, 0};
+    HID_KEYBD_BootTypeDef items, boot;
+    Start();
+    Receive(report);
+    CHECK(DecodeItems(&items));
+    Receive(report);
+    CHECK(DecodeBoot(&boot));
+    CHECK_EQ(items.keys[KEY_F13 >> 5], 0);
+    CHECK_EQ(boot.keys[KEY_F13 >> 5], 1UL << (KEY_F13 & 31));
+}
+
+static void TestTime() {
+    static const uint8_t report[KEYBD_BOOT_REPORT_SIZE] = {0x22, 0, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09};
+    HID_KEYBD_BootTypeDef boot;
+    unsigned n, decoded = 0;
+    uint64_t start, items_ns, boot_ns;
+    Start();
+    start = Now();
+    for (n = 0; n < TIMED_REPORTS; n++) {
+        Receive(report);
+        decoded += DecodeItems(&boot);
+    }
+    items_ns = Now() - start;
+    start = Now();
+    for (n = 0; n < TIMED_REPORTS; n++) {
+        Receive(report);
+        decoded += DecodeBoot(&boot);
+    }
+    boot_ns = Now() - start;
+    CHECK_EQ(decoded, 2 * TIMED_REPORTS);
+    printf("Boot report from the ring: items %.1f ns, boot decoder %.1f ns\n", (double)items_ns / TIMED_REPORTS,
+           (double)boot_ns / TIMED_REPORTS);
+}
+
+int main() {
+    TestReports();
+    TestRandom();
+    TestAboveBootRange();
+    TestTime();
+    return TestResult("boot_decode");
+}
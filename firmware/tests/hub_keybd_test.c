@@ -0,0 +1,213 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Two boot keyboards on two ports of a hub, with the HID class: their reports merge into one key matrix the way
+ * ZxMatrixFromDevices in my.c merges them, a key is down while it is down on either keyboard. The cost of
+ * polling a keyboard is measured against the hub alone. */
+
+#include <stdint.h>
+#include <string.h>
+#include "usb_sim.h"
+#include "usbh_hub.h"
+#include "usbh_hid.h"
+#include "test.h"
+
+#define TIMED_MS 1000000
+
+#define ARRAY_SIZE(A) (sizeof(A) / sizeof(A[0]))
+
+static const uint8_t kbd_report_desc[] = {
+    0x05, 0x01, 0x09, 0x06, 0xA1, 0x01, 0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7, 0x15, 0x00, 0x25, 0x01,
+    0x75, 0x01, 0x95, 0x08, 0x81, 0x02, 0x95, 0x01, 0x75, 0x08, 0x81, 0x01, 0x95, 0x05, 0x75, 0x01,
+    0x05, 0x08, 0x19, 0x01, 0x29, 0x05, 0x91, 0x02, 0x95, 0x01, 0x75, 0x03, 0x91, 0x01, 0x95, 0x06,
+    0x75, 0x08, 0x15, 0x00, 0x25, 0x65, 0x05, 0x07, 0x19, 0x00, 0x29, 0x65, 0x81, 0x00, 0xC0,
+};
+
+#define LEFT_CTRL 0x01
+#define LEFT_SHIFT 0x02
+
+static USBH_HandleTypeDef root;
+
+static SimDevice hub = SIM_HUB();
+static SimDevice fs_kbd = SIM_FS_KBD(.report_desc = kbd_report_desc, .report_desc_size = sizeof(kbd_report_desc));
+static SimDevice ls_kbd = SIM_LS_KBD(.report_desc = kbd_report_desc, .report_desc_size = sizeof(kbd_report_desc));
+
+static void UserProcess(USBH_HandleTypeDef *phost, uint8_t id) {
+    (void)phost;
+    (void)id;
+}
+
+static void Start() {
+    SimInit();
+    memset(&root, 0, sizeof(root));
+    (void)USBH_Init(&root, UserProcess, 0);
+    (void)USBH_RegisterClass(&root, USBH_HUB_CLASS);
+    (void)USBH_RegisterClass(&root, USBH_HID_CLASS);
+    (void)USBH_Start(&root);
+    SimConnectRoot(&root, &hub);
+    SimRun(&root, 1000);
+    CHECK_EQ(root.gState, HOST_CLASS);
+}
+
+static void Finish() {
+    SimDisconnectRoot(&root);
+    SimRun(&root, 10);
+    CHECK_EQ(root.gState, HOST_IDLE);
+    CHECK_EQ(sim_errors, 0);
+}
+
+/* The HID devices behind the hub, as UsbHidDevices in my.c finds them */
+static unsigned Devices(USBH_HandleTypeDef **devices) {
+    unsigned count = 0;
+    uint8_t port;
+    for (port = 1; port <= SIM_HUB_PORTS; port++) {
+        USBH_HandleTypeDef *device = USBH_HUB_GetDevice(&root, port);
+        if (device != NULL && device->gState == HOST_CLASS && device->pActiveClass->ClassCode == USB_HID_CLASS)
+            devices[count++] = device;
+    }
+    return count;
+}
+
+/* Reads new reports like MyKeysTask, then merges the keys of all keyboards. Returns false without new reports. */
+static bool Keys(HID_KEYBD_BootTypeDef *keys) {
+    USBH_HandleTypeDef *devices[SIM_HUB_PORTS];
+    const unsigned count = Devices(devices);
+    bool fresh = false;
+    unsigned d, i;
+    for (d = 0; d < count; d++)
+        if (USBH_HID_GetKeybdBoot(devices[d]) != NULL)
+            fresh = true;
+    memset(keys, 0, sizeof(*keys));
+    for (d = 0; d < count; d++) {
+        const HID_KEYBD_BootTypeDef *boot = USBH_HID_KeybdMerge(devices[d]->pActiveClass->pData);
+        keys->modifiers |= boot->modifiers;
+        keys->joystick |= boot->joystick;
+        for (i = 0; i < ARRAY_SIZE(keys->keys); i++)
+            keys->keys[i] |= boot->keys[i];
+    }
+    return fresh;
+}
+
+static void Press(SimDevice *d, uint8_t modifiers, uint8_t key1, uint8_t key2) {
+    const uint8_t report[KEYBD_BOOT_REPORT_SIZE] = {modifiers, 0, key1, key2};
+    memcpy(d->report, report, sizeof(report));
+    d->report_size = sizeof(report);
+}
+
+static bool KeyDown(const HID_KEYBD_BootTypeDef *keys, uint8_t key) {
+    return (keys->keys[key / 32] >> (key % 32) & 1) != 0;
+}
+
+static unsigned KeysDown(const HID_KEYBD_BootTypeDef *keys) {
+    unsigned i, n = 0;
+    for (i = 0; i < ARRAY_SIZE(keys->keys); i++)
+        n += __builtin_popcount(keys->keys[i]);
+    return n;
+}
+
+static void TestMerge() {
+    USBH_HandleTypeDef *devices[SIM_HUB_PORTS];
+    HID_KEYBD_BootTypeDef keys;
+    Start();
+    SimPlug(1, &fs_kbd);
+    SimPlug(3, &ls_kbd);
+    SimRun(&root, 1000);
+    CHECK_EQ(Devices(devices), 2);
+    CHECK_EQ(fs_kbd.configuration, 1);
+    CHECK_EQ(ls_kbd.configuration, 1);
+    CHECK(!Keys(&keys));
+
+    /* Shift and A on one, Ctrl and B on the other */
+    Press(&fs_kbd, LEFT_SHIFT, KEY_A, 0);
+    Press(&ls_kbd, LEFT_CTRL, KEY_B, 0);
+    SimRun(&root, 20);
+    CHECK_EQ(fs_kbd.report_size, 0);
+    CHECK_EQ(ls_kbd.report_size, 0);
+    CHECK(Keys(&keys));
+    CHECK_EQ(keys.modifiers, LEFT_SHIFT | LEFT_CTRL);
+    CHECK(KeyDown(&keys, KEY_A));
+    CHECK(KeyDown(&keys, KEY_B));
+    CHECK_EQ(KeysDown(&keys), 2);
+    CHECK(!Keys(&keys)); /* Read once */
+
+    /* Released on one, the keys of the other stay */
+    Press(&fs_kbd, 0, 0, 0);
+    SimRun(&root, 20);
+    CHECK(Keys(&keys));
+    CHECK_EQ(keys.modifiers, LEFT_CTRL);
+    CHECK(KeyDown(&keys, KEY_B));
+    CHECK_EQ(KeysDown(&keys), 1);
+
+    /* The same key on both is down until both release it */
+    Press(&fs_kbd, 0, KEY_B, KEY_C);
+    SimRun(&root, 20);
+    CHECK(Keys(&keys));
+    CHECK_EQ(KeysDown(&keys), 2);
+    Press(&ls_kbd, 0, 0, 0);
+    SimRun(&root, 20);
+    CHECK(Keys(&keys));
+    CHECK_EQ(keys.modifiers, 0);
+    CHECK(KeyDown(&keys, KEY_B));
+    CHECK(KeyDown(&keys, KEY_C));
+    CHECK_EQ(KeysDown(&keys), 2);
+
+    /* Unplugged with keys down, its keys go with it */
+    Press(&ls_kbd, 0, KEY_D, 0);
+    SimRun(&root, 20);
+    CHECK(Keys(&keys));
+    CHECK_EQ(KeysDown(&keys), 3);
+    SimUnplug(3);
+    SimRun(&root, 100);
+    CHECK_EQ(Devices(devices), 1);
+    Keys(&keys);
+    CHECK(!KeyDown(&keys, KEY_D));
+    CHECK_EQ(KeysDown(&keys), 2);
+    Finish();
+}
+
+/* Host time of a millisecond of the USB host with the hub alone, then with one and two keyboards sending nothing */
+static void TestPollCost() {
+    uint64_t ns[3];
+    uint32_t polls;
+    unsigned n;
+    for (n = 0; n <= 2; n++) {
+        Start();
+        if (n >= 1)
+            SimPlug(1, &fs_kbd);
+        if (n >= 2)
+            SimPlug(3, &ls_kbd);
+        SimRun(&root, 1000);
+        fs_kbd.polls = 0;
+        ls_kbd.polls = 0;
+        const uint64_t start = Now();
+        SimRun(&root, TIMED_MS);
+        ns[n] = Now() - start;
+        polls = fs_kbd.polls + ls_kbd.polls;
+        /* bInterval 10 ms, each keyboard once per interval */
+        CHECK(polls >= n * (TIMED_MS / 10 - 1) && polls <= n * (TIMED_MS / 10 + 1));
+        Finish();
+    }
+    printf("USB host per ms: hub %.1f ns, 1 keyboard +%.1f ns, 2 keyboards +%.1f ns, %.0f ns per keyboard poll\n",
+           (double)ns[0] / TIMED_MS, (double)(ns[1] - ns[0]) / TIMED_MS, (double)(ns[2] - ns[0]) / TIMED_MS,
+           (double)(ns[2] - ns[0]) / polls);
+}
+
+int main() {
+    TestMerge();
+    TestPollCost();
+    return TestResult("hub_keybd");
+}
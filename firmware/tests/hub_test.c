@@ -0,0 +1,294 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The hub class and the core on a simulated host port: port changes, enumeration of the devices behind the hub
+ * one at a time and their turns on the control pipes of the root port. */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "usb_sim.h"
+#include "usbh_hub.h"
+#include "test.h"
+
+/* A keyboard class that opens its interrupt pipe and sends SET_IDLE */
+
+typedef struct {
+    uint8_t pipe;
+} KbdHandle;
+
+static unsigned kbd_inits[SIM_HUB_PORTS + 1];
+static unsigned kbd_deinits[SIM_HUB_PORTS + 1];
+
+static USBH_StatusTypeDef KbdInit(USBH_HandleTypeDef *phost) {
+    USBH_EpDescTypeDef *ep = &phost->device.CfgDesc.Itf_Desc[0].Ep_Desc[0];
+    KbdHandle *kbd = malloc(sizeof(KbdHandle));
+    kbd->pipe = USBH_AllocPipe(phost, ep->bEndpointAddress);
+    (void)USBH_OpenPipe(phost, kbd->pipe, ep->bEndpointAddress, phost->device.address, phost->device.speed,
+                        USB_EP_TYPE_INTR, ep->wMaxPacketSize);
+    phost->pActiveClass->pData = kbd;
+    kbd_inits[phost->hub_port]++;
+    return USBH_OK;
+}
+
+static USBH_StatusTypeDef KbdDeInit(USBH_HandleTypeDef *phost) {
+    KbdHandle *kbd = phost->pActiveClass->pData;
+    (void)USBH_ClosePipe(phost, kbd->pipe);
+    (void)USBH_FreePipe(phost, kbd->pipe);
+    free(kbd);
+    phost->pActiveClass->pData = NULL;
+    kbd_deinits[phost->hub_port]++;
+    return USBH_OK;
+}
+
+static USBH_StatusTypeDef KbdRequests(USBH_HandleTypeDef *phost) {
+    phost->Control.setup.b.bmRequestType = USB_H2D | USB_REQ_RECIPIENT_INTERFACE | USB_REQ_TYPE_CLASS;
+    phost->Control.setup.b.bRequest = 0x0A; /* SET_IDLE */
+    phost->Control.setup.b.wValue.w = 0U;
+    phost->Control.setup.b.wIndex.w = 0U;
+    phost->Control.setup.b.wLength.w = 0U;
+    return USBH_CtlReq(phost, NULL, 0U);
+}
+
+static USBH_StatusTypeDef KbdProcess(USBH_HandleTypeDef *phost) {
+    (void)phost;
+    return USBH_OK;
+}
+
+static USBH_ClassTypeDef kbd_class = {"KBD", 0x03, KbdInit, KbdDeInit, KbdRequests, KbdProcess, KbdProcess, NULL};
+
+static void UserProcess(USBH_HandleTypeDef *phost, uint8_t id) {
+    (void)phost;
+    (void)id;
+}
+
+static USBH_HandleTypeDef root;
+
+static SimDevice hub = SIM_HUB();
+static SimDevice fs_kbd = SIM_FS_KBD();
+static SimDevice ls_kbd = SIM_LS_KBD();
+
+static unsigned PipesInUse() {
+    unsigned i, n = 0;
+    for (i = 0; i < USBH_MAX_PIPES_NBR; i++)
+        if ((root.Pipes[i] & 0x8000U) != 0)
+            n++;
+    return n;
+}
+
+static void Start() {
+    SimInit();
+    memset(&root, 0, sizeof(root));
+    (void)USBH_Init(&root, UserProcess, 0);
+    (void)USBH_RegisterClass(&root, USBH_HUB_CLASS);
+    (void)USBH_RegisterClass(&root, &kbd_class);
+    (void)USBH_Start(&root);
+    memset(kbd_inits, 0, sizeof(kbd_inits));
+    memset(kbd_deinits, 0, sizeof(kbd_deinits));
+}
+
+/* The hub is removed at the end of every test, the devices behind it go with it */
+static void Finish() {
+    unsigned port;
+    SimDisconnectRoot(&root);
+    SimRun(&root, 10);
+    CHECK_EQ(root.gState, HOST_IDLE);
+    CHECK(root.pCtlOwner == NULL);
+    CHECK_EQ(PipesInUse(), 0);
+    for (port = 1; port <= SIM_HUB_PORTS; port++)
+        CHECK_EQ(kbd_deinits[port], kbd_inits[port]);
+    CHECK_EQ(sim_errors, 0);
+}
+
+static void TestHub() {
+    HUB_HandleTypeDef *h;
+    unsigned port;
+    Start();
+    SimConnectRoot(&root, &hub);
+    SimRun(&root, 1000);
+    CHECK_EQ(root.gState, HOST_CLASS);
+    CHECK(root.pActiveClass == USBH_HUB_CLASS);
+    CHECK_EQ(root.device.address, USBH_DEVICE_ADDRESS);
+    CHECK_EQ(hub.address, USBH_DEVICE_ADDRESS);
+    CHECK_EQ(hub.configuration, 1);
+    h = root.pActiveClass->pData;
+    CHECK_EQ(h->NbrPorts, SIM_HUB_PORTS);
+    CHECK_EQ(h->state, HUB_IDLE);
+    for (port = 1; port <= SIM_HUB_PORTS; port++) {
+        CHECK_EQ(SimPortStatus(port), SIM_PORT_POWER);
+        CHECK_EQ(USBH_HUB_GetDevice(&root, port)->gState, HOST_IDLE);
+    }
+    CHECK(USBH_HUB_GetDevice(&root, SIM_HUB_PORTS + 1) == NULL);
+    CHECK_EQ(PipesInUse(), 3); /* Control pipes and the status change endpoint */
+    Finish();
+}
+
+/* Plugged in together, a full and a low speed device are reset one at a time and take turns on the control pipes */
+/* The port reset only waits, the scheduler does not run USBH_Process back to back through it */
+static void TestWaitPending() {
+    unsigned ms;
+    Start();
+    SimConnectRoot(&root, &hub);
+    for (ms = 0; ms < 1000 && root.gState != HOST_DEV_RESET; ms++)
+        SimRun(&root, 1);
+    CHECK_EQ(root.gState, HOST_DEV_RESET);
+    CHECK_EQ(USBH_WaitPending(&root), 1);
+    SimRun(&root, 90);
+    CHECK_EQ(root.gState, HOST_DEV_RESET);
+    CHECK_EQ(USBH_WaitPending(&root), 1);
+    SimRun(&root, 20);
+    CHECK(root.gState != HOST_DEV_RESET);
+    SimRun(&root, 1000);
+    CHECK_EQ(root.gState, HOST_CLASS);
+    CHECK_EQ(USBH_WaitPending(&root), 0);
+    Finish();
+}
+
+static void TestTwoDevices() {
+    USBH_HandleTypeDef *fs, *ls;
+    Start();
+    SimConnectRoot(&root, &hub);
+    SimRun(&root, 1000);
+    SimPlug(1, &fs_kbd);
+    SimPlug(3, &ls_kbd);
+    SimRun(&root, 1000);
+
+    fs = USBH_HUB_GetDevice(&root, 1);
+    ls = USBH_HUB_GetDevice(&root, 3);
+    CHECK_EQ(fs->gState, HOST_CLASS);
+    CHECK_EQ(ls->gState, HOST_CLASS);
+    CHECK_EQ(USBH_HUB_GetDevice(&root, 2)->gState, HOST_IDLE);
+
+    /* Numbered after the ports */
+    CHECK_EQ(fs->device.address, USBH_DEVICE_ADDRESS + 1);
+    CHECK_EQ(ls->device.address, USBH_DEVICE_ADDRESS + 3);
+    CHECK_EQ(fs_kbd.address, USBH_DEVICE_ADDRESS + 1);
+    CHECK_EQ(ls_kbd.address, USBH_DEVICE_ADDRESS + 3);
+
+    CHECK_EQ(fs->device.speed, USBH_SPEED_FULL);
+    CHECK_EQ(ls->device.speed, USBH_SPEED_LOW);
+    CHECK_EQ(fs_kbd.configuration, 1);
+    CHECK_EQ(ls_kbd.configuration, 1);
+    CHECK_EQ(fs_kbd.class_requests, 1);
+    CHECK_EQ(ls_kbd.class_requests, 1);
+    CHECK_EQ(kbd_inits[1], 1);
+    CHECK_EQ(kbd_inits[3], 1);
+
+    /* Every change is acknowledged, the control pipes are free */
+    CHECK_EQ(SimPortChange(1), 0);
+    CHECK_EQ(SimPortChange(3), 0);
+    CHECK(root.pCtlOwner == NULL);
+    CHECK(sim_ctl_switches > 2);
+    CHECK_EQ(PipesInUse(), 5);
+    Finish();
+}
+
+/* An unplugged device is deinitialized, the other one keeps running, plugged in again it comes back */
+static void TestUnplug() {
+    USBH_HandleTypeDef *fs, *ls;
+    Start();
+    SimConnectRoot(&root, &hub);
+    SimPlug(1, &fs_kbd);
+    SimPlug(3, &ls_kbd);
+    SimRun(&root, 2000);
+    fs = USBH_HUB_GetDevice(&root, 1);
+    ls = USBH_HUB_GetDevice(&root, 3);
+    CHECK_EQ(fs->gState, HOST_CLASS);
+    CHECK_EQ(ls->gState, HOST_CLASS);
+
+    SimUnplug(1);
+    SimRun(&root, 100);
+    CHECK_EQ(fs->gState, HOST_IDLE);
+    CHECK_EQ(fs->device.is_connected, 0);
+    CHECK_EQ(kbd_deinits[1], 1);
+    CHECK_EQ(ls->gState, HOST_CLASS);
+    CHECK_EQ(SimPortChange(1), 0);
+    CHECK_EQ(PipesInUse(), 4);
+
+    /* A low speed device on the port of the full speed one */
+    SimUnplug(3);
+    SimPlug(1, &ls_kbd);
+    SimRun(&root, 1000);
+    CHECK_EQ(fs->gState, HOST_CLASS);
+    CHECK_EQ(fs->device.speed, USBH_SPEED_LOW);
+    CHECK_EQ(fs->device.address, USBH_DEVICE_ADDRESS + 1);
+    CHECK_EQ(ls->gState, HOST_IDLE);
+    CHECK_EQ(kbd_inits[1], 2);
+    CHECK_EQ(kbd_deinits[3], 1);
+    Finish();
+}
+
+/* A device unplugged while it has the control pipes gives them up, the next device gets them */
+static void TestUnplugDuringEnumeration() {
+    USBH_HandleTypeDef *dev;
+    unsigned ms;
+    Start();
+    SimConnectRoot(&root, &hub);
+    SimRun(&root, 1000);
+    SimPlug(2, &fs_kbd);
+    dev = USBH_HUB_GetDevice(&root, 2);
+    for (ms = 0; ms < 1000 && !(root.pCtlOwner == dev && dev->gState == HOST_ENUMERATION); ms++)
+        SimRun(&root, 1);
+    CHECK(root.pCtlOwner == dev);
+    CHECK_EQ(dev->gState, HOST_ENUMERATION);
+
+    SimUnplug(2);
+    SimRun(&root, 100);
+    CHECK(root.pCtlOwner == NULL);
+    CHECK_EQ(dev->gState, HOST_IDLE);
+    CHECK_EQ(SimPortChange(2), 0);
+
+    SimPlug(4, &ls_kbd);
+    SimRun(&root, 1000);
+    CHECK_EQ(USBH_HUB_GetDevice(&root, 4)->gState, HOST_CLASS);
+    CHECK_EQ(ls_kbd.address, USBH_DEVICE_ADDRESS + 4);
+    Finish();
+}
+
+/* The devices go with the hub and come back with it */
+static void TestHubRemoved() {
+    Start();
+    SimConnectRoot(&root, &hub);
+    SimPlug(1, &fs_kbd);
+    SimPlug(2, &ls_kbd);
+    SimRun(&root, 2000);
+    CHECK_EQ(USBH_HUB_GetDevice(&root, 1)->gState, HOST_CLASS);
+    CHECK_EQ(USBH_HUB_GetDevice(&root, 2)->gState, HOST_CLASS);
+    Finish();
+    CHECK_EQ(kbd_deinits[1], 1);
+    CHECK_EQ(kbd_deinits[2], 1);
+
+    /* And back */
+    Start();
+    SimConnectRoot(&root, &hub);
+    SimPlug(1, &fs_kbd);
+    SimPlug(2, &ls_kbd);
+    SimRun(&root, 2000);
+    CHECK_EQ(USBH_HUB_GetDevice(&root, 1)->gState, HOST_CLASS);
+    CHECK_EQ(USBH_HUB_GetDevice(&root, 2)->gState, HOST_CLASS);
+    Finish();
+}
+
+int main() {
+    TestHub();
+    TestWaitPending();
+    TestTwoDevices();
+    TestUnplug();
+    TestUnplugDuringEnumeration();
+    TestHubRemoved();
+    return TestResult("hub");
+}
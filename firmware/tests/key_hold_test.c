@@ -0,0 +1,277 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Short tap stretching against traces of keyboard reports and ZX keyboard scans */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "key_hold.h"
+#include "test.h"
+
+/* One trace step: a report with keys, between or during keyboard scans, or the end of a keyboard scan,
+ * then the keys the ZX sees.
+ * Keys are rows 0 (bits 0-7) and 5 (bits 8-15), bits 5-7 of a row are RESET, MAGIC and modes. */
+typedef struct {
+    char op; /* 'R' - report, 'D' - report during a scan, 'S' - end of a scan */
+    uint16_t keys;
+    uint16_t visible;
+} Step;
+
+#define A 0x0001   /* Row 0, D0 */
+#define B 0x0002   /* Row 0, D1 */
+#define P 0x0100   /* Row 5, D0 */
+#define M 0x0020   /* Row 0, bit 5, not a key line */
+#define END {0, 0, 0}
+
+static void ToMatrix(uint8_t *m, uint16_t keys) {
+    memset(m, 0, ZX_MATRIX_ROWS);
+    m[0] = (uint8_t)keys;
+    m[5] = (uint8_t)(keys >> 8);
+}
+
+static uint16_t FromMatrix(const uint8_t *m) {
+    unsigned r;
+    for (r = 0; r < ZX_MATRIX_ROWS; r++)
+        if (r != 0 && r != 5 && m[r] != 0)
+            return 0xFFFF;
+    return (uint16_t)(m[0] | m[5] << 8);
+}
+
+static void RunTrace(const char *name, unsigned scans, const Step *steps) {
+    KeyHold h;
+    uint8_t m[ZX_MATRIX_ROWS];
+    uint16_t prev = 0;
+    unsigned i;
+    KeyHoldInit(&h, scans);
+    for (i = 0; steps[i].op != 0; i++) {
+        const Step *s = &steps[i];
+        uint16_t visible;
+        if (s->op == 'R' || s->op == 'D') {
+            ToMatrix(m, s->keys);
+            visible = FromMatrix(KeyHoldReport(&h, m, s->op == 'D'));
+        } else {
+            const bool changed = KeyHoldScan(&h);
+            visible = FromMatrix(h.visible);
+            if (changed != (visible != prev)) {
+                printf("%s, step %u: scan returned %d\n", name, i, changed);
+                test_failures++;
+            }
+        }
+        if (visible != s->visible) {
+            printf("%s, step %u: visible %04X, expected %04X\n", name, i, visible, s->visible);
+            test_failures++;
+        }
+        prev = visible;
+    }
+}
+
+/* A tap between two scans is seen by the next 2 scans */
+static const Step tap[] = {
+    {'S', 0, 0}, {'R', A, A}, {'R', 0, A}, {'S', 0, A}, {'S', 0, 0}, {'S', 0, 0}, END,
+};
+
+/* A key held over many scans is released with the report, its hold is over */
+static const Step hold[] = {
+    {'R', A, A}, {'S', 0, A}, {'S', 0, A}, {'S', 0, A}, {'S', 0, A}, {'R', 0, 0}, {'S', 0, 0}, END,
+};
+
+/* A tap during a scan that has read its row already, the next 2 scans see it */
+static const Step during[] = {
+    {'D', A, A}, {'R', 0, A}, {'S', 0, A}, {'S', 0, A}, {'S', 0, 0}, END,
+};
+
+/* Held from a scan to the next one, it stays for one more after the release */
+static const Step during_hold[] = {
+    {'D', A, A}, {'S', 0, A}, {'R', 0, A}, {'S', 0, A}, {'S', 0, 0}, END,
+};
+
+/* Released after one scan, it stays for one more */
+static const Step one_scan[] = {
+    {'R', A, A}, {'S', 0, A}, {'R', 0, A}, {'S', 0, 0}, END,
+};
+
+/* Pressed again during the hold, the count starts over */
+static const Step again[] = {
+    {'R', A, A}, {'R', 0, A}, {'S', 0, A}, {'R', A, A}, {'R', 0, A}, {'S', 0, A}, {'S', 0, 0}, END,
+};
+
+/* Keys are held one by one, in different rows too */
+static const Step keys[] = {
+    {'R', A, A}, {'R', 0, A}, {'S', 0, A},
+    {'R', B | P, A | B | P}, {'R', 0, A | B | P}, {'S', 0, B | P},
+    {'R', P, B | P}, {'S', 0, P}, {'R', 0, P}, {'S', 0, 0}, END,
+};
+
+/* RESET, MAGIC and modes follow the reports */
+static const Step not_keys[] = {
+    {'R', M, M}, {'R', 0, 0}, {'R', A | M, A | M}, {'R', 0, A}, {'S', 0, A}, {'S', 0, 0}, END,
+};
+
+static const Step one[] = {
+    {'R', A, A}, {'R', 0, A}, {'S', 0, 0}, END,
+};
+
+static const Step off[] = {
+    {'R', A, A}, {'R', 0, 0}, {'S', 0, 0}, END,
+};
+
+/* The same report again is not a new press */
+static const Step repeat[] = {
+    {'R', A, A}, {'S', 0, A}, {'R', A, A}, {'S', 0, A}, {'R', 0, 0}, END,
+};
+
+/* Generated typing. Keystrokes of 40 keys with rollover at millisecond times, the ZX scans every 20 ms between
+ * them. The ZX takes a key that was up in the last scan and is down now as a press, like the ROM does. Each
+ * keystroke must give it exactly one press: none is dropped, none is doubled. */
+
+#define TYPING_KEYS 40
+#define TYPING_STROKES 20000
+#define TYPING_SCAN_US 20000
+#define TYPING_SCAN_PHASE_US 7500 /* Scans fall between the reports */
+#define TYPING_SAME_KEY_MS 100    /* From a release to the next press of the same key */
+
+typedef struct {
+    uint8_t key;
+    uint32_t press, release; /* us */
+    unsigned seen;           /* Presses the ZX took */
+} Stroke;
+
+typedef struct {
+    uint32_t time;
+    unsigned stroke;
+    bool down;
+} TypingEvent;
+
+static Stroke strokes[TYPING_STROKES];
+static TypingEvent typing_events[2 * TYPING_STROKES];
+
+static uint32_t random_state;
+
+static uint32_t Random(uint32_t min, uint32_t max) {
+    random_state = random_state * 1103515245 + 12345;
+    return min + (random_state >> 16) % (max - min + 1);
+}
+
+static int CompareEvents(const void *a, const void *b) {
+    const TypingEvent *x = a, *y = b;
+    return x->time < y->time ? -1 : x->time > y->time;
+}
+
+/* Strokes held hold_min-hold_max ms, pressed every 20-120 ms */
+static void Type(uint32_t seed, unsigned hold_min, unsigned hold_max) {
+    uint32_t released[TYPING_KEYS] = {0};
+    uint32_t t = 0;
+    unsigned i;
+    random_state = seed;
+    for (i = 0; i < TYPING_STROKES; i++) {
+        Stroke *s = &strokes[i];
+        t += Random(20, 120) * 1000;
+        do
+            s->key = Random(0, TYPING_KEYS - 1);
+        while (released[s->key] != 0 && t < released[s->key] + TYPING_SAME_KEY_MS * 1000);
+        s->press = t;
+        s->release = t + Random(hold_min, hold_max) * 1000;
+        released[s->key] = s->release;
+        typing_events[2 * i] = (TypingEvent){s->press, i, true};
+        typing_events[2 * i + 1] = (TypingEvent){s->release, i, false};
+    }
+    qsort(typing_events, 2 * TYPING_STROKES, sizeof(TypingEvent), CompareEvents);
+}
+
+/* Returns the number of dropped keystrokes, checks for doubled ones */
+static unsigned RunTyping(const char *name, unsigned scans) {
+    KeyHold h;
+    uint8_t m[ZX_MATRIX_ROWS], zx_seen[ZX_MATRIX_ROWS];
+    unsigned last[TYPING_KEYS] = {0}; /* Last stroke of a key */
+    const uint32_t end = typing_events[2 * TYPING_STROKES - 1].time + (scans + 2) * TYPING_SCAN_US;
+    uint32_t scan = TYPING_SCAN_PHASE_US;
+    unsigned i = 0, dropped = 0, doubled = 0;
+    memset(m, 0, sizeof(m));
+    memset(zx_seen, 0, sizeof(zx_seen));
+    for (i = 0; i < TYPING_STROKES; i++)
+        strokes[i].seen = 0;
+    i = 0;
+    KeyHoldInit(&h, scans);
+    KeyHoldReport(&h, m, false);
+    while (scan < end) {
+        if (i < 2 * TYPING_STROKES && typing_events[i].time < scan) {
+            const TypingEvent *e = &typing_events[i++];
+            const uint8_t key = strokes[e->stroke].key;
+            if (e->down) {
+                m[key / KEY_HOLD_BITS] |= 1 << (key % KEY_HOLD_BITS);
+                last[key] = e->stroke;
+            } else {
+                m[key / KEY_HOLD_BITS] &= ~(1 << (key % KEY_HOLD_BITS));
+            }
+            KeyHoldReport(&h, m, false);
+            continue;
+        }
+        unsigned r;
+        for (r = 0; r < ZX_MATRIX_ROWS; r++) {
+            unsigned pressed = h.visible[r] & ~zx_seen[r] & KEY_HOLD_MASK;
+            while (pressed != 0) {
+                strokes[last[r * KEY_HOLD_BITS + __builtin_ctz(pressed)]].seen++;
+                pressed &= pressed - 1;
+            }
+            zx_seen[r] = h.visible[r];
+        }
+        KeyHoldScan(&h);
+        scan += TYPING_SCAN_US;
+    }
+    for (i = 0; i < TYPING_STROKES; i++) {
+        if (strokes[i].seen == 0)
+            dropped++;
+        else if (strokes[i].seen > 1)
+            doubled++;
+    }
+    if (doubled != 0) {
+        printf("%s: %u of %u keystrokes doubled\n", name, doubled, TYPING_STROKES);
+        test_failures++;
+    }
+    return dropped;
+}
+
+static void TestTyping() {
+    /* Held longer than a scan period: nothing is lost with the hold on or off */
+    Type(1, 30, 150);
+    CHECK_EQ(RunTyping("typing, hold 2", 2), 0);
+    CHECK_EQ(RunTyping("typing, hold off", 0), 0);
+
+    /* Taps shorter than a scan period: only the hold keeps them all */
+    Type(2, 3, 19);
+    CHECK_EQ(RunTyping("taps, hold 2", 2), 0);
+    CHECK_EQ(RunTyping("taps, hold 1", 1), 0);
+    CHECK(RunTyping("taps, hold off", 0) > 0);
+}
+
+int main() {
+    RunTrace("tap", 2, tap);
+    RunTrace("hold", 2, hold);
+    RunTrace("during", 2, during);
+    RunTrace("during_hold", 2, during_hold);
+    RunTrace("one_scan", 2, one_scan);
+    RunTrace("again", 2, again);
+    RunTrace("keys", 2, keys);
+    RunTrace("not_keys", 2, not_keys);
+    RunTrace("repeat", 2, repeat);
+    RunTrace("scans 1", 1, one);
+    RunTrace("scans 0", 0, off);
+    TestTyping();
+    return TestResult("key_hold");
+}
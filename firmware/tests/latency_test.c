@@ -0,0 +1,242 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Latency accounting of the KBD_RD interrupt handler, fed with synthetic edge and write times, then the handler
+ * of responder.c itself on simulated registers */
+
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include "stm32f4xx.h"
+#include "latency.h"
+#include "responder.h"
+#include "test.h"
+
+static LatencyRecorder recorder;
+
+static void TestEmpty() {
+    LatencySummary s;
+    LatencyRecorderInit(&recorder);
+    LatencyTake(&recorder, &s);
+    CHECK_EQ(s.total, 0);
+    CHECK_EQ(s.min, 0);
+    CHECK_EQ(s.max, 0);
+    CHECK_EQ(s.p50, 0);
+}
+
+static void TestBuckets() {
+    LatencySummary s;
+    unsigned i;
+    LatencyRecorderInit(&recorder);
+    /* 1000 reads: 900 at 30 cycles, 95 at 40, 4 at 100, one at 200 */
+    for (i = 0; i < 900; i++)
+        LatencyRecord(&recorder, 1000 + i * 100, 1000 + i * 100 + 30);
+    for (i = 0; i < 95; i++)
+        LatencyRecord(&recorder, 5000, 5040);
+    for (i = 0; i < 4; i++)
+        LatencyRecord(&recorder, 7000, 7100);
+    LatencyRecord(&recorder, 9000, 9200);
+
+    CHECK_EQ(recorder.active->count[30], 900);
+    CHECK_EQ(recorder.active->count[40], 95);
+    CHECK_EQ(recorder.active->count[100], 4);
+    CHECK_EQ(recorder.active->count[200], 1);
+
+    LatencyTake(&recorder, &s);
+    CHECK_EQ(s.total, 1000);
+    CHECK_EQ(s.min, 30);
+    CHECK_EQ(s.max, 200);
+    CHECK_EQ(s.p50, 30);
+    CHECK_EQ(s.p99, 40);
+    CHECK_EQ(s.p999, 100);
+}
+
+/* The timers wrap, a write just after the wrap is still a short latency */
+static void TestWrap() {
+    LatencySummary s;
+    LatencyRecorderInit(&recorder);
+    LatencyRecord(&recorder, 0xFFFFFFF0, 0x00000005);
+    LatencyTake(&recorder, &s);
+    CHECK_EQ(s.total, 1);
+    CHECK_EQ(s.max, 0x15);
+}
+
+/* Longer than the histogram goes to the last bucket, the max stays exact with the write time */
+static void TestOverflow() {
+    LatencySummary s;
+    LatencyRecorderInit(&recorder);
+    LatencyRecord(&recorder, 0, LATENCY_BUCKETS - 1);
+    LatencyRecord(&recorder, 0, LATENCY_BUCKETS);
+    LatencyRecord(&recorder, 1000, 101000);
+    LatencyRecord(&recorder, 200000, 200300);
+    CHECK_EQ(recorder.active->count[LATENCY_BUCKETS - 1], 4);
+    LatencyTake(&recorder, &s);
+    CHECK_EQ(s.total, 4);
+    CHECK_EQ(s.max, 100000);
+    CHECK_EQ(s.max_at, 101000);
+    CHECK_EQ(s.p999, LATENCY_BUCKETS - 1);
+}
+
+/* Every report starts from zero, reads between the reports go to the other histogram */
+static void TestReset() {
+    LatencySummary s;
+    LatencyRecorderInit(&recorder);
+    LatencyRecord(&recorder, 0, 50);
+    LatencyRecord(&recorder, 0, 60);
+    LatencyTake(&recorder, &s);
+    CHECK_EQ(s.total, 2);
+    CHECK_EQ(s.p50, 50);
+    CHECK_EQ(s.p999, 60);
+    CHECK_EQ(s.max, 60);
+
+    LatencyRecord(&recorder, 0, 20);
+    LatencyTake(&recorder, &s);
+    CHECK_EQ(s.total, 1);
+    CHECK_EQ(s.min, 20);
+    CHECK_EQ(s.max, 20);
+
+    LatencyTake(&recorder, &s);
+    CHECK_EQ(s.total, 0);
+    CHECK_EQ(s.max, 0);
+    CHECK_EQ(recorder.histograms[0].max, 0);
+    CHECK_EQ(recorder.histograms[1].max, 0);
+
+    /* Both histograms have been taken and cleared */
+    unsigned i;
+    uint32_t sum = 0;
+    for (i = 0; i < LATENCY_BUCKETS; i++)
+        sum += recorder.histograms[0].count[i] + recorder.histograms[1].count[i];
+    CHECK_EQ(sum, 0);
+}
+
+/* Simulated hardware. TIM2 and the DWT counter run at HCLK with an offset, simulated time is in TIM2 ticks.
+ * A GPIO access takes bus cycles, the other registers take none. */
+
+#define CYCLES_OFFSET 0x12345678U
+#define IDR_CYCLES 3 /* GPIOB->IDR read */
+#define ODR_CYCLES 2 /* GPIOA->ODR write, done when it returns */
+#define HANDLER_CYCLES (IDR_CYCLES + ODR_CYCLES)
+
+uint32_t SystemCoreClock = 84000000;
+uint32_t zx_timer_cycles_offset = CYCLES_OFFSET;
+
+static uint32_t sim_time;
+static GPIO_TypeDef gpio_a, gpio_b;
+static TIM_TypeDef tim2;
+static DWT_Type dwt;
+static CoreDebug_Type core_debug;
+static EXTI_TypeDef exti;
+static char output[256]; /* Last DebugOutput line */
+
+GPIO_TypeDef *SimGpioA() {
+    sim_time += ODR_CYCLES;
+    return &gpio_a;
+}
+
+GPIO_TypeDef *SimGpioB() {
+    sim_time += IDR_CYCLES;
+    return &gpio_b;
+}
+
+TIM_TypeDef *SimTim2() {
+    tim2.CNT = sim_time;
+    return &tim2;
+}
+
+DWT_Type *SimDwt() {
+    dwt.CYCCNT = sim_time + CYCLES_OFFSET;
+    return &dwt;
+}
+
+CoreDebug_Type *SimCoreDebug() {
+    return &core_debug;
+}
+
+EXTI_TypeDef *SimExti() {
+    return &exti;
+}
+
+void ZxTimerInit() {
+}
+
+void DebugOutput(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(output, sizeof(output), format, args);
+    va_end(args);
+}
+
+void EXTI9_5_IRQHandler();
+
+/* KBD_RD falls at the edge time with A8-A15 on PB0-PB7, the handler starts entry cycles later. Returns D0-D4. */
+static uint32_t Read(uint32_t edge, uint32_t entry, uint8_t address) {
+    tim2.CCR1 = edge;
+    gpio_b.IDR = 0xA500 | address; /* The other pins of the port are not the address */
+    gpio_a.ODR = 0;
+    exti.PR = 0;
+    sim_time = edge + entry;
+    EXTI9_5_IRQHandler();
+    CHECK_EQ(exti.PR, 0xFFFF);
+    return gpio_a.ODR;
+}
+
+/* The published keys are on D0-D4 and the latency counts up to the end of the ODR write */
+static void TestResponder() {
+    static const uint8_t zx_matrix[ZX_MATRIX_ROWS] = {0x01, 0, 0, 0, 0, 0x04, 0, 0};
+    uint32_t cycles, at;
+    char expected[sizeof(output)];
+    unsigned i;
+
+    ResponderPublish(zx_matrix);
+    CHECK_EQ(Read(1000, 12, 0xFF), 0xFF);
+    CHECK_EQ(Read(2000, 12, 0xFE), 0xFE); /* Row 0 */
+    CHECK_EQ(Read(3000, 12, 0xDF), 0xFB); /* Row 5 */
+    CHECK_EQ(Read(4000, 12, 0x00), 0xFA); /* All rows */
+    ResponderReport();
+    snprintf(expected, sizeof(expected),
+             "Latency: 4 reads, min %u, p50 %u, p99 %u, p99.9 %u, max %u cycles, handler in flash\r\n",
+             12 + HANDLER_CYCLES, 12 + HANDLER_CYCLES, 12 + HANDLER_CYCLES, 12 + HANDLER_CYCLES, 12 + HANDLER_CYCLES);
+    CHECK(strcmp(output, expected) == 0);
+
+    /* 1000 reads entered after 12 cycles, 10 after 30, the longest after 60 across the wrap of TIM2 */
+    for (i = 0; i < 1000; i++)
+        Read(10000 + i * 100, 12, 0xFE);
+    for (i = 0; i < 10; i++)
+        Read(200000 + i * 100, 30, 0xFE);
+    CHECK_EQ(Read(0xFFFFFFF0, 60, 0xFE), 0xFE);
+    ResponderReport();
+    snprintf(expected, sizeof(expected),
+             "Latency: 1011 reads, min %u, p50 %u, p99 %u, p99.9 %u, max %u cycles, handler in flash\r\n",
+             12 + HANDLER_CYCLES, 12 + HANDLER_CYCLES, 30 + HANDLER_CYCLES, 30 + HANDLER_CYCLES, 60 + HANDLER_CYCLES);
+    CHECK(strcmp(output, expected) == 0);
+    ResponderLatencyMax(&cycles, &at);
+    CHECK_EQ(cycles, 60 + HANDLER_CYCLES);
+    CHECK_EQ(at, (uint32_t)(0xFFFFFFF0 + 60 + HANDLER_CYCLES));
+
+    ResponderReport();
+    CHECK(strncmp(output, "Latency: 0 reads,", 17) == 0);
+}
+
+int main() {
+    TestEmpty();
+    TestBuckets();
+    TestWrap();
+    TestOverflow();
+    TestReset();
+    TestResponder();
+    return TestResult("latency");
+}
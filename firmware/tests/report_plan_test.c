@@ -0,0 +1,536 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The report descriptor compiler and the plan decoder. The descriptor arrives in pieces of any size,
+ * the plan must not depend on where they end. */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "report_plan.h"
+#include "responder.h"
+#include "zx_keys.h"
+#include "test.h"
+
+#define ARRAY_SIZE(A) (sizeof(A) / sizeof(A[0]))
+
+/* HID 1.11 appendix B.1 */
+static const uint8_t boot_desc[] = {
+    0x05, 0x01, 0x09, 0x06, 0xA1, 0x01,                   /* Generic desktop, keyboard, application */
+    0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x08, 0x81, 0x02, /* Mods */
+    0x95, 0x01, 0x75, 0x08, 0x81, 0x01,                   /* Reserved */
+    0x95, 0x05, 0x75, 0x01, 0x05, 0x08, 0x19, 0x01, 0x29, 0x05, 0x91, 0x02, /* LEDs */
+    0x95, 0x01, 0x75, 0x03, 0x91, 0x01,                   /* LED padding */
+    0x95, 0x06, 0x75, 0x08, 0x15, 0x00, 0x25, 0x65, 0x05, 0x07, 0x19, 0x00, 0x29, 0x65, 0x81, 0x00, /* Keys */
+    0xC0,
+};
+
+/* The same with 4 byte items, a usage page in the usages and a long item: most pieces split an item */
+static const uint8_t wide_desc[] = {
+    0x07, 0x01, 0x00, 0x00, 0x00, 0x0B, 0x06, 0x00, 0x01, 0x00, 0xA1, 0x01,
+    0x1B, 0xE0, 0x00, 0x07, 0x00, 0x2B, 0xE7, 0x00, 0x07, 0x00, 0x17, 0x00, 0x00, 0x00, 0x00,
+    0x27, 0x01, 0x00, 0x00, 0x00, 0x77, 0x01, 0x00, 0x00, 0x00,
+    0x97, 0x08, 0x00, 0x00, 0x00, 0x83, 0x02, 0x00, 0x00, 0x00,
+    0x97, 0x01, 0x00, 0x00, 0x00, 0x77, 0x08, 0x00, 0x00, 0x00, 0x83, 0x01, 0x00, 0x00, 0x00,
+    0x97, 0x06, 0x00, 0x00, 0x00, 0x27, 0x65, 0x00, 0x00, 0x00, 0x07, 0x07, 0x00, 0x00, 0x00,
+    0x1B, 0x00, 0x00, 0x07, 0x00, 0x2B, 0x65, 0x00, 0x07, 0x00, 0x83, 0x00, 0x00, 0x00, 0x00,
+    0xC0,
+};
+
+static const uint8_t long_item_desc[] = {
+    0x05, 0x01, 0x09, 0x06, 0xA1, 0x01,
+    0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x08, 0x81, 0x02,
+    0xFE, 0x03, 0x10, 0x01, 0x02, 0x03, /* Long item, 3 data bytes, tag 10 */
+    0xC0,
+};
+
+/* N-key rollover: modifiers and a bit for every key from 00 to 77 */
+static const uint8_t nkro_desc[] = {
+    0x05, 0x01, 0x09, 0x06, 0xA1, 0x01,
+    0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x08, 0x81, 0x02,
+    0x95, 0x01, 0x75, 0x08, 0x81, 0x01,
+    0x05, 0x07, 0x19, 0x00, 0x29, 0x77, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x78, 0x81, 0x02,
+    0x95, 0x05, 0x75, 0x01, 0x05, 0x08, 0x19, 0x01, 0x29, 0x05, 0x91, 0x02,
+    0x95, 0x01, 0x75, 0x03, 0x91, 0x01,
+    0xC0,
+};
+
+/* Consumer control with report ID 2 before a keyboard with report ID 1 and a 0-255 key array */
+static const uint8_t report_id_desc[] = {
+    0x05, 0x0C, 0x09, 0x01, 0xA1, 0x01, 0x85, 0x02,
+    0x15, 0x00, 0x26, 0xFF, 0x03, 0x19, 0x00, 0x2A, 0xFF, 0x03, 0x75, 0x10, 0x95, 0x02, 0x81, 0x00,
+    0xC0,
+    0x05, 0x01, 0x09, 0x06, 0xA1, 0x01, 0x85, 0x01,
+    0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x08, 0x81, 0x02,
+    0x95, 0x01, 0x75, 0x08, 0x81, 0x01,
+    0x95, 0x06, 0x75, 0x08, 0x15, 0x00, 0x26, 0xFF, 0x00, 0x05, 0x07, 0x19, 0x00, 0x2A, 0xFF, 0x00, 0x81, 0x00,
+    0xC0,
+};
+
+/* Game pad: X and Y 0-255, hat switch with a null state, 12 buttons. Physical range and unit items are skipped. */
+static const uint8_t gamepad_desc[] = {
+    0x05, 0x01, 0x09, 0x05, 0xA1, 0x01,
+    0x15, 0x00, 0x26, 0xFF, 0x00, 0x09, 0x30, 0x09, 0x31, 0x75, 0x08, 0x95, 0x02, 0x81, 0x02,
+    0x09, 0x39, 0x15, 0x00, 0x25, 0x07, 0x35, 0x00, 0x46, 0x3B, 0x01, 0x65, 0x14, 0x75, 0x04, 0x95, 0x01, 0x81, 0x42,
+    0x75, 0x04, 0x95, 0x01, 0x81, 0x01,
+    0x05, 0x09, 0x19, 0x01, 0x29, 0x0C, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x0C, 0x81, 0x02,
+    0x75, 0x04, 0x95, 0x01, 0x81, 0x01,
+    0xC0,
+};
+
+/* Joystick with report ID 3: signed 16 bit X and Y in a physical collection, 2 buttons */
+static const uint8_t joystick_desc[] = {
+    0x05, 0x01, 0x09, 0x04, 0xA1, 0x01, 0x85, 0x03,
+    0x09, 0x01, 0xA1, 0x00, 0x09, 0x30, 0x09, 0x31, 0x16, 0x00, 0x80, 0x26, 0xFF, 0x7F, 0x75, 0x10, 0x95, 0x02,
+    0x81, 0x02, 0xC0,
+    0x05, 0x09, 0x19, 0x01, 0x29, 0x02, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x02, 0x81, 0x02,
+    0x75, 0x06, 0x95, 0x01, 0x81, 0x01,
+    0xC0,
+};
+
+typedef struct {
+    const char *name;
+    const uint8_t *desc;
+    unsigned length;
+} Descriptor;
+
+#define DESCRIPTOR(D) {#D, D, sizeof(D)}
+
+static const Descriptor descriptors[] = {
+    DESCRIPTOR(boot_desc),
+    DESCRIPTOR(wide_desc),
+    DESCRIPTOR(long_item_desc),
+    DESCRIPTOR(nkro_desc),
+    DESCRIPTOR(report_id_desc),
+    DESCRIPTOR(gamepad_desc),
+    DESCRIPTOR(joystick_desc),
+};
+
+static bool Compile(const Descriptor *d, unsigned chunk, ReportPlan *plan) {
+    ReportPlanCompiler c;
+    unsigned i;
+    ReportPlanBegin(&c, plan);
+    for (i = 0; i < d->length; i += chunk)
+        ReportPlanFeed(&c, d->desc + i, d->length - i < chunk ? d->length - i : chunk);
+    return ReportPlanEnd(&c);
+}
+
+/* What the descriptors compile to */
+static void TestCompile() {
+    ReportPlan plan, wide;
+    CHECK(Compile(&descriptors[0], sizeof(boot_desc), &plan));
+    CHECK_EQ(plan.report_id, 0);
+    CHECK_EQ(plan.fields_count, 2);
+    CHECK_EQ(plan.fields[0].type, REPORT_PLAN_BITMAP);
+    CHECK_EQ(plan.fields[0].usage, 0xE0);
+    CHECK_EQ(plan.fields[0].count, 8);
+    CHECK_EQ(plan.fields[1].type, REPORT_PLAN_ARRAY);
+    CHECK_EQ(plan.fields[1].offset, 16);
+    CHECK_EQ(plan.fields[1].count, 6);
+    CHECK_EQ(plan.fields[1].logical_max, 0x65);
+
+    CHECK(Compile(&descriptors[1], sizeof(wide_desc), &wide));
+    CHECK(memcmp(&plan, &wide, sizeof(plan)) == 0);
+
+    CHECK(!Compile(&descriptors[2], sizeof(long_item_desc), &plan));
+    CHECK_EQ(plan.fields_count, 0);
+
+    CHECK(Compile(&descriptors[3], sizeof(nkro_desc), &plan));
+    CHECK_EQ(plan.fields_count, 2);
+    CHECK_EQ(plan.fields[1].type, REPORT_PLAN_BITMAP);
+    CHECK_EQ(plan.fields[1].offset, 16);
+    CHECK_EQ(plan.fields[1].count, 0x78);
+
+    CHECK(Compile(&descriptors[4], sizeof(report_id_desc), &plan));
+    CHECK_EQ(plan.report_id, 1);
+    CHECK_EQ(plan.fields_count, 2);
+    CHECK_EQ(plan.fields[1].offset, 16); /* Counted from the keyboard report, not after the consumer one */
+    CHECK_EQ(plan.fields[1].logical_max, 0xFF);
+}
+
+/* Fed in pieces the way the control pipe may deliver them, the plan is the one from the whole descriptor */
+static void TestChunks() {
+    static const unsigned chunks[] = {1, 3, 7, 64};
+    unsigned d, i;
+    for (d = 0; d < ARRAY_SIZE(descriptors); d++) {
+        ReportPlan whole;
+        const bool whole_ok = Compile(&descriptors[d], descriptors[d].length, &whole);
+        for (i = 0; i < ARRAY_SIZE(chunks); i++) {
+            ReportPlan plan;
+            const bool ok = Compile(&descriptors[d], chunks[i], &plan);
+            if (ok != whole_ok || memcmp(&plan, &whole, sizeof(plan)) != 0) {
+                printf("%s in %u byte pieces compiles differently\n", descriptors[d].name, chunks[i]);
+                test_failures++;
+            }
+        }
+    }
+}
+
+static bool HasReportIds(const uint8_t *desc, unsigned desc_length) {
+    unsigned i;
+    for (i = 0; i < desc_length; i += 1 + ((desc[i] & 3) == 3 ? 4 : desc[i] & 3))
+        if ((desc[i] & 0xFC) == 0x84)
+            return true;
+    return false;
+}
+
+/* Reference decoder: walks the descriptor for every report, as a generic HID parser does. Short items,
+ * keyboard page inputs, report IDs. Returns false if the report ID has no keyboard input. */
+static bool WalkDecode(const uint8_t *desc, unsigned desc_length, const uint8_t *report, unsigned length,
+                       uint8_t *modifiers, uint32_t keys[8]) {
+    uint32_t page = 0, size = 0, count = 0, id = 0, bits = 0;
+    int32_t logical_min = 0, logical_max = 0;
+    uint32_t usage_min = 0, usage_max = 0;
+    const bool ids = HasReportIds(desc, desc_length);
+    bool found = false;
+    unsigned i, j;
+    *modifiers = 0;
+    memset(keys, 0, 8 * sizeof(keys[0]));
+    const unsigned report_id = ids && length > 0 ? report[0] : 0;
+    if (ids) {
+        report++;
+        length = length > 0 ? length - 1 : 0;
+    }
+    for (i = 0; i < desc_length;) {
+        const uint8_t prefix = desc[i];
+        const unsigned n = (prefix & 3) == 3 ? 4 : prefix & 3;
+        uint32_t data = 0;
+        for (j = 0; j < n; j++)
+            data |= (uint32_t)desc[i + 1 + j] << (8 * j);
+        const int32_t sdata = n == 1 ? (int8_t)data : n == 2 ? (int16_t)data : (int32_t)data;
+        i += 1 + n;
+        switch (prefix & 0xFC) {
+            case 0x04:
+                page = data;
+                break;
+            case 0x14:
+                logical_min = sdata;
+                break;
+            case 0x24:
+                logical_max = logical_min >= 0 ? (int32_t)data : sdata;
+                break;
+            case 0x74:
+                size = data;
+                break;
+            case 0x84:
+                id = data;
+                bits = 0;
+                break;
+            case 0x94:
+                count = data;
+                break;
+            case 0x18:
+                usage_min = data & 0xFFFF;
+                break;
+            case 0x28:
+                usage_max = data & 0xFFFF;
+                break;
+            case 0x80:
+                if (id == report_id && page == 0x07 && (data & 1) == 0) {
+                    found = true;
+                    for (j = 0; j < count; j++) {
+                        const unsigned bit = bits + j * size;
+                        if (bit + size > length * 8)
+                            break;
+                        uint32_t value = 0, k;
+                        for (k = 0; k < size; k++)
+                            value |= (uint32_t)((report[(bit + k) / 8] >> ((bit + k) % 8)) & 1) << k;
+                        uint32_t usage;
+                        if (data & 2) {
+                            if (value == 0 || usage_min + j > usage_max)
+                                continue;
+                            usage = usage_min + j;
+                        } else {
+                            if ((int32_t)value < logical_min || (int32_t)value > logical_max)
+                                continue;
+                            usage = usage_min + value - logical_min;
+                        }
+                        if (usage >= 0xE0 && usage <= 0xE7)
+                            *modifiers |= 1 << (usage - 0xE0);
+                        else if (usage >= 0x04 && usage <= 0xFF)
+                            keys[usage >> 5] |= 1u << (usage & 31);
+                    }
+                }
+                bits += size * count;
+                usage_min = usage_max = 0;
+                break;
+            case 0x90: /* Output, collection, feature, end collection */
+            case 0xA0:
+            case 0xB0:
+            case 0xC0:
+                usage_min = usage_max = 0;
+                break;
+        }
+    }
+    return found;
+}
+
+static uint32_t random_state = 1;
+
+static uint32_t Random() {
+    random_state = random_state * 1103515245 + 12345;
+    return random_state >> 16;
+}
+
+/* The plan decodes every report as the descriptor walk does: the array keyboards with codes in and out of the
+ * logical range, the bitmap keyboard with any keys, the report ID keyboard with both IDs, short reports too */
+static void TestDecode() {
+    static const struct {
+        const uint8_t *desc;
+        unsigned desc_length;
+        unsigned length; /* Of a whole report */
+        bool bitmap;
+    } keyboards[] = {
+        {boot_desc, sizeof(boot_desc), 8, false},
+        {nkro_desc, sizeof(nkro_desc), 17, true},
+        {report_id_desc, sizeof(report_id_desc), 9, false},
+    };
+    unsigned k, n, i;
+    for (k = 0; k < ARRAY_SIZE(keyboards); k++) {
+        const Descriptor d = {"keyboard", keyboards[k].desc, keyboards[k].desc_length};
+        ReportPlan plan;
+        CHECK(Compile(&d, d.length, &plan));
+        for (n = 0; n < 20000; n++) {
+            uint8_t report[64];
+            unsigned length = keyboards[k].length;
+            for (i = 0; i < length; i++)
+                report[i] = keyboards[k].bitmap ? (uint8_t)(1 << (Random() % 8)) & (uint8_t)Random()
+                                                : Random() % 4 == 0 ? 0 : (uint8_t)Random();
+            if (plan.report_id != 0)
+                report[0] = Random() % 4 == 0 ? 2 : 1;
+            if (n % 8 == 0)
+                length = Random() % (length + 1);
+            uint8_t walk_modifiers, plan_modifiers;
+            uint32_t walk_keys[8], plan_keys[8];
+            uint16_t joystick;
+            const bool walked = WalkDecode(d.desc, d.length, report, length, &walk_modifiers, walk_keys);
+            const bool planned = ReportPlanDecode(&plan, report, length, &plan_modifiers, plan_keys, &joystick);
+            /* A report of another ID, or without its ID byte, is not the keyboard one */
+            if (walked != planned || (walked && (walk_modifiers != plan_modifiers ||
+                                                 memcmp(walk_keys, plan_keys, sizeof(plan_keys)) != 0))) {
+                printf("keyboard %u report %u of %u bytes decodes differently\n", k, n, length);
+                test_failures++;
+                break;
+            }
+        }
+    }
+}
+
+#define RIGHT REPORT_PLAN_JOY_RIGHT
+#define LEFT REPORT_PLAN_JOY_LEFT
+#define DOWN REPORT_PLAN_JOY_DOWN
+#define UP REPORT_PLAN_JOY_UP
+#define BUTTON(N) (1 << (REPORT_PLAN_JOY_BUTTON1 + (N) - 1))
+
+static uint16_t Joystick(const ReportPlan *plan, const uint8_t *report, unsigned length) {
+    uint8_t modifiers;
+    uint32_t keys[8];
+    uint16_t joystick = 0xFFFF;
+    unsigned i;
+    CHECK(ReportPlanDecode(plan, report, length, &modifiers, keys, &joystick));
+    CHECK_EQ(modifiers, 0);
+    for (i = 0; i < 8; i++)
+        CHECK_EQ(keys[i], 0);
+    return joystick;
+}
+
+/* Axes through the thresholds at a quarter of the range from the ends, hat positions clockwise from up */
+static void TestGamepad() {
+    static const struct {
+        uint8_t report[5];
+        uint16_t joystick;
+    } reports[] = {
+        {{0x80, 0x80, 0x08, 0x00, 0x00}, 0},             /* Centre, hat null */
+        {{0x80, 0x80, 0x0F, 0x00, 0x00}, 0},             /* Hat null, the other value out of range */
+        {{0xFF, 0x80, 0x08, 0x00, 0x00}, RIGHT},
+        {{0x00, 0x80, 0x08, 0x00, 0x00}, LEFT},
+        {{0x80, 0xFF, 0x08, 0x00, 0x00}, DOWN},
+        {{0x80, 0x00, 0x08, 0x00, 0x00}, UP},
+        {{0x3F, 0xC0, 0x08, 0x00, 0x00}, 0},             /* On the thresholds, 63 and 192 */
+        {{0x3E, 0xC1, 0x08, 0x00, 0x00}, LEFT | DOWN},   /* Just past them */
+        {{0x80, 0x80, 0x00, 0x00, 0x00}, UP},
+        {{0x80, 0x80, 0x01, 0x00, 0x00}, UP | RIGHT},
+        {{0x80, 0x80, 0x02, 0x00, 0x00}, RIGHT},
+        {{0x80, 0x80, 0x03, 0x00, 0x00}, DOWN | RIGHT},
+        {{0x80, 0x80, 0x04, 0x00, 0x00}, DOWN},
+        {{0x80, 0x80, 0x05, 0x00, 0x00}, DOWN | LEFT},
+        {{0x80, 0x80, 0x06, 0x00, 0x00}, LEFT},
+        {{0x80, 0x80, 0x07, 0x00, 0x00}, UP | LEFT},
+        {{0xFF, 0x00, 0x04, 0x00, 0x00}, RIGHT | UP | DOWN}, /* Stick and hat together */
+        {{0x80, 0x80, 0xF8, 0x01, 0x00}, BUTTON(1)},     /* The padding nibble is not the hat */
+        {{0x80, 0x80, 0x08, 0x00, 0x08}, BUTTON(12)},
+        {{0x80, 0x80, 0x08, 0x05, 0x01}, BUTTON(1) | BUTTON(3) | BUTTON(9)},
+    };
+    const Descriptor d = DESCRIPTOR(gamepad_desc);
+    ReportPlan plan;
+    unsigned i;
+    CHECK(Compile(&d, d.length, &plan));
+    CHECK_EQ(plan.report_id, 0);
+    CHECK_EQ(plan.fields_count, 4);
+    for (i = 0; i < ARRAY_SIZE(reports); i++) {
+        const uint16_t joystick = Joystick(&plan, reports[i].report, sizeof(reports[i].report));
+        if (joystick != reports[i].joystick) {
+            printf("gamepad report %u: joystick %04X, not %04X\n", i, joystick, reports[i].joystick);
+            test_failures++;
+        }
+    }
+    /* A short report has no hat and buttons, the axes are still read */
+    CHECK_EQ(Joystick(&plan, reports[2].report, 2), RIGHT);
+}
+
+/* Signed axes: compared after the sign bit is flipped, thresholds at -16385 and 16384 */
+static void TestSignedAxes() {
+    static const struct {
+        int16_t x, y;
+        uint8_t buttons;
+        uint16_t joystick;
+    } reports[] = {
+        {0, 0, 0, 0},
+        {-1, 1, 0, 0},
+        {32767, 0, 0, RIGHT},
+        {-32768, 0, 0, LEFT},
+        {0, 32767, 0, DOWN},
+        {0, -32768, 0, UP},
+        {-16385, 16384, 0, 0},
+        {-16386, 16385, 0, LEFT | DOWN},
+        {16385, -16386, 0x03, RIGHT | UP | BUTTON(1) | BUTTON(2)},
+    };
+    const Descriptor d = DESCRIPTOR(joystick_desc);
+    ReportPlan plan;
+    unsigned i;
+    CHECK(Compile(&d, d.length, &plan));
+    CHECK_EQ(plan.report_id, 3);
+    CHECK_EQ(plan.fields_count, 3);
+    for (i = 0; i < ARRAY_SIZE(reports); i++) {
+        const uint8_t report[6] = {3, (uint8_t)reports[i].x, (uint8_t)((uint16_t)reports[i].x >> 8),
+                                   (uint8_t)reports[i].y, (uint8_t)((uint16_t)reports[i].y >> 8), reports[i].buttons};
+        const uint16_t joystick = Joystick(&plan, report, sizeof(report));
+        if (joystick != reports[i].joystick) {
+            printf("joystick report %u: joystick %04X, not %04X\n", i, joystick, reports[i].joystick);
+            test_failures++;
+        }
+    }
+    const uint8_t other_id[6] = {1, 0xFF, 0x7F, 0, 0, 0};
+    uint8_t modifiers;
+    uint32_t keys[8];
+    uint16_t joystick;
+    CHECK(!ReportPlanDecode(&plan, other_id, sizeof(other_id), &modifiers, keys, &joystick));
+}
+
+/* The ZX keys of a joystick mask, the way ZxMatrixFromBoot sets them */
+static void ZxJoystick(unsigned profile, uint16_t joystick, uint8_t *zx_matrix) {
+    memset(zx_matrix, 0, ZX_MATRIX_ROWS);
+    while (joystick != 0) {
+        const uint8_t zx_key = joystick_to_zx[profile][__builtin_ctz(joystick)];
+        if (zx_key != NONE)
+            zx_matrix[ZX_GET_ADDRESS(zx_key)] |= 1 << ZX_GET_DATA(zx_key);
+        joystick &= joystick - 1;
+    }
+}
+
+static void ZxKeys(const uint8_t *keys, unsigned count, uint8_t *zx_matrix) {
+    unsigned i;
+    memset(zx_matrix, 0, ZX_MATRIX_ROWS);
+    for (i = 0; i < count; i++)
+        zx_matrix[ZX_GET_ADDRESS(keys[i])] |= 1 << ZX_GET_DATA(keys[i]);
+}
+
+/* Cursor keys 5-8 and 0, Sinclair port 1 keys 6-0, port 2 keys 1-5. Buttons 1-4 fire, 9 and 10 space and enter. */
+static void TestJoystickToZx() {
+    static const struct {
+        unsigned profile;
+        uint16_t joystick;
+        uint8_t keys[3];
+        unsigned count;
+    } cases[] = {
+        {JOYSTICK_CURSOR, 0, {0}, 0},
+        {JOYSTICK_CURSOR, LEFT, {ZX_5}, 1},
+        {JOYSTICK_CURSOR, DOWN, {ZX_6}, 1},
+        {JOYSTICK_CURSOR, UP, {ZX_7}, 1},
+        {JOYSTICK_CURSOR, RIGHT, {ZX_8}, 1},
+        {JOYSTICK_CURSOR, UP | RIGHT | BUTTON(1), {ZX_7, ZX_8, ZX_0}, 3},
+        {JOYSTICK_SINCLAIR1, LEFT, {ZX_6}, 1},
+        {JOYSTICK_SINCLAIR1, RIGHT, {ZX_7}, 1},
+        {JOYSTICK_SINCLAIR1, DOWN, {ZX_8}, 1},
+        {JOYSTICK_SINCLAIR1, UP, {ZX_9}, 1},
+        {JOYSTICK_SINCLAIR1, DOWN | LEFT | BUTTON(4), {ZX_8, ZX_6, ZX_0}, 3},
+        {JOYSTICK_SINCLAIR2, LEFT, {ZX_1}, 1},
+        {JOYSTICK_SINCLAIR2, RIGHT, {ZX_2}, 1},
+        {JOYSTICK_SINCLAIR2, DOWN, {ZX_3}, 1},
+        {JOYSTICK_SINCLAIR2, UP, {ZX_4}, 1},
+        {JOYSTICK_SINCLAIR2, UP | LEFT | BUTTON(2), {ZX_4, ZX_1, ZX_5}, 3},
+        {JOYSTICK_SINCLAIR2, BUTTON(9) | BUTTON(10), {ZX_SPACE, ZX_ENTER}, 2},
+        {JOYSTICK_SINCLAIR2, BUTTON(5) | BUTTON(8) | BUTTON(11) | BUTTON(12), {0}, 0}, /* Not mapped */
+    };
+    unsigned i, profile;
+    for (i = 0; i < ARRAY_SIZE(cases); i++) {
+        uint8_t got[ZX_MATRIX_ROWS], expected[ZX_MATRIX_ROWS];
+        ZxJoystick(cases[i].profile, cases[i].joystick, got);
+        ZxKeys(cases[i].keys, cases[i].count, expected);
+        if (memcmp(got, expected, sizeof(got)) != 0) {
+            printf("profile %u joystick %04X gives other ZX keys\n", cases[i].profile, cases[i].joystick);
+            test_failures++;
+        }
+    }
+
+    /* An arrow key indexes joystick_to_zx like its direction bit, the buttons come after the directions */
+    CHECK_EQ(RIGHT | LEFT | DOWN | UP, (1 << REPORT_PLAN_JOY_DIRECTIONS) - 1);
+    CHECK_EQ(BUTTON(1), 1 << REPORT_PLAN_JOY_DIRECTIONS);
+    for (profile = JOYSTICK_CURSOR; profile <= JOYSTICK_SINCLAIR2; profile++)
+        for (i = 0; i < REPORT_PLAN_JOY_DIRECTIONS; i++) {
+            uint8_t got[ZX_MATRIX_ROWS], expected[ZX_MATRIX_ROWS];
+            ZxJoystick(profile, 1 << i, got);
+            ZxKeys(&joystick_to_zx[profile][i], 1, expected);
+            CHECK(memcmp(got, expected, sizeof(got)) == 0);
+        }
+
+    /* From a report: the hat up-right of the game pad in every profile */
+    static const uint8_t report[5] = {0x80, 0x80, 0x01, 0x00, 0x00};
+    static const uint8_t up_right[][2] = {
+        [JOYSTICK_CURSOR] = {ZX_7, ZX_8},
+        [JOYSTICK_SINCLAIR1] = {ZX_9, ZX_7},
+        [JOYSTICK_SINCLAIR2] = {ZX_4, ZX_2},
+    };
+    const Descriptor d = DESCRIPTOR(gamepad_desc);
+    ReportPlan plan;
+    CHECK(Compile(&d, d.length, &plan));
+    const uint16_t joystick = Joystick(&plan, report, sizeof(report));
+    for (profile = JOYSTICK_CURSOR; profile <= JOYSTICK_SINCLAIR2; profile++) {
+        uint8_t got[ZX_MATRIX_ROWS], expected[ZX_MATRIX_ROWS];
+        ZxJoystick(profile, joystick, got);
+        ZxKeys(up_right[profile], 2, expected);
+        CHECK(memcmp(got, expected, sizeof(got)) == 0);
+    }
+}
+
+/* A descriptor cut inside an item does not compile */
+static void TestTruncated() {
+    const Descriptor cut = {"cut", wide_desc, 3};
+    ReportPlan plan;
+    CHECK(!Compile(&cut, 1, &plan));
+}
+
+int main() {
+    TestCompile();
+    TestChunks();
+    TestTruncated();
+    TestDecode();
+    TestGamepad();
+    TestSignedAxes();
+    TestJoystickToZx();
+    return TestResult("report_plan");
+}
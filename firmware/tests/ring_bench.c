@@ -0,0 +1,97 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The report ring against the byte FIFO it replaced, on the host: one report received and read, as the
+ * interrupt and the main loop do it. Both paths must read the same bytes. The times are of the PC with the
+ * barriers of the target (see stub/stm32f4xx.h), the firmware prints the same comparison in cycles with
+ * ZX_BENCHMARK. */
+
+#include <stdint.h>
+#include <string.h>
+#include "usbh_hid.h"
+#include "test.h"
+
+#define REPORTS 1000000
+
+static FIFO_TypeDef fifo;
+static uint8_t fifo_buf[HID_QUEUE_SIZE * HID_RING_REPORT_SIZE];
+static uint8_t rx_buf[HID_RING_REPORT_SIZE]; /* HID_Handle->pData of the FIFO version */
+static HID_RingTypeDef ring;
+
+/* Different bytes every report, so the reads can not be folded */
+static void Fill(uint8_t *dst, uint32_t n, uint16_t length) {
+    uint16_t i;
+    for (i = 0; i < length; i++)
+        dst[i] = (uint8_t)(n + i);
+}
+
+static uint32_t Sum(const uint8_t *report, uint16_t length) {
+    uint32_t sum = 0;
+    uint16_t i;
+    for (i = 0; i < length; i++)
+        sum = sum * 31 + report[i];
+    return sum;
+}
+
+/* The channel receives into pData, the interrupt copies it to the FIFO and the reader copies it out byte by byte */
+static uint32_t Fifo(uint16_t length, uint64_t *ns) {
+    uint32_t report[HID_RING_REPORT_SIZE / sizeof(uint32_t)];
+    uint32_t sum = 0;
+    uint32_t n;
+    USBH_HID_FifoInit(&fifo, fifo_buf, sizeof(fifo_buf));
+    const uint64_t start = Now();
+    for (n = 0; n < REPORTS; n++) {
+        Fill(rx_buf, n, length);
+        (void)USBH_HID_FifoWrite(&fifo, rx_buf, length);
+        if (USBH_HID_FifoRead(&fifo, report, length) == length)
+            sum += Sum((const uint8_t *)report, length);
+    }
+    *ns = Now() - start;
+    return sum;
+}
+
+/* The channel receives into the slot, the interrupt commits it and the reader copies it out in words */
+static uint32_t Ring(uint16_t length, uint64_t *ns) {
+    uint32_t report[HID_RING_REPORT_SIZE / sizeof(uint32_t)];
+    uint32_t sum = 0;
+    uint32_t n;
+    USBH_HID_RingInit(&ring);
+    const uint64_t start = Now();
+    for (n = 0; n < REPORTS; n++) {
+        Fill(USBH_HID_RingWriteSlot(&ring), n, length);
+        USBH_HID_RingCommit(&ring, length);
+        if (USBH_HID_RingRead(&ring, report, sizeof(report)) == length)
+            sum += Sum((const uint8_t *)report, length);
+    }
+    *ns = Now() - start;
+    return sum;
+}
+
+static void Bench(uint16_t length) {
+    uint64_t fifo_ns, ring_ns;
+    const uint32_t fifo_sum = Fifo(length, &fifo_ns);
+    const uint32_t ring_sum = Ring(length, &ring_ns);
+    CHECK_EQ(fifo_sum, ring_sum);
+    printf("%u byte reports: FIFO %.1f ns, ring %.1f ns per report\n", length, (double)fifo_ns / REPORTS,
+           (double)ring_ns / REPORTS);
+}
+
+int main() {
+    Bench(8);  /* Boot keyboard */
+    Bench(64); /* Full speed NKRO keyboard */
+    return TestResult("ring_bench");
+}
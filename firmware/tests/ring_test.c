@@ -0,0 +1,145 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The HID report ring with both policies, built once for each: per report received sizes, the newest report
+ * or every report, and the indexes wrapping around. */
+
+#include <stdint.h>
+#include <string.h>
+#include "usbh_hid.h"
+#include "test.h"
+
+static HID_RingTypeDef ring;
+
+/* What the host channel does: receive into the slot at head, then the transfer complete interrupt commits it */
+static int Receive(uint8_t first, uint16_t size) {
+    uint8_t *slot = USBH_HID_RingWriteSlot(&ring);
+    uint16_t i;
+    if (slot == NULL)
+        return 0;
+    for (i = 0; i < size; i++)
+        slot[i] = (uint8_t)(first + i);
+    USBH_HID_RingCommit(&ring, size);
+    return 1;
+}
+
+static void TestEmpty() {
+    uint32_t buf[HID_RING_REPORT_SIZE / sizeof(uint32_t)];
+    USBH_HID_RingInit(&ring);
+    CHECK_EQ(USBH_HID_RingRead(&ring, buf, sizeof(buf)), 0);
+    Receive(1, 8);
+    CHECK_EQ(USBH_HID_RingRead(&ring, buf, sizeof(buf)), 8);
+    CHECK_EQ(USBH_HID_RingRead(&ring, buf, sizeof(buf)), 0);
+}
+
+/* Every report comes out with its own size, a short report does not take the bytes a longer one left */
+static void TestSizes() {
+    uint32_t buf[HID_RING_REPORT_SIZE / sizeof(uint32_t)];
+    const uint8_t *bytes = (const uint8_t *)buf;
+    unsigned i;
+    USBH_HID_RingInit(&ring);
+    for (i = 0; i < HID_RING_SIZE * 2; i++) {
+        Receive(0x40, 64);
+        CHECK_EQ(USBH_HID_RingRead(&ring, buf, sizeof(buf)), 64);
+        CHECK_EQ(bytes[63], 0x40 + 63);
+    }
+    for (i = 0; i < HID_RING_SIZE; i++) {
+        memset(buf, 0xEE, sizeof(buf));
+        Receive(0x10, 3);
+        CHECK_EQ(USBH_HID_RingRead(&ring, buf, sizeof(buf)), 3);
+        CHECK_EQ(bytes[0], 0x10);
+        CHECK_EQ(bytes[2], 0x12);
+        CHECK_EQ(bytes[4], 0xEE); /* Copied in words, up to the word with the last byte */
+    }
+    Receive(0x20, 0); /* Zero length packet */
+    CHECK_EQ(USBH_HID_RingRead(&ring, buf, sizeof(buf)), 0);
+    CHECK_EQ(ring.head, ring.tail);
+
+    /* Cut to the reader's buffer */
+    Receive(0x30, 64);
+    memset(buf, 0xEE, sizeof(buf));
+    CHECK_EQ(USBH_HID_RingRead(&ring, buf, 8), 8);
+    CHECK_EQ(bytes[7], 0x37);
+    CHECK_EQ(bytes[8], 0xEE);
+}
+
+#if HID_RING_POLICY == HID_RING_LATEST
+/* The reader gets the newest report, the older are counted as skipped, the writer never waits */
+static void TestPolicy() {
+    uint32_t buf[HID_RING_REPORT_SIZE / sizeof(uint32_t)];
+    const uint8_t *bytes = (const uint8_t *)buf;
+    unsigned i;
+    USBH_HID_RingInit(&ring);
+    Receive(1, 8);
+    Receive(2, 5);
+    Receive(3, 8);
+    CHECK_EQ(USBH_HID_RingRead(&ring, buf, sizeof(buf)), 8);
+    CHECK_EQ(bytes[0], 3);
+    CHECK_EQ(ring.skipped, 2);
+    CHECK_EQ(USBH_HID_RingRead(&ring, buf, sizeof(buf)), 0);
+
+    for (i = 0; i < HID_RING_SIZE * 3; i++)
+        CHECK_EQ(Receive((uint8_t)(10 + i), (uint16_t)(4 + i)), 1);
+    CHECK_EQ(USBH_HID_RingRead(&ring, buf, sizeof(buf)), 4 + HID_RING_SIZE * 3 - 1);
+    CHECK_EQ(bytes[0], 10 + HID_RING_SIZE * 3 - 1);
+    CHECK_EQ(ring.skipped, 2 + HID_RING_SIZE * 3 - 1);
+}
+#else
+/* The reader gets every report in order, the writer gets no slot while the ring is full */
+static void TestPolicy() {
+    uint32_t buf[HID_RING_REPORT_SIZE / sizeof(uint32_t)];
+    const uint8_t *bytes = (const uint8_t *)buf;
+    unsigned i;
+    USBH_HID_RingInit(&ring);
+    for (i = 0; i < HID_RING_SIZE; i++)
+        CHECK_EQ(Receive((uint8_t)(10 + i), (uint16_t)(4 + i)), 1);
+    CHECK_EQ(Receive(99, 8), 0);
+    for (i = 0; i < HID_RING_SIZE; i++) {
+        CHECK_EQ(USBH_HID_RingRead(&ring, buf, sizeof(buf)), 4 + i);
+        CHECK_EQ(bytes[0], 10 + i);
+    }
+    CHECK_EQ(USBH_HID_RingRead(&ring, buf, sizeof(buf)), 0);
+    CHECK_EQ(Receive(20, 8), 1);
+    CHECK_EQ(USBH_HID_RingRead(&ring, buf, sizeof(buf)), 8);
+    CHECK_EQ(bytes[0], 20);
+}
+#endif
+
+/* The indexes are free running, the slot is the index modulo HID_RING_SIZE across the wrap */
+static void TestWrap() {
+    uint32_t buf[HID_RING_REPORT_SIZE / sizeof(uint32_t)];
+    const uint8_t *bytes = (const uint8_t *)buf;
+    unsigned i;
+    USBH_HID_RingInit(&ring);
+    ring.head = UINT32_MAX - 2;
+    ring.tail = UINT32_MAX - 2;
+    for (i = 0; i < HID_RING_SIZE * 2; i++) {
+        Receive((uint8_t)i, (uint16_t)(1 + i));
+        CHECK_EQ(USBH_HID_RingRead(&ring, buf, sizeof(buf)), 1 + i);
+        CHECK_EQ(bytes[0], i);
+    }
+    CHECK_EQ(ring.head, HID_RING_SIZE * 2 - 3);
+    CHECK_EQ(ring.tail, ring.head);
+}
+
+int main() {
+    TestEmpty();
+    TestSizes();
+    TestPolicy();
+    TestWrap();
+    return TestResult(HID_RING_POLICY == HID_RING_LATEST ? "ring latest" : "ring keep all");
+}
@@ -0,0 +1,86 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The parts of the CMSIS and HAL headers the USB Host Library and responder.c use, for the host tests */
+
+#pragma once
+
+#include <stdint.h>
+
+#define __IO volatile
+
+/* stm32f4xx_ll_usb.h */
+#define EP_TYPE_CTRL 0U
+#define EP_TYPE_ISOC 1U
+#define EP_TYPE_BULK 2U
+#define EP_TYPE_INTR 3U
+#define EP_TYPE_MSK 3U
+
+/* cmsis_gcc.h. The M4 is a single in-order core where a DMB takes a few cycles, the tests have no threads:
+ * a compiler barrier, not the host fence that would cost the ring ~10 ns a barrier in ring_bench */
+#define __DMB() __asm__ volatile("" ::: "memory")
+
+/* stm32f4xx_hal_def.h */
+#define UNUSED(X) (void)X
+
+/* The registers responder.c uses, simulated by latency_test.c. Every access goes through a function, so the
+ * simulation advances its cycle counter in the order the interrupt handler touches the hardware. */
+
+typedef struct {
+    volatile uint32_t IDR;
+    volatile uint32_t ODR;
+} GPIO_TypeDef;
+
+typedef struct {
+    volatile uint32_t CNT;
+    volatile uint32_t CCR1;
+} TIM_TypeDef;
+
+typedef struct {
+    volatile uint32_t CTRL;
+    volatile uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct {
+    volatile uint32_t DEMCR;
+} CoreDebug_Type;
+
+typedef struct {
+    volatile uint32_t PR;
+} EXTI_TypeDef;
+
+GPIO_TypeDef *SimGpioA();
+GPIO_TypeDef *SimGpioB();
+TIM_TypeDef *SimTim2();
+DWT_Type *SimDwt();
+CoreDebug_Type *SimCoreDebug();
+EXTI_TypeDef *SimExti();
+
+#define GPIOA SimGpioA()
+#define GPIOB SimGpioB()
+#define TIM2 SimTim2()
+#define DWT SimDwt()
+#define CoreDebug SimCoreDebug()
+#define EXTI SimExti()
+
+#define DWT_CTRL_CYCCNTENA_Msk 1U
+#define CoreDebug_DEMCR_TRCENA_Msk (1U << 24)
+
+extern uint32_t SystemCoreClock;
+
+/* stm32f4xx_hal_gpio.h */
+#define __HAL_GPIO_EXTI_CLEAR_IT(__EXTI_LINE__) (EXTI->PR = (__EXTI_LINE__))
@@ -0,0 +1,55 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/* Checks for the host tests. A failed check is printed and the test goes on, main returns TestResult(). */
+
+static int test_failures;
+
+#define CHECK(E)                                                                                                      \
+    do {                                                                                                              \
+        if (!(E)) {                                                                                                   \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #E);                                              \
+            test_failures++;                                                                                          \
+        }                                                                                                             \
+    } while (0)
+
+#define CHECK_EQ(A, B)                                                                                                \
+    do {                                                                                                              \
+        const long long a_ = (long long)(A), b_ = (long long)(B);                                                     \
+        if (a_ != b_) {                                                                                               \
+            printf("%s:%d: %s == %s failed: %lld != %lld\n", __FILE__, __LINE__, #A, #B, a_, b_);                     \
+            test_failures++;                                                                                          \
+        }                                                                                                             \
+    } while (0)
+
+static inline int TestResult(const char *name) {
+    printf("%s: %s\n", name, test_failures == 0 ? "ok" : "FAILED");
+    return test_failures == 0 ? 0 : 1;
+}
+
+/* Monotonic time for the benchmarks, ns */
+static inline uint64_t Now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
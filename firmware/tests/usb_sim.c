@@ -0,0 +1,515 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "usb_sim.h"
+#include "usbh_hub.h"
+
+#define SIM_CHANNELS 8
+#define SIM_RESET_MS 10
+#define SIM_PROCESS_PER_MS 4
+
+typedef struct {
+    uint8_t open;
+    uint8_t ep;
+    uint8_t address;
+    uint8_t speed;
+    uint8_t type;
+    uint16_t mps;
+    uint8_t toggle;
+    USBH_URBStateTypeDef urb;
+    uint32_t xfer;
+} SimChannel;
+
+typedef struct {
+    SimDevice *dev;
+    uint16_t status;
+    uint16_t change;
+    uint8_t reset_left;
+} SimPort;
+
+const uint8_t sim_hub_dev_desc[18] = {0x12, 0x01, 0x00, 0x02, 0x09, 0x00, 0x00, 0x40, 0x40, 0x1A,
+                                      0x01, 0x01, 0x11, 0x01, 0x00, 0x00, 0x00, 0x01};
+const uint8_t sim_hub_cfg_desc[25] = {0x09, 0x02, 0x19, 0x00, 0x01, 0x01, 0x00, 0xE0, 0x32,
+                                      0x09, 0x04, 0x00, 0x00, 0x01, 0x09, 0x00, 0x00, 0x00,
+                                      0x07, 0x05, 0x81, 0x03, 0x01, 0x00, 0x0C};
+const uint8_t sim_hub_desc[9] = {0x09, 0x29, SIM_HUB_PORTS, 0x00, 0x00, 0x32, 0x64, 0x00, 0xFF};
+
+const uint8_t sim_fs_kbd_dev_desc[18] = {0x12, 0x01, 0x10, 0x01, 0x00, 0x00, 0x00, 0x08, 0x6D, 0x04,
+                                         0x1C, 0xC3, 0x00, 0x64, 0x00, 0x00, 0x00, 0x01};
+const uint8_t sim_ls_kbd_dev_desc[18] = {0x12, 0x01, 0x10, 0x01, 0x00, 0x00, 0x00, 0x08, 0xC4, 0x04,
+                                         0x05, 0x01, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01};
+const uint8_t sim_kbd_cfg_desc[34] = {0x09, 0x02, 0x22, 0x00, 0x01, 0x01, 0x00, 0xA0, 0x32,
+                                      0x09, 0x04, 0x00, 0x00, 0x01, 0x03, 0x01, 0x01, 0x00,
+                                      0x09, 0x21, 0x11, 0x01, 0x00, 0x01, 0x22, 0x3F, 0x00,
+                                      0x07, 0x05, 0x81, 0x03, 0x08, 0x00, 0x0A};
+
+uint32_t sim_errors;
+uint32_t sim_ctl_switches;
+
+static uint32_t sim_tick;
+static SimChannel sim_channels[SIM_CHANNELS];
+static SimDevice *sim_root;
+static uint8_t sim_root_connected;
+static uint8_t sim_root_reset;
+static uint8_t sim_root_enabled;
+static SimPort sim_ports[SIM_HUB_PORTS + 1]; /* 1.. */
+static SimDevice *sim_ctl_device;             /* Control transfer in progress, between SETUP and status */
+static SimDevice *sim_ctl_last;
+
+static void SimError(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    printf("sim %u ms: ", (unsigned)sim_tick);
+    vprintf(format, args);
+    printf("\n");
+    va_end(args);
+    sim_errors++;
+}
+
+void SimInit() {
+    memset(sim_channels, 0, sizeof(sim_channels));
+    memset(sim_ports, 0, sizeof(sim_ports));
+    sim_root = NULL;
+    sim_root_connected = 0;
+    sim_root_reset = 0;
+    sim_root_enabled = 0;
+    sim_ctl_device = NULL;
+    sim_ctl_last = NULL;
+    sim_errors = 0;
+    sim_ctl_switches = 0;
+}
+
+static uint8_t SimPortValid(uint16_t port) {
+    return port >= 1 && port <= sim_root->hub_desc[2];
+}
+
+static uint8_t SimHubReachable() {
+    return sim_root_connected && sim_root_enabled;
+}
+
+/* Devices that answer on an address, the hub and the enabled ports of the hub */
+static SimDevice *SimFind(uint8_t address) {
+    SimDevice *found = NULL;
+    unsigned port;
+    if (!SimHubReachable())
+        return NULL;
+    if (sim_root->address == address)
+        found = sim_root;
+    for (port = 1; port <= SIM_HUB_PORTS; port++) {
+        SimDevice *d = sim_ports[port].dev;
+        if (d == NULL || (sim_ports[port].status & HUB_PORT_ENABLE) == 0 || d->address != address)
+            continue;
+        if (found != NULL)
+            SimError("%s and %s at address %u", found->name, d->name, address);
+        found = d;
+    }
+    return found;
+}
+
+static uint8_t SimPresent(SimDevice *d) {
+    return d != NULL && SimFind(d->address) == d;
+}
+
+static void SimConnection(uint8_t port) {
+    SimPort *p = &sim_ports[port];
+    if ((p->status & SIM_PORT_POWER) == 0)
+        return;
+    p->status = SIM_PORT_POWER;
+    if (p->dev != NULL)
+        p->status |= HUB_PORT_CONNECTION | (p->dev->speed == USBH_SPEED_LOW ? HUB_PORT_LOW_SPEED : 0);
+    p->change |= HUB_C_PORT_CONNECTION;
+}
+
+void SimPlug(uint8_t port, SimDevice *d) {
+    sim_ports[port].dev = d;
+    d->address = 0;
+    d->configuration = 0;
+    SimConnection(port);
+}
+
+void SimUnplug(uint8_t port) {
+    sim_ports[port].dev = NULL;
+    sim_ports[port].reset_left = 0;
+    SimConnection(port);
+}
+
+uint16_t SimPortStatus(uint8_t port) {
+    return sim_ports[port].status;
+}
+
+uint16_t SimPortChange(uint8_t port) {
+    return sim_ports[port].change;
+}
+
+/* The hub is powered by the root port, its ports are off until SET_FEATURE(PORT_POWER) */
+static void SimHubOff() {
+    unsigned port;
+    for (port = 1; port <= SIM_HUB_PORTS; port++) {
+        sim_ports[port].status = 0;
+        sim_ports[port].change = 0;
+        sim_ports[port].reset_left = 0;
+    }
+}
+
+void SimConnectRoot(USBH_HandleTypeDef *phost, SimDevice *d) {
+    sim_root = d;
+    sim_root_connected = 1;
+    sim_root_enabled = 0;
+    d->address = 0;
+    d->configuration = 0;
+    (void)USBH_LL_Connect(phost);
+}
+
+void SimDisconnectRoot(USBH_HandleTypeDef *phost) {
+    sim_root_connected = 0;
+    sim_root_enabled = 0;
+    SimHubOff();
+    (void)USBH_LL_Disconnect(phost);
+}
+
+static void SimReply(SimDevice *d, const uint8_t *data, uint16_t size) {
+    memcpy(d->in, data, size);
+    d->in_len = size;
+}
+
+/* Requests of the hub class, 0 - done, 1 - stall */
+static uint8_t SimHubRequest(SimDevice *d, uint8_t type, uint8_t request, uint16_t value, uint16_t index) {
+    SimPort *p = &sim_ports[index];
+    if (type == 0xA0 && request == USB_REQ_GET_DESCRIPTOR && (value >> 8) == USB_DESC_TYPE_HUB) {
+        SimReply(d, d->hub_desc, d->hub_desc[0]);
+        return 0;
+    }
+    if ((type & 0x1F) != USB_REQ_RECIPIENT_OTHER || !SimPortValid(index))
+        return 1;
+    if (type == 0xA3 && request == USB_REQ_GET_STATUS) {
+        const uint8_t status[4] = {(uint8_t)p->status, (uint8_t)(p->status >> 8), (uint8_t)p->change,
+                                   (uint8_t)(p->change >> 8)};
+        SimReply(d, status, sizeof(status));
+        return 0;
+    }
+    if (type == 0x23 && request == USB_REQ_SET_FEATURE && value == HUB_FEAT_PORT_POWER) {
+        if ((p->status & SIM_PORT_POWER) == 0) {
+            p->status = SIM_PORT_POWER;
+            if (p->dev != NULL)
+                SimConnection((uint8_t)index);
+        }
+        return 0;
+    }
+    if (type == 0x23 && request == USB_REQ_SET_FEATURE && value == HUB_FEAT_PORT_RESET) {
+        if ((p->status & HUB_PORT_CONNECTION) != 0) {
+            p->status &= (uint16_t)~HUB_PORT_ENABLE;
+            p->reset_left = SIM_RESET_MS;
+        }
+        return 0;
+    }
+    if (type == 0x23 && request == USB_REQ_CLEAR_FEATURE && value >= HUB_FEAT_C_PORT_CONNECTION &&
+        value <= HUB_FEAT_C_PORT_RESET) {
+        p->change &= (uint16_t)~(1U << (value - HUB_FEAT_C_PORT_CONNECTION));
+        return 0;
+    }
+    return 1;
+}
+
+/* Starts the request in the setup packet, 0 - accepted, 1 - stall */
+static uint8_t SimRequest(SimDevice *d) {
+    const uint8_t type = d->setup[0];
+    const uint8_t request = d->setup[1];
+    const uint16_t value = LE16(&d->setup[2]);
+    const uint16_t index = LE16(&d->setup[4]);
+    const uint16_t length = LE16(&d->setup[6]);
+    uint8_t stall = 1;
+
+    d->in_len = 0;
+    d->in_offset = 0;
+    d->new_address = 0xFF;
+
+    if (type == 0x80 && request == USB_REQ_GET_DESCRIPTOR && (value >> 8) == USB_DESC_TYPE_DEVICE) {
+        SimReply(d, d->dev_desc, d->dev_desc[0]);
+        stall = 0;
+    } else if (type == 0x80 && request == USB_REQ_GET_DESCRIPTOR && (value >> 8) == USB_DESC_TYPE_CONFIGURATION) {
+        SimReply(d, d->cfg_desc, LE16(&d->cfg_desc[2]));
+        stall = 0;
+    } else if (type == 0x81 && request == USB_REQ_GET_DESCRIPTOR && (value >> 8) == USB_DESC_TYPE_HID_REPORT &&
+               d->report_desc != NULL) {
+        SimReply(d, d->report_desc, d->report_desc_size);
+        stall = 0;
+    } else if (type == 0x00 && request == USB_REQ_SET_ADDRESS) {
+        d->new_address = (uint8_t)value;
+        stall = 0;
+    } else if (type == 0x00 && request == USB_REQ_SET_CONFIGURATION) {
+        d->configuration = (uint8_t)value;
+        stall = 0;
+    } else if (type == 0x00 && request == USB_REQ_SET_FEATURE && value == FEATURE_SELECTOR_REMOTEWAKEUP) {
+        stall = 0;
+    } else if (type == 0x02 && request == USB_REQ_CLEAR_FEATURE && value == FEATURE_SELECTOR_ENDPOINT) {
+        stall = 0;
+    } else if (d->hub_desc != NULL && (type & 0x60U) == USB_REQ_TYPE_CLASS) {
+        stall = SimHubRequest(d, type, request, value, index);
+    } else if (d->hub_desc == NULL && type == 0x21) {
+        d->class_requests++;
+        stall = 0;
+    }
+
+    if (d->in_len > length)
+        d->in_len = length;
+    return stall;
+}
+
+static USBH_URBStateTypeDef SimControl(SimDevice *d, SimChannel *ch, uint8_t direction, uint8_t token,
+                                       uint8_t *buff, uint16_t length) {
+    uint16_t size;
+
+    if (token == USBH_PID_SETUP) {
+        if (sim_ctl_device != NULL && sim_ctl_device != d && SimPresent(sim_ctl_device))
+            SimError("control transfer of %s interrupted by %s", sim_ctl_device->name, d->name);
+        if (sim_ctl_last != NULL && sim_ctl_last != d)
+            sim_ctl_switches++;
+        sim_ctl_device = d;
+        sim_ctl_last = d;
+        memcpy(d->setup, buff, sizeof(d->setup));
+        d->stall = SimRequest(d);
+        return USBH_URB_DONE;
+    }
+
+    if (sim_ctl_device != d) {
+        SimError("%s: data or status stage without SETUP", d->name);
+        return USBH_URB_ERROR;
+    }
+
+    if (d->stall) {
+        sim_ctl_device = NULL;
+        return USBH_URB_STALL;
+    }
+
+    if (direction == 1U && length != 0U) {
+        /* Data IN */
+        size = (uint16_t)(d->in_len - d->in_offset);
+        if (size > length)
+            size = length;
+        if (size > d->dev_desc[7] && ch->mps != d->dev_desc[7])
+            SimError("%s: EP0 opened with packet size %u instead of %u", d->name, ch->mps, d->dev_desc[7]);
+        memcpy(buff, &d->in[d->in_offset], size);
+        d->in_offset += size;
+        ch->xfer = size;
+        return USBH_URB_DONE;
+    }
+
+    if (length == 0U) {
+        /* Status stage, SET_ADDRESS takes effect after it */
+        if (d->new_address != 0xFF)
+            d->address = d->new_address;
+        sim_ctl_device = NULL;
+    }
+    return USBH_URB_DONE;
+}
+
+static USBH_URBStateTypeDef SimInterrupt(SimDevice *d, SimChannel *ch, uint8_t *buff, uint16_t length) {
+    unsigned port;
+    uint8_t bitmap = 0;
+
+    if (d->configuration == 0)
+        SimError("%s: interrupt IN before SET_CONFIGURATION", d->name);
+    if (d->report_desc != NULL && ch->ep == 0x81) {
+        d->polls++;
+        if (d->report_size == 0)
+            return USBH_URB_NOTREADY;
+        if (length < d->report_size)
+            SimError("%s: report of %u bytes into %u", d->name, d->report_size, length);
+        ch->xfer = length < d->report_size ? length : d->report_size;
+        memcpy(buff, d->report, ch->xfer);
+        d->report_size = 0;
+        d->reports++;
+        return USBH_URB_DONE;
+    }
+    if (d->hub_desc == NULL || ch->ep != 0x81 || length == 0)
+        return USBH_URB_NOTREADY;
+
+    /* Status change endpoint, NAK while nothing changed */
+    for (port = 1; port <= SIM_HUB_PORTS; port++)
+        if (sim_ports[port].change != 0)
+            bitmap |= (uint8_t)(1U << port);
+    if (bitmap == 0)
+        return USBH_URB_NOTREADY;
+    buff[0] = bitmap;
+    ch->xfer = 1;
+    return USBH_URB_DONE;
+}
+
+void SimRun(USBH_HandleTypeDef *phost, uint32_t ms) {
+    unsigned i;
+    while (ms-- != 0) {
+        sim_tick++;
+        for (i = 1; i <= SIM_HUB_PORTS; i++) {
+            SimPort *p = &sim_ports[i];
+            if (p->reset_left != 0 && --p->reset_left == 0) {
+                p->status |= HUB_PORT_ENABLE;
+                p->change |= HUB_C_PORT_RESET;
+                p->dev->address = 0;
+                p->dev->configuration = 0;
+            }
+        }
+        if (SimHubReachable())
+            USBH_LL_IncTimer(phost);
+        for (i = 0; i < SIM_PROCESS_PER_MS; i++)
+            (void)USBH_Process(phost);
+    }
+}
+
+/* USBH_LL layer of usbh_conf.c */
+
+USBH_StatusTypeDef USBH_LL_Init(USBH_HandleTypeDef *phost) {
+    (void)phost;
+    return USBH_OK;
+}
+
+USBH_StatusTypeDef USBH_LL_DeInit(USBH_HandleTypeDef *phost) {
+    (void)phost;
+    return USBH_OK;
+}
+
+USBH_StatusTypeDef USBH_LL_Start(USBH_HandleTypeDef *phost) {
+    (void)phost;
+    return USBH_OK;
+}
+
+USBH_StatusTypeDef USBH_LL_Stop(USBH_HandleTypeDef *phost) {
+    (void)phost;
+    return USBH_OK;
+}
+
+USBH_StatusTypeDef USBH_LL_DriverVBUS(USBH_HandleTypeDef *phost, uint8_t state) {
+    (void)phost;
+    (void)state;
+    return USBH_OK;
+}
+
+USBH_SpeedTypeDef USBH_LL_GetSpeed(USBH_HandleTypeDef *phost) {
+    (void)phost;
+    return (USBH_SpeedTypeDef)sim_root->speed;
+}
+
+USBH_StatusTypeDef USBH_LL_ResetPort2(USBH_HandleTypeDef *phost, uint32_t resetActiveState) {
+    if (resetActiveState != 0) {
+        sim_root_reset = 1;
+        sim_root_enabled = 0;
+        return USBH_OK;
+    }
+    if (sim_root_reset && sim_root_connected) {
+        sim_root_enabled = 1;
+        sim_root->address = 0;
+        sim_root->configuration = 0;
+        SimHubOff();
+        USBH_LL_PortEnabled(phost);
+    }
+    sim_root_reset = 0;
+    return USBH_OK;
+}
+
+USBH_StatusTypeDef USBH_LL_ResetPort(USBH_HandleTypeDef *phost) {
+    (void)USBH_LL_ResetPort2(phost, 1U);
+    return USBH_LL_ResetPort2(phost, 0U);
+}
+
+USBH_StatusTypeDef USBH_LL_OpenPipe(USBH_HandleTypeDef *phost, uint8_t pipe, uint8_t epnum, uint8_t dev_address,
+                                    uint8_t speed, uint8_t ep_type, uint16_t mps) {
+    SimChannel *ch = &sim_channels[pipe];
+    (void)phost;
+    if (pipe >= SIM_CHANNELS) {
+        SimError("open of channel %u", pipe);
+        return USBH_FAIL;
+    }
+    memset(ch, 0, sizeof(*ch));
+    ch->open = 1;
+    ch->ep = epnum;
+    ch->address = dev_address;
+    ch->speed = speed;
+    ch->type = ep_type;
+    ch->mps = mps;
+    return USBH_OK;
+}
+
+USBH_StatusTypeDef USBH_LL_ClosePipe(USBH_HandleTypeDef *phost, uint8_t pipe) {
+    (void)phost;
+    if (pipe < SIM_CHANNELS)
+        sim_channels[pipe].open = 0;
+    return USBH_OK;
+}
+
+USBH_StatusTypeDef USBH_LL_SubmitURB(USBH_HandleTypeDef *phost, uint8_t pipe, uint8_t direction, uint8_t ep_type,
+                                     uint8_t token, uint8_t *pbuff, uint16_t length, uint8_t do_ping) {
+    SimChannel *ch = &sim_channels[pipe];
+    SimDevice *d;
+    (void)phost;
+    (void)do_ping;
+
+    if (pipe >= SIM_CHANNELS || !ch->open) {
+        SimError("transfer on closed channel %u", pipe);
+        return USBH_FAIL;
+    }
+    ch->xfer = 0;
+
+    /* Nobody answers, the channel halts with a transaction error */
+    d = SimFind(ch->address);
+    if (d == NULL) {
+        ch->urb = USBH_URB_ERROR;
+        return USBH_OK;
+    }
+
+    if (ch->speed != d->speed) {
+        SimError("%s: channel %u speed %u, device speed %u", d->name, pipe, ch->speed, d->speed);
+        ch->urb = USBH_URB_ERROR;
+        return USBH_OK;
+    }
+
+    if (ep_type == USBH_EP_CONTROL)
+        ch->urb = SimControl(d, ch, direction, token, pbuff, length);
+    else
+        ch->urb = SimInterrupt(d, ch, pbuff, length);
+    return USBH_OK;
+}
+
+USBH_URBStateTypeDef USBH_LL_GetURBState(USBH_HandleTypeDef *phost, uint8_t pipe) {
+    (void)phost;
+    return sim_channels[pipe].urb;
+}
+
+uint32_t USBH_LL_GetLastXferSize(USBH_HandleTypeDef *phost, uint8_t pipe) {
+    (void)phost;
+    return sim_channels[pipe].xfer;
+}
+
+USBH_StatusTypeDef USBH_LL_SetToggle(USBH_HandleTypeDef *phost, uint8_t pipe, uint8_t toggle) {
+    (void)phost;
+    sim_channels[pipe].toggle = toggle;
+    return USBH_OK;
+}
+
+uint8_t USBH_LL_GetToggle(USBH_HandleTypeDef *phost, uint8_t pipe) {
+    (void)phost;
+    return sim_channels[pipe].toggle;
+}
+
+void USBH_Delay(uint32_t Delay) {
+    sim_tick += Delay;
+}
+
+uint32_t USBH_GetTick(void) {
+    return sim_tick;
+}
@@ -0,0 +1,92 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Simulated OTG FS host port for the host tests. It takes the place of usbh_conf.c: a hub on the root port,
+ * devices on the ports of the hub. Whatever a real bus would not allow is counted in sim_errors. */
+
+#pragma once
+
+#include <stdint.h>
+#include "usbh_core.h"
+
+#define SIM_HUB_PORTS 4
+
+/* wPortStatus, not used by usbh_hub.c */
+#define SIM_PORT_POWER 0x0100U
+
+typedef struct {
+    const char *name;
+    uint8_t speed; /* USBH_SPEED_FULL, USBH_SPEED_LOW */
+    const uint8_t *dev_desc;
+    const uint8_t *cfg_desc;
+    const uint8_t *hub_desc;    /* NULL - not a hub */
+    const uint8_t *report_desc; /* HID, NULL - interrupt IN NAKs */
+    uint16_t report_desc_size;
+
+    uint8_t address;
+    uint8_t configuration;
+    uint32_t class_requests; /* Interface requests of the class, SET_IDLE and alike */
+
+    /* HID report, sent once on the next interrupt IN, NAK after that like a keyboard with SET_IDLE(0) */
+    uint8_t report[8];
+    uint8_t report_size;
+    uint32_t polls;   /* Interrupt IN transactions */
+    uint32_t reports; /* Of them with data */
+
+    /* Control transfer in progress */
+    uint8_t setup[8];
+    uint8_t stall;
+    uint8_t new_address;
+    uint8_t in[256];
+    uint16_t in_len;
+    uint16_t in_offset;
+} SimDevice;
+
+extern uint32_t sim_errors;
+extern uint32_t sim_ctl_switches; /* Control transfers to another device than the previous one */
+
+/* A 4 port hub, 100 ms from power on to power good */
+extern const uint8_t sim_hub_dev_desc[18];
+extern const uint8_t sim_hub_cfg_desc[25];
+extern const uint8_t sim_hub_desc[9];
+
+/* Boot keyboards with an 8 byte EP0 polled every 10 ms, the full speed one wants remote wakeup */
+extern const uint8_t sim_fs_kbd_dev_desc[18];
+extern const uint8_t sim_ls_kbd_dev_desc[18];
+extern const uint8_t sim_kbd_cfg_desc[34];
+
+/* SimDevice initializers, more fields can follow */
+#define SIM_HUB(...)                                                                                                  \
+    {.name = "hub", .speed = USBH_SPEED_FULL, .dev_desc = sim_hub_dev_desc, .cfg_desc = sim_hub_cfg_desc,             \
+     .hub_desc = sim_hub_desc, __VA_ARGS__}
+#define SIM_FS_KBD(...)                                                                                               \
+    {.name = "fs_kbd", .speed = USBH_SPEED_FULL, .dev_desc = sim_fs_kbd_dev_desc, .cfg_desc = sim_kbd_cfg_desc,       \
+     __VA_ARGS__}
+#define SIM_LS_KBD(...)                                                                                               \
+    {.name = "ls_kbd", .speed = USBH_SPEED_LOW, .dev_desc = sim_ls_kbd_dev_desc, .cfg_desc = sim_kbd_cfg_desc,        \
+     __VA_ARGS__}
+
+void SimInit();
+void SimConnectRoot(USBH_HandleTypeDef *phost, SimDevice *d);
+void SimDisconnectRoot(USBH_HandleTypeDef *phost);
+void SimPlug(uint8_t port, SimDevice *d);
+void SimUnplug(uint8_t port);
+uint16_t SimPortStatus(uint8_t port);
+uint16_t SimPortChange(uint8_t port);
+
+/* Every ms: SOF, then the main loop calls USBH_Process a few times */
+void SimRun(USBH_HandleTypeDef *phost, uint32_t ms);
@@ -0,0 +1,85 @@
+/*
+ * USB keyboard controller for ZX Spectrum
+ * Copyright (c) 2023 Aleksey Morozov aleksey.f.morozov@gmail.com aleksey.f.morozov@yandex.ru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "responder.h"
+#include "zx_prepare.h"
+#include "test.h"
+
+/* The ZX_KERNEL_TABLE recurrence against the formula: a row is read when its address line is low, the
+ * entry is the inverted OR of the read rows. All 256 entries, random matrices with a fixed seed. */
+
+#define RANDOM_MATRICES 10000
+
+static uint32_t random_state = 1;
+
+static uint32_t Random() {
+    random_state = random_state * 1103515245 + 12345;
+    return random_state >> 16;
+}
+
+static uint8_t ZxNaive(const uint8_t *zx_matrix, unsigned address) {
+    uint8_t pressed = 0;
+    unsigned j;
+    for (j = 0; j < ZX_MATRIX_ROWS; j++)
+        if ((address & (1 << j)) == 0)
+            pressed |= zx_matrix[j];
+    return ~pressed;
+}
+
+static void CheckMatrix(const uint8_t *zx_matrix) {
+    uint8_t table[ZX_TABLE_SIZE];
+    unsigned address;
+    memset(table, 0x55, sizeof(table));
+    ZxPrepareTable(table, zx_matrix);
+    for (address = 0; address < ZX_TABLE_SIZE; address++) {
+        const uint8_t expected = ZxNaive(zx_matrix, address);
+        if (table[address] != expected) {
+            printf("matrix %02X %02X %02X %02X %02X %02X %02X %02X, address %02X: %02X, not %02X\n", zx_matrix[0],
+                   zx_matrix[1], zx_matrix[2], zx_matrix[3], zx_matrix[4], zx_matrix[5], zx_matrix[6], zx_matrix[7],
+                   address, table[address], expected);
+            test_failures++;
+            return;
+        }
+    }
+}
+
+int main() {
+    uint8_t zx_matrix[ZX_MATRIX_ROWS];
+    unsigned i, j;
+
+    memset(zx_matrix, 0, sizeof(zx_matrix));
+    CheckMatrix(zx_matrix);
+    memset(zx_matrix, 0xFF, sizeof(zx_matrix));
+    CheckMatrix(zx_matrix);
+
+    /* Every single key */
+    for (i = 0; i < ZX_MATRIX_ROWS * 8; i++) {
+        memset(zx_matrix, 0, sizeof(zx_matrix));
+        zx_matrix[i / 8] = 1 << (i % 8);
+        CheckMatrix(zx_matrix);
+    }
+
+    /* Random, sparse like typing and dense */
+    for (i = 0; i < RANDOM_MATRICES; i++) {
+        for (j = 0; j < ZX_MATRIX_ROWS; j++)
+            zx_matrix[j] = (i & 1) ? Random() : Random() & Random() & Random() & 0x1F;
+        CheckMatrix(zx_matrix);
+    }
+    return TestResult("zx_prepare");
+}